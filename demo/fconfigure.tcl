@@ -77,7 +77,7 @@ if { [catch { set vi [visa::open $rm $visaAddr] } rc] } {
 
 # check interface type of the instrument opened
 # serial options only allowed for "serial" interface type
-if { [visa::get-attribute $vi $visa::ATTR_INTF_TYPE] != $visa::INTF_ASRL } {
+if { [visa::get-attribute $vi [visa::const ATTR_INTF_TYPE]] != [visa::const INTF_ASRL] } {
 	puts "Instrument has non-serial interface type"
 	exit
 }
@@ -130,8 +130,8 @@ checkOption $vi -timeout 1000
 checkOption $vi -timeout 10000
 
 # notice usage of predefined VISA constants
-checkOption $vi -timeout $visa::TMO_IMMEDIATE
-checkOption $vi -timeout $visa::TMO_INFINITE
+checkOption $vi -timeout [visa::const TMO_IMMEDIATE]
+checkOption $vi -timeout [visa::const TMO_INFINITE]
 
 # restore initial timeout
 fconfigure $vi -timeout $timeout
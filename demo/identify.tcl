@@ -53,24 +53,24 @@ if { [catch { set vi [visa::open $rm $visaAddr] } rc] } {
   exit
 }
 
+# Clear device and discard any unread data
+visa::clear $vi
+
 # Send command to instrument. New line is added automatically by `puts`.
 puts $vi "*CLS"
 
-# Set zero timeout for non-blocking reading
-# This is an equivalent of visa::set-attribute $vi $visa::ATTR_TMO_VALUE 0
-fconfigure $vi -timeout 0
+# Let `read` return exactly one instrument message, so that we need not
+# wait for a timeout to know where the answer ends.
+fconfigure $vi -message 1
 
-# Read all from input buffer.
-while { [gets $vi ] != "" } {}
+# This is an equivalent of visa::set-attribute $vi [visa::const ATTR_TMO_VALUE] 500
+fconfigure $vi -timeout 500
 
 # Send command to query device identity string
 puts $vi "*IDN?"
 
-# This is an equivalent of visa::set-attribute $vi $visa::ATTR_TMO_VALUE 500
-fconfigure $vi -timeout 500
-
-# Read device's answer. Trailing new line char is removed by `gets`.
-set id [gets $vi]
+# Read device's answer and remove trailing new line char.
+set id [string trimright [read $vi] "\n"]
 
 puts "Identity of `$visaAddr` is `$id`"
 
@@ -58,7 +58,7 @@ set ans [gets $vi]
 if { $ans == "" } {
   # Either timeout error or empty device response
   set err [visa::last-error $vi]
-  if { [lindex $err 0] == $visa::ERROR_TMO } {
+  if { [lindex $err 0] == [visa::const ERROR_TMO] } {
     puts stderr "Error reading from instrument $visaAddr"
     puts stderr "Code: [lindex $err 0]"
     puts stderr "Char code: [lindex $err 1]"
@@ -0,0 +1,204 @@
+#!/usr/bin/tclsh
+
+##########################################################
+#
+# scale.tcl --
+#
+# This file is part of tclvisa library.
+#
+# Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+# All rights reserved.
+#
+# See the file "COPYING" for information on usage and redistribution
+# of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+##########################################################
+
+##########################################################
+#
+# This file measures how tclvisa behaves with many sessions open.
+# It opens a number of sessions, then drives mixed traffic (queries,
+# attribute reads and writes) over all of them, first from the main
+# thread and then from several threads each having its own sessions.
+# It reports open time, memory per session, cost of session lookup
+# and throughput.
+#
+# Best run against simulated instruments, where every resource name
+# can be opened, see src/mockvisa/README:
+#
+#   TCLVISA_LIBRARY=./libmockvisa.so tclsh demo/scale.tcl 1000 8
+#
+# Usage: scale.tcl [sessions [threads [operations [address format [native]]]]]
+#
+# Address format is passed to `format` with session number, default
+# is TCPIP0::sim%d::INSTR. If fifth argument is 1, native sessions are
+# enabled, for instance to open many sockets to one server:
+#
+#   tclsh demo/scale.tcl 1000 4 100000 TCPIP::localhost::5025::SOCKET 1
+#
+##########################################################
+
+package require tclvisa
+
+set sessions [expr {[llength $argv] >= 1 ? [lindex $argv 0] : 1000}]
+set threads [expr {[llength $argv] >= 2 ? [lindex $argv 1] : 4}]
+set operations [expr {[llength $argv] >= 3 ? [lindex $argv 2] : 20000}]
+set addrFormat [expr {[llength $argv] >= 4 ? [lindex $argv 3] : "TCPIP0::sim%d::INSTR"}]
+set native [expr {[llength $argv] >= 5 ? [lindex $argv 4] : 0}]
+
+##########################################################
+# Helpers shared with worker threads
+##########################################################
+
+set helpers {
+  # Resident memory of the process in kilobytes, 0 if unknown
+  proc rss {} {
+    if {[catch {open /proc/self/status} f]} {
+      return 0
+    }
+    set kb 0
+    foreach line [split [read $f] "\n"] {
+      if {[regexp {^VmRSS:\s+(\d+)} $line -> kb]} {
+        break
+      }
+    }
+    close $f
+    return $kb
+  }
+
+  # Opens sessions, returns list of channels
+  proc openSessions {rm addrFormat first count} {
+    set result {}
+    for {set i $first} {$i < $first + $count} {incr i} {
+      set vi [visa::open $rm [format $addrFormat $i]]
+      fconfigure $vi -timeout 1000
+      lappend result $vi
+    }
+    return $result
+  }
+
+  # One operation out of four is a query, others are attribute accesses
+  proc traffic {channels operations} {
+    set tmo [visa::const ATTR_TMO_VALUE]
+    set n [llength $channels]
+    for {set i 0} {$i < $operations} {incr i} {
+      set vi [lindex $channels [expr {$i % $n}]]
+      switch [expr {$i % 4}] {
+        0 {
+          puts $vi "*IDN?"
+          gets $vi
+        }
+        1 {
+          visa::get-attribute $vi $tmo
+        }
+        2 {
+          visa::set-attribute $vi $tmo 1000
+        }
+        3 {
+          fconfigure $vi -timeout
+        }
+      }
+    }
+  }
+
+  # Average time of cheap command which only looks session up
+  proc lookupCost {channels count} {
+    set n [llength $channels]
+    set start [clock microseconds]
+    for {set i 0} {$i < $count} {incr i} {
+      visa::last-error [lindex $channels [expr {$i % $n}]]
+    }
+    return [expr {double([clock microseconds] - $start) / $count}]
+  }
+}
+
+eval $helpers
+
+proc report {name value unit} {
+  puts [format "%-40s %12s %s" $name $value $unit]
+}
+
+##########################################################
+# ENTRY POINT
+##########################################################
+
+visa::backend native $native
+if {[catch {set rm [visa::open-default-rm]} rc]} {
+  puts stderr "Error opening default resource manager\n$rc"
+  exit 1
+}
+
+puts "$sessions sessions, $threads threads, $operations operations"
+
+# Lookup cost and memory with a single session
+set channels [openSessions $rm $addrFormat 0 1]
+set lookup1 [lookupCost $channels 100000]
+set rss0 [rss]
+
+set start [clock microseconds]
+if {[catch {lappend channels {*}[openSessions $rm $addrFormat 1 [expr {$sessions - 1}]]} rc]} {
+  puts stderr "Error opening sessions\n$rc"
+  exit 1
+}
+set openTime [expr {[clock microseconds] - $start}]
+set rss1 [rss]
+
+report "open" [format %.1f [expr {double($openTime) / ($sessions - 1)}]] "us/session"
+if {$rss0 > 0} {
+  report "memory" [format %.2f [expr {double($rss1 - $rss0) / ($sessions - 1)}]] "KB/session"
+}
+report "lookup, 1 session" [format %.3f $lookup1] "us"
+report "lookup, $sessions sessions" [format %.3f [lookupCost $channels 100000]] "us"
+
+# Traffic from main thread over all sessions
+set start [clock microseconds]
+traffic $channels $operations
+set elapsed [expr {[clock microseconds] - $start}]
+report "single thread" [format %.0f [expr {$operations * 1e6 / $elapsed}]] "ops/s"
+set rss2 [rss]
+
+foreach vi $channels {
+  close $vi
+}
+if {$rss0 > 0} {
+  report "memory after traffic" [format %.2f [expr {double($rss2 - $rss0) / ($sessions - 1)}]] "KB/session"
+}
+
+# Same traffic spread over threads, every thread has its own sessions
+if {$threads > 0 && ![catch {package require Thread}]} {
+  # Worker threads load library the same way as main thread did
+  set loadCmd {package require tclvisa}
+  foreach item [info loaded] {
+    if {[string equal -nocase [lindex $item 1] Tclvisa] && [lindex $item 0] ne ""} {
+      set loadCmd [list load [lindex $item 0] Tclvisa]
+    }
+  }
+
+  set perThread [expr {$sessions / $threads}]
+  set workers {}
+  for {set t 0} {$t < $threads} {incr t} {
+    set tid [thread::create]
+    thread::send $tid $loadCmd
+    thread::send $tid $helpers
+    thread::send $tid {set rm [visa::open-default-rm]}
+    thread::send $tid "set channels \[openSessions \$rm [list $addrFormat] [expr {$t * $perThread}] $perThread\]"
+    lappend workers $tid
+  }
+
+  set start [clock microseconds]
+  foreach tid $workers {
+    thread::send -async $tid "traffic \$channels [expr {$operations / $threads}]" done($tid)
+  }
+  foreach tid $workers {
+    if {![info exists done($tid)]} {
+      vwait done($tid)
+    }
+  }
+  set elapsed [expr {[clock microseconds] - $start}]
+  report "$threads threads" [format %.0f [expr {($operations / $threads) * $threads * 1e6 / $elapsed}]] "ops/s"
+
+  foreach tid $workers {
+    thread::release $tid
+  }
+}
+
+close $rm
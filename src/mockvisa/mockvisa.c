@@ -0,0 +1,1593 @@
+/*
+ * mockvisa.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+/*
+ * Simulated VISA library. Implements the VISA functions called by tclvisa
+ * (see VISA_API_FUNCTIONS in src/tclvisa/visa_api.h) on top of virtual
+ * instruments described in a configuration file, see README.
+ * Load it into tclvisa by TCLVISA_LIBRARY environment variable or
+ * visa::backend command. POSIX only.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+/*
+ * Constness of parameters differs between VISA versions, so vendor
+ * prototypes are hidden and functions are declared from the tclvisa list
+ */
+#define viAssertIntrSignal hidden_viAssertIntrSignal
+#define viAssertTrigger hidden_viAssertTrigger
+#define viAssertUtilSignal hidden_viAssertUtilSignal
+#define viClear hidden_viClear
+#define viClose hidden_viClose
+#define viDisableEvent hidden_viDisableEvent
+#define viEnableEvent hidden_viEnableEvent
+#define viFindNext hidden_viFindNext
+#define viFindRsrc hidden_viFindRsrc
+#define viFlush hidden_viFlush
+#define viGetAttribute hidden_viGetAttribute
+#define viGpibCommand hidden_viGpibCommand
+#define viGpibControlATN hidden_viGpibControlATN
+#define viGpibControlREN hidden_viGpibControlREN
+#define viGpibPassControl hidden_viGpibPassControl
+#define viGpibSendIFC hidden_viGpibSendIFC
+#define viInstallHandler hidden_viInstallHandler
+#define viLock hidden_viLock
+#define viOpen hidden_viOpen
+#define viOpenDefaultRM hidden_viOpenDefaultRM
+#define viParseRsrc hidden_viParseRsrc
+#define viParseRsrcEx hidden_viParseRsrcEx
+#define viRead hidden_viRead
+#define viReadSTB hidden_viReadSTB
+#define viReadToFile hidden_viReadToFile
+#define viSetAttribute hidden_viSetAttribute
+#define viTerminate hidden_viTerminate
+#define viUninstallHandler hidden_viUninstallHandler
+#define viUnlock hidden_viUnlock
+#define viWaitOnEvent hidden_viWaitOnEvent
+#define viWrite hidden_viWrite
+#define viWriteFromFile hidden_viWriteFromFile
+
+#define VISA_API_IMPLEMENTATION
+#include "visa_api.h"
+
+#undef viAssertIntrSignal
+#undef viAssertTrigger
+#undef viAssertUtilSignal
+#undef viClear
+#undef viClose
+#undef viDisableEvent
+#undef viEnableEvent
+#undef viFindNext
+#undef viFindRsrc
+#undef viFlush
+#undef viGetAttribute
+#undef viGpibCommand
+#undef viGpibControlATN
+#undef viGpibControlREN
+#undef viGpibPassControl
+#undef viGpibSendIFC
+#undef viInstallHandler
+#undef viLock
+#undef viOpen
+#undef viOpenDefaultRM
+#undef viParseRsrc
+#undef viParseRsrcEx
+#undef viRead
+#undef viReadSTB
+#undef viReadToFile
+#undef viSetAttribute
+#undef viTerminate
+#undef viUninstallHandler
+#undef viUnlock
+#undef viWaitOnEvent
+#undef viWrite
+#undef viWriteFromFile
+
+#define VISA_API(name, params) ViStatus _VI_FUNC name params;
+VISA_API_FUNCTIONS
+#undef VISA_API
+
+/* Environment variable with path to configuration file */
+#define MOCKVISA_CONFIG_ENV "MOCKVISA_CONFIG"
+
+/* Session identifiers start here, 0 is VI_NULL */
+#define SESSION_BASE 1
+
+#define ERROR_QUEUE_SIZE 32
+#define MAX_ATTRS 64
+#define MAX_LINE 4096
+#define MAX_TOKENS 8
+
+/* IEEE 488.2 status byte bits */
+#define STB_EAV 0x04
+#define STB_MAV 0x10
+#define STB_RQS 0x40
+
+typedef enum { PATTERN_RAMP, PATTERN_RANDOM, PATTERN_ZERO } BlockPattern;
+
+typedef struct _Rule {
+	char* command;	/* matched case-insensitively against command or its header */
+	char* reply;	/* NULL if command has no response */
+	ViUInt32 blockSize;	/* reply is IEEE 488.2 definite length block */
+	BlockPattern pattern;
+	int errorCode;	/* non-zero: command puts error into error queue */
+	char* errorText;
+	struct _Rule* next;
+} Rule;
+
+typedef enum { FAIL_OPEN, FAIL_READ, FAIL_WRITE, FAIL_COUNT } FailOp;
+
+typedef struct _FailRule {
+	ViUInt32 every;	/* every n-th call fails, 0 - never */
+	ViStatus status;
+} FailRule;
+
+typedef struct _Instrument {
+	char* name;	/* resource name, "*" matches any resource */
+	ViUInt32 latency;	/* ms added to every IO call */
+	ViUInt32 throughput;	/* bytes per second, 0 - unlimited */
+	ViUInt32 srqPeriod;	/* ms between service requests, 0 - none */
+	int echo;	/* unknown queries are echoed back */
+	char* defaultReply;	/* reply to unknown queries */
+	FailRule fail[FAIL_COUNT];
+	ViUInt32 openCount;
+	Rule* rules;
+	Rule* lastRule;
+	struct _Instrument* next;
+} Instrument;
+
+typedef struct _ErrorEntry {
+	int code;
+	char text[128];
+} ErrorEntry;
+
+typedef struct _AttrValue {
+	ViAttr attr;
+	ViAttrState value;
+} AttrValue;
+
+typedef enum { SESSION_FREE, SESSION_RM, SESSION_INSTR, SESSION_FIND } SessionKind;
+
+typedef struct _Session {
+	SessionKind kind;
+	ViSession vi;
+	Instrument* inst;
+	char rsrcName[VI_FIND_BUFLEN];
+	pthread_mutex_t mutex;
+
+	/* Message exchange */
+	char* output;	/* response not read yet */
+	size_t outLen, outPos, outSize;
+	char* input;	/* incomplete command */
+	size_t inLen, inSize;
+	ErrorEntry errors[ERROR_QUEUE_SIZE];
+	int errorCount;
+	int rqs;	/* service request not polled yet */
+	ViUInt32 callCount[FAIL_COUNT];
+	unsigned int seed;
+
+	AttrValue attrs[MAX_ATTRS];
+	int attrCount;
+
+	/* Service request generation */
+	int srqQueue, srqHandler;
+	double srqStart;
+	ViUInt32 srqDelivered;
+	ViHndlr handler;
+	ViAddr userHandle;
+	int handlerRunning;
+	pthread_t handlerThread;
+
+	/* viTerminate() wakes up threads waiting in viWaitOnEvent() */
+	pthread_cond_t abortCond;
+	unsigned int abortCount;
+	int waiting;
+
+	/* Find list */
+	char** found;
+	int foundCount, foundPos;
+} Session;
+
+static pthread_once_t configOnce = PTHREAD_ONCE_INIT;
+static Instrument* instruments = NULL;
+
+/* Session table grows by chunks which are never moved, lookup takes no lock */
+#define CHUNK_BITS 8
+#define CHUNK_SIZE (1 << CHUNK_BITS)
+#define CHUNK_COUNT 4096
+
+static pthread_mutex_t tableMutex = PTHREAD_MUTEX_INITIALIZER;
+static Session** chunks[CHUNK_COUNT];
+static long sessionCount = 0;
+
+/*
+ * Time
+ */
+
+static double nowMs(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void sleepMs(double ms) {
+	struct timespec ts;
+
+	if (ms <= 0) {
+		return;
+	}
+	ts.tv_sec = (time_t) (ms / 1000);
+	ts.tv_nsec = (long) ((ms - ts.tv_sec * 1000.0) * 1e6);
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {
+	}
+}
+
+static void ioDelay(Instrument* inst, size_t bytes) {
+	sleepMs(inst->latency + (inst->throughput ? bytes * 1000.0 / inst->throughput : 0.0));
+}
+
+/*
+ * Configuration
+ */
+
+static char* copyString(const char* s) {
+	char* res = (char*) malloc(strlen(s) + 1);
+	strcpy(res, s);
+	return res;
+}
+
+/* Splits line into words, double quoted words may contain \n, \r, \t, \", \\ */
+static int tokenize(char* line, char** tokens) {
+	int count = 0;
+	char* p = line;
+
+	while (count < MAX_TOKENS) {
+		char* out;
+
+		while (isspace((unsigned char) *p)) {
+			++p;
+		}
+		if (!*p || *p == '#') {
+			break;
+		}
+
+		if (*p == '"') {
+			tokens[count++] = out = ++p;
+			while (*p && *p != '"') {
+				if (*p == '\\' && p[1]) {
+					++p;
+					*out++ = *p == 'n' ? '\n' : *p == 'r' ? '\r' : *p == 't' ? '\t' : *p;
+					++p;
+				} else {
+					*out++ = *p++;
+				}
+			}
+			if (*p) {
+				++p;
+			}
+			*out = 0;
+		} else {
+			tokens[count++] = p;
+			while (*p && !isspace((unsigned char) *p)) {
+				++p;
+			}
+			if (*p) {
+				*p++ = 0;
+			}
+		}
+	}
+
+	return count;
+}
+
+static ViStatus parseStatus(const char* s) {
+	static const struct {
+		const char* name;
+		ViStatus status;
+	} names[] = {
+		{"TMO", VI_ERROR_TMO},
+		{"CONN_LOST", VI_ERROR_CONN_LOST},
+		{"IO", VI_ERROR_IO},
+		{"RSRC_NFOUND", VI_ERROR_RSRC_NFOUND},
+		{"RSRC_BUSY", VI_ERROR_RSRC_BUSY},
+		{"RSRC_LOCKED", VI_ERROR_RSRC_LOCKED},
+		{"NLISTENERS", VI_ERROR_NLISTENERS},
+		{"SYSTEM_ERROR", VI_ERROR_SYSTEM_ERROR},
+		{NULL, 0}
+	};
+	int i;
+
+	if (strncmp(s, "VI_ERROR_", 9) == 0) {
+		s += 9;
+	}
+	for (i = 0; names[i].name; ++i) {
+		if (strcmp(s, names[i].name) == 0) {
+			return names[i].status;
+		}
+	}
+
+	return (ViStatus) strtol(s, NULL, 0);
+}
+
+static Rule* addRule(Instrument* inst, const char* command) {
+	Rule* rule = (Rule*) calloc(1, sizeof(Rule));
+
+	rule->command = copyString(command);
+	if (inst->lastRule) {
+		inst->lastRule->next = rule;
+	} else {
+		inst->rules = rule;
+	}
+	inst->lastRule = rule;
+
+	return rule;
+}
+
+static Instrument* newInstrument(const char* name) {
+	Instrument* inst = (Instrument*) calloc(1, sizeof(Instrument));
+	inst->name = copyString(name);
+	return inst;
+}
+
+static void configError(const char* path, int line, const char* message) {
+	fprintf(stderr, "mockvisa: %s:%d: %s\n", path, line, message);
+}
+
+static void parseLine(const char* path, int lineNo, char** tokens, int count, Instrument** current, Instrument*** tail) {
+	Instrument* inst = *current;
+	const char* cmd = tokens[0];
+
+	if (strcmp(cmd, "instrument") == 0) {
+		if (count != 2) {
+			configError(path, lineNo, "usage: instrument rsrcName");
+			return;
+		}
+		inst = newInstrument(tokens[1]);
+		**tail = inst;
+		*tail = &inst->next;
+		*current = inst;
+		return;
+	}
+
+	if (NULL == inst) {
+		configError(path, lineNo, "directive outside of instrument");
+		return;
+	}
+
+	if (strcmp(cmd, "latency") == 0 && count == 2) {
+		inst->latency = (ViUInt32) strtoul(tokens[1], NULL, 0);
+	} else if (strcmp(cmd, "throughput") == 0 && count == 2) {
+		inst->throughput = (ViUInt32) strtoul(tokens[1], NULL, 0);
+	} else if (strcmp(cmd, "srq") == 0 && count == 2) {
+		inst->srqPeriod = (ViUInt32) strtoul(tokens[1], NULL, 0);
+	} else if (strcmp(cmd, "echo") == 0 && count == 2) {
+		inst->echo = strcmp(tokens[1], "on") == 0 || strcmp(tokens[1], "1") == 0;
+	} else if (strcmp(cmd, "default") == 0 && count == 2) {
+		inst->defaultReply = copyString(tokens[1]);
+	} else if (strcmp(cmd, "response") == 0 && count == 3) {
+		addRule(inst, tokens[1])->reply = copyString(tokens[2]);
+	} else if (strcmp(cmd, "block") == 0 && (count == 3 || count == 4)) {
+		Rule* rule = addRule(inst, tokens[1]);
+		rule->blockSize = (ViUInt32) strtoul(tokens[2], NULL, 0);
+		rule->pattern = count < 4 || strcmp(tokens[3], "ramp") == 0 ? PATTERN_RAMP
+			: strcmp(tokens[3], "random") == 0 ? PATTERN_RANDOM : PATTERN_ZERO;
+	} else if (strcmp(cmd, "error") == 0 && count == 4) {
+		Rule* rule = addRule(inst, tokens[1]);
+		rule->errorCode = (int) strtol(tokens[2], NULL, 0);
+		rule->errorText = copyString(tokens[3]);
+	} else if (strcmp(cmd, "fail") == 0 && count == 4) {
+		FailOp op = strcmp(tokens[1], "open") == 0 ? FAIL_OPEN
+			: strcmp(tokens[1], "read") == 0 ? FAIL_READ
+			: strcmp(tokens[1], "write") == 0 ? FAIL_WRITE : FAIL_COUNT;
+		if (FAIL_COUNT == op) {
+			configError(path, lineNo, "usage: fail open|read|write every status");
+			return;
+		}
+		inst->fail[op].every = (ViUInt32) strtoul(tokens[2], NULL, 0);
+		inst->fail[op].status = parseStatus(tokens[3]);
+	} else {
+		configError(path, lineNo, "unknown directive or wrong number of arguments");
+	}
+}
+
+static void loadConfig(void) {
+	const char* path = getenv(MOCKVISA_CONFIG_ENV);
+	Instrument* current = NULL;
+	Instrument** tail = &instruments;
+	char line[MAX_LINE];
+	int lineNo = 0;
+	FILE* f;
+
+	if (path && *path) {
+		f = fopen(path, "r");
+		if (NULL == f) {
+			fprintf(stderr, "mockvisa: cannot open %s: %s\n", path, strerror(errno));
+		} else {
+			while (fgets(line, sizeof(line), f)) {
+				char* tokens[MAX_TOKENS];
+				int count = tokenize(line, tokens);
+
+				++lineNo;
+				if (count > 0) {
+					parseLine(path, lineNo, tokens, count, &current, &tail);
+				}
+			}
+			fclose(f);
+		}
+	}
+
+	if (NULL == instruments) {
+		/* Without configuration any resource is a generic instrument */
+		instruments = newInstrument("*");
+	}
+}
+
+/*
+ * Sessions
+ */
+
+static Session* newSession(SessionKind kind) {
+	Session* s = (Session*) calloc(1, sizeof(Session));
+
+	s->kind = kind;
+	pthread_mutex_init(&s->mutex, NULL);
+	pthread_cond_init(&s->abortCond, NULL);
+
+	/* Sessions are never freed, identifiers are never reused */
+	pthread_mutex_lock(&tableMutex);
+	if (sessionCount < (long) CHUNK_SIZE * CHUNK_COUNT && NULL == chunks[sessionCount >> CHUNK_BITS]) {
+		__atomic_store_n(&chunks[sessionCount >> CHUNK_BITS], (Session**) calloc(CHUNK_SIZE, sizeof(Session*)), __ATOMIC_RELEASE);
+	}
+	if (sessionCount >= (long) CHUNK_SIZE * CHUNK_COUNT || NULL == chunks[sessionCount >> CHUNK_BITS]) {
+		pthread_mutex_unlock(&tableMutex);
+		pthread_cond_destroy(&s->abortCond);
+		pthread_mutex_destroy(&s->mutex);
+		free(s);
+		return NULL;
+	}
+	s->vi = (ViSession) (sessionCount + SESSION_BASE);
+	__atomic_store_n(&chunks[sessionCount >> CHUNK_BITS][sessionCount & (CHUNK_SIZE - 1)], s, __ATOMIC_RELEASE);
+	++sessionCount;
+	pthread_mutex_unlock(&tableMutex);
+
+	s->seed = (unsigned int) s->vi;
+	return s;
+}
+
+static Session* getSession(ViObject vi) {
+	Session** chunk;
+	Session* s;
+	long index = (long) vi - SESSION_BASE;
+
+	if (index < 0 || index >= (long) CHUNK_SIZE * CHUNK_COUNT) {
+		return NULL;
+	}
+	chunk = __atomic_load_n(&chunks[index >> CHUNK_BITS], __ATOMIC_ACQUIRE);
+	if (NULL == chunk) {
+		return NULL;
+	}
+	s = __atomic_load_n(&chunk[index & (CHUNK_SIZE - 1)], __ATOMIC_ACQUIRE);
+	return s && s->kind != SESSION_FREE ? s : NULL;
+}
+
+static Session* getInstrSession(ViSession vi) {
+	Session* s = getSession(vi);
+	return s && s->kind == SESSION_INSTR ? s : NULL;
+}
+
+/* Returns non-zero if configured failure should be injected into this call */
+static int injectFailure(Session* s, FailOp op) {
+	FailRule* rule = &s->inst->fail[op];
+	return rule->every && ++s->callCount[op] % rule->every == 0;
+}
+
+/*
+ * Attributes
+ */
+
+static int attrSize(ViAttr attr) {
+	switch (attr) {
+	case VI_ATTR_TERMCHAR:
+	case VI_ATTR_ASRL_XON_CHAR:
+	case VI_ATTR_ASRL_XOFF_CHAR:
+		return sizeof(ViUInt8);
+
+	case VI_ATTR_TERMCHAR_EN:
+	case VI_ATTR_SEND_END_EN:
+		return sizeof(ViBoolean);
+
+	case VI_ATTR_INTF_TYPE:
+	case VI_ATTR_INTF_NUM:
+	case VI_ATTR_TRIG_ID:
+	case VI_ATTR_ASRL_DATA_BITS:
+	case VI_ATTR_ASRL_PARITY:
+	case VI_ATTR_ASRL_STOP_BITS:
+	case VI_ATTR_ASRL_FLOW_CNTRL:
+	case VI_ATTR_ASRL_END_IN:
+	case VI_ATTR_ASRL_END_OUT:
+	case VI_ATTR_ASRL_CTS_STATE:
+	case VI_ATTR_ASRL_DCD_STATE:
+	case VI_ATTR_ASRL_DSR_STATE:
+	case VI_ATTR_ASRL_DTR_STATE:
+	case VI_ATTR_ASRL_RI_STATE:
+	case VI_ATTR_ASRL_RTS_STATE:
+	case VI_ATTR_ASRL_BREAK_STATE:
+		return sizeof(ViUInt16);
+
+	default:
+		/* Unknown attributes are reported as 32-bit values */
+		return sizeof(ViUInt32);
+	}
+}
+
+static void setAttr(Session* s, ViAttr attr, ViAttrState value) {
+	int i;
+
+	for (i = 0; i < s->attrCount; ++i) {
+		if (s->attrs[i].attr == attr) {
+			s->attrs[i].value = value;
+			return;
+		}
+	}
+	if (s->attrCount < MAX_ATTRS) {
+		s->attrs[s->attrCount].attr = attr;
+		s->attrs[s->attrCount].value = value;
+		++s->attrCount;
+	}
+}
+
+static int getAttr(Session* s, ViAttr attr, ViAttrState* value) {
+	int i;
+
+	for (i = 0; i < s->attrCount; ++i) {
+		if (s->attrs[i].attr == attr) {
+			*value = s->attrs[i].value;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static ViAttrState getAttrDefault(Session* s, ViAttr attr, ViAttrState def) {
+	ViAttrState value;
+	return getAttr(s, attr, &value) ? value : def;
+}
+
+/* Interface type and number from resource name, like "GPIB0::5::INSTR" */
+static int parseName(const char* name, ViUInt16* intfType, ViUInt16* intfNum, char* rsrcClass) {
+	static const struct {
+		const char* prefix;
+		ViUInt16 type;
+	} prefixes[] = {
+		/* Longer prefixes first */
+		{"GPIB-VXI", VI_INTF_GPIB_VXI},
+		{"GPIB", VI_INTF_GPIB},
+		{"VXI", VI_INTF_VXI},
+		{"ASRL", VI_INTF_ASRL},
+		{"PXI", VI_INTF_PXI},
+		{"TCPIP", VI_INTF_TCPIP},
+		{"USB", VI_INTF_USB},
+		{NULL, 0}
+	};
+	const char* cls;
+	int i;
+
+	for (i = 0; prefixes[i].prefix; ++i) {
+		size_t len = strlen(prefixes[i].prefix);
+
+		if (strncasecmp(name, prefixes[i].prefix, len) == 0) {
+			*intfType = prefixes[i].type;
+			*intfNum = (ViUInt16) strtoul(name + len, NULL, 10);
+
+			cls = strrchr(name, ':');
+			if (rsrcClass) {
+				strcpy(rsrcClass, cls && cls > name && cls[-1] == ':' ? cls + 1 : "INSTR");
+			}
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static void initAttrs(Session* s) {
+	ViUInt16 intfType = 0, intfNum = 0;
+
+	parseName(s->rsrcName, &intfType, &intfNum, NULL);
+	setAttr(s, VI_ATTR_TMO_VALUE, 2000);
+	setAttr(s, VI_ATTR_TERMCHAR, '\n');
+	setAttr(s, VI_ATTR_TERMCHAR_EN, VI_FALSE);
+	setAttr(s, VI_ATTR_SEND_END_EN, VI_TRUE);
+	setAttr(s, VI_ATTR_INTF_TYPE, intfType);
+	setAttr(s, VI_ATTR_INTF_NUM, intfNum);
+	setAttr(s, VI_ATTR_TRIG_ID, (ViAttrState) VI_TRIG_SW);
+	if (VI_INTF_ASRL == intfType) {
+		setAttr(s, VI_ATTR_ASRL_BAUD, 9600);
+		setAttr(s, VI_ATTR_ASRL_DATA_BITS, 8);
+		setAttr(s, VI_ATTR_ASRL_PARITY, 0);
+		setAttr(s, VI_ATTR_ASRL_STOP_BITS, 10);
+		setAttr(s, VI_ATTR_ASRL_FLOW_CNTRL, 0);
+	}
+}
+
+/*
+ * Message exchange
+ */
+
+static void appendOutput(Session* s, const char* data, size_t len) {
+	if (s->outPos == s->outLen) {
+		/* Everything is read, start from the beginning */
+		s->outPos = s->outLen = 0;
+	}
+	if (s->outLen + len > s->outSize) {
+		s->outSize = (s->outLen + len) * 2;
+		s->output = (char*) realloc(s->output, s->outSize);
+	}
+	memcpy(s->output + s->outLen, data, len);
+	s->outLen += len;
+}
+
+static void pushError(Session* s, int code, const char* text) {
+	ErrorEntry* e;
+
+	if (s->errorCount == ERROR_QUEUE_SIZE) {
+		/* SCPI replaces the last error by "Queue overflow" */
+		e = &s->errors[ERROR_QUEUE_SIZE - 1];
+		e->code = -350;
+		strcpy(e->text, "Queue overflow");
+		return;
+	}
+
+	e = &s->errors[s->errorCount++];
+	e->code = code;
+	strncpy(e->text, text, sizeof(e->text) - 1);
+	e->text[sizeof(e->text) - 1] = 0;
+}
+
+static void appendBlock(Session* s, Rule* rule) {
+	char header[32];
+	char* data = (char*) malloc(rule->blockSize + 1);
+	ViUInt32 i;
+	int digits;
+
+	digits = sprintf(header + 2, "%lu", (unsigned long) rule->blockSize);
+	header[0] = '#';
+	header[1] = (char) ('0' + digits);
+	appendOutput(s, header, (size_t) digits + 2);
+
+	for (i = 0; i < rule->blockSize; ++i) {
+		switch (rule->pattern) {
+		case PATTERN_RAMP:
+			data[i] = (char) (i & 0xFF);
+			break;
+		case PATTERN_RANDOM:
+			s->seed = s->seed * 1103515245 + 12345;
+			data[i] = (char) (s->seed >> 16);
+			break;
+		default:
+			data[i] = 0;
+		}
+	}
+	data[rule->blockSize] = '\n';
+	appendOutput(s, data, (size_t) rule->blockSize + 1);
+	free(data);
+}
+
+static void appendReply(Session* s, const char* reply) {
+	appendOutput(s, reply, strlen(reply));
+	appendOutput(s, "\n", 1);
+}
+
+static Rule* findRule(Instrument* inst, const char* command) {
+	size_t headerLen = strcspn(command, " \t");
+	Rule* rule;
+
+	/* Full command first, then its header without arguments */
+	for (rule = inst->rules; rule; rule = rule->next) {
+		if (strcasecmp(rule->command, command) == 0) {
+			return rule;
+		}
+	}
+	for (rule = inst->rules; rule; rule = rule->next) {
+		if (strlen(rule->command) == headerLen && strncasecmp(rule->command, command, headerLen) == 0) {
+			return rule;
+		}
+	}
+
+	return NULL;
+}
+
+static void processCommand(Session* s, char* command) {
+	size_t headerLen;
+	int isQuery;
+	Rule* rule;
+	char buf[VI_FIND_BUFLEN + 64];
+
+	/* Trim white space */
+	while (isspace((unsigned char) *command)) {
+		++command;
+	}
+	headerLen = strlen(command);
+	while (headerLen > 0 && isspace((unsigned char) command[headerLen - 1])) {
+		command[--headerLen] = 0;
+	}
+	if (!*command) {
+		return;
+	}
+
+	headerLen = strcspn(command, " \t");
+	isQuery = headerLen > 0 && command[headerLen - 1] == '?';
+
+	rule = findRule(s->inst, command);
+	if (rule) {
+		if (rule->errorCode) {
+			pushError(s, rule->errorCode, rule->errorText);
+		} else if (rule->blockSize) {
+			appendBlock(s, rule);
+		} else if (rule->reply) {
+			appendReply(s, rule->reply);
+		}
+		return;
+	}
+
+	/* Common commands */
+	if (strcasecmp(command, "*IDN?") == 0) {
+		snprintf(buf, sizeof(buf), "MOCKVISA,%s,0,1.0", s->rsrcName);
+		appendReply(s, buf);
+	} else if (strcasecmp(command, "SYST:ERR?") == 0 || strcasecmp(command, "SYSTEM:ERROR?") == 0
+		|| strcasecmp(command, "SYST:ERR:NEXT?") == 0) {
+		if (s->errorCount > 0) {
+			snprintf(buf, sizeof(buf), "%d,\"%s\"", s->errors[0].code, s->errors[0].text);
+			memmove(s->errors, s->errors + 1, sizeof(ErrorEntry) * --s->errorCount);
+		} else {
+			strcpy(buf, "0,\"No error\"");
+		}
+		appendReply(s, buf);
+	} else if (strcasecmp(command, "*STB?") == 0) {
+		snprintf(buf, sizeof(buf), "%d", (s->errorCount ? STB_EAV : 0) | (s->rqs ? STB_RQS : 0));
+		appendReply(s, buf);
+	} else if (strcasecmp(command, "*CLS") == 0) {
+		s->errorCount = 0;
+		s->rqs = 0;
+	} else if (strcasecmp(command, "*OPC?") == 0) {
+		appendReply(s, "1");
+	} else if (isQuery) {
+		if (s->inst->echo) {
+			appendReply(s, command);
+		} else if (s->inst->defaultReply) {
+			appendReply(s, s->inst->defaultReply);
+		} else {
+			pushError(s, -113, "Undefined header");
+		}
+	}
+	/* Other commands are accepted silently */
+}
+
+/* Adds written data to input, executes every complete command */
+/*
+ * Returns size of IEEE 488.2 definite length block starting at p with "#",
+ * 0 if block has not arrived completely or has indefinite length (lasts
+ * until END), 1 if length is malformed
+ */
+static size_t blockLength(const char* p, size_t len) {
+	size_t digits, count = 0, i;
+
+	if (len < 2 || p[1] == '0') {
+		return 0;
+	}
+	digits = (size_t) (p[1] - '0');
+	if (len < 2 + digits) {
+		return 0;
+	}
+	for (i = 2; i < 2 + digits; ++i) {
+		if (!isdigit((unsigned char) p[i])) {
+			return 1;
+		}
+		count = count * 10 + (size_t) (p[i] - '0');
+	}
+
+	return 2 + digits + count <= len ? 2 + digits + count : 0;
+}
+
+static void processInput(Session* s, const char* buf, size_t len, int end) {
+	size_t start = 0, i;
+
+	if (s->inLen + len + 1 > s->inSize) {
+		s->inSize = (s->inLen + len + 1) * 2;
+		s->input = (char*) realloc(s->input, s->inSize);
+	}
+	memcpy(s->input + s->inLen, buf, len);
+	s->inLen += len;
+	s->input[s->inLen] = 0;
+
+	for (i = 0; i < s->inLen; ++i) {
+		if (s->input[i] == '#' && i + 1 < s->inLen && isdigit((unsigned char) s->input[i + 1])) {
+			/* Line feed inside block is data, not end of command */
+			size_t size = blockLength(s->input + i, s->inLen - i);
+
+			if (0 == size) {
+				/* Wait for the rest of block or for END */
+				break;
+			}
+			i += size - 1;
+		} else if (s->input[i] == '\n') {
+			s->input[i] = 0;
+			processCommand(s, s->input + start);
+			start = i + 1;
+		}
+	}
+
+	if (end && start < s->inLen) {
+		/* END terminates the last command as well */
+		processCommand(s, s->input + start);
+		start = s->inLen;
+	}
+
+	memmove(s->input, s->input + start, s->inLen - start);
+	s->inLen -= start;
+}
+
+/*
+ * Service requests
+ */
+
+static void* handlerProc(void* arg) {
+	Session* s = (Session*) arg;
+	ViUInt32 period = s->inst->srqPeriod;
+
+	for (;;) {
+		ViHndlr handler;
+		ViAddr userHandle;
+
+		sleepMs(period);
+
+		pthread_mutex_lock(&s->mutex);
+		if (!s->srqHandler) {
+			pthread_mutex_unlock(&s->mutex);
+			break;
+		}
+		s->rqs = 1;
+		handler = s->handler;
+		userHandle = s->userHandle;
+		pthread_mutex_unlock(&s->mutex);
+
+		if (handler) {
+			handler(s->vi, VI_EVENT_SERVICE_REQ, VI_NULL, userHandle);
+		}
+	}
+
+	return NULL;
+}
+
+static void stopHandlerThread(Session* s) {
+	int running;
+
+	pthread_mutex_lock(&s->mutex);
+	s->srqHandler = 0;
+	running = s->handlerRunning;
+	s->handlerRunning = 0;
+	pthread_mutex_unlock(&s->mutex);
+
+	if (running && !pthread_equal(pthread_self(), s->handlerThread)) {
+		pthread_join(s->handlerThread, NULL);
+	}
+}
+
+/*
+ * VISA API
+ */
+
+ViStatus _VI_FUNC viOpenDefaultRM(ViSession* vi) {
+	Session* s;
+
+	pthread_once(&configOnce, loadConfig);
+	s = newSession(SESSION_RM);
+	if (NULL == s) {
+		return VI_ERROR_ALLOC;
+	}
+	*vi = s->vi;
+	return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viOpen(ViSession sesn, ViRsrc name, ViAccessMode mode, ViUInt32 timeout, ViSession* vi) {
+	Session* rm = getSession(sesn);
+	Instrument* inst;
+	Instrument* any = NULL;
+	Session* s;
+	int fail;
+
+	(void) mode;
+	(void) timeout;
+
+	if (NULL == rm || rm->kind != SESSION_RM) {
+		return VI_ERROR_INV_OBJECT;
+	}
+
+	for (inst = instruments; inst; inst = inst->next) {
+		if (strcasecmp(inst->name, name) == 0) {
+			break;
+		}
+		if (NULL == any && strcmp(inst->name, "*") == 0) {
+			any = inst;
+		}
+	}
+	if (NULL == inst) {
+		inst = any;
+	}
+	if (NULL == inst) {
+		return VI_ERROR_RSRC_NFOUND;
+	}
+
+	pthread_mutex_lock(&tableMutex);
+	fail = inst->fail[FAIL_OPEN].every && ++inst->openCount % inst->fail[FAIL_OPEN].every == 0;
+	pthread_mutex_unlock(&tableMutex);
+
+	sleepMs(inst->latency);
+	if (fail) {
+		return inst->fail[FAIL_OPEN].status;
+	}
+
+	s = newSession(SESSION_INSTR);
+	if (NULL == s) {
+		return VI_ERROR_ALLOC;
+	}
+	s->inst = inst;
+	strncpy(s->rsrcName, name, VI_FIND_BUFLEN - 1);
+	initAttrs(s);
+
+	*vi = s->vi;
+	return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viClose(ViObject vi) {
+	Session* s;
+
+	if (VI_NULL == vi) {
+		return VI_WARN_NULL_OBJECT;
+	}
+
+	s = getSession(vi);
+	if (NULL == s) {
+		return VI_ERROR_INV_OBJECT;
+	}
+
+	stopHandlerThread(s);
+	if (SESSION_INSTR == s->kind && s->inst) {
+		/* Instrument closes connection */
+		sleepMs(s->inst->latency);
+	}
+
+	pthread_mutex_lock(&s->mutex);
+	s->kind = SESSION_FREE;
+	free(s->output);
+	free(s->input);
+	s->output = s->input = NULL;
+	s->outLen = s->outPos = s->outSize = s->inLen = s->inSize = 0;
+	if (s->found) {
+		int i;
+		for (i = 0; i < s->foundCount; ++i) {
+			free(s->found[i]);
+		}
+		free(s->found);
+		s->found = NULL;
+	}
+	pthread_mutex_unlock(&s->mutex);
+
+	return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viWrite(ViSession vi, ViBuf buf, ViUInt32 cnt, ViUInt32* retCnt) {
+	Session* s = getInstrSession(vi);
+	ViStatus status = VI_SUCCESS;
+
+	if (retCnt) {
+		*retCnt = 0;
+	}
+	if (NULL == s) {
+		return VI_ERROR_INV_OBJECT;
+	}
+
+	ioDelay(s->inst, cnt);
+
+	pthread_mutex_lock(&s->mutex);
+	if (injectFailure(s, FAIL_WRITE)) {
+		status = s->inst->fail[FAIL_WRITE].status;
+	} else {
+		processInput(s, (const char*) buf, cnt, getAttrDefault(s, VI_ATTR_SEND_END_EN, VI_TRUE) != VI_FALSE);
+		if (retCnt) {
+			*retCnt = cnt;
+		}
+	}
+	pthread_mutex_unlock(&s->mutex);
+
+	return status;
+}
+
+ViStatus _VI_FUNC viRead(ViSession vi, ViPBuf buf, ViUInt32 cnt, ViUInt32* retCnt) {
+	Session* s = getInstrSession(vi);
+	ViStatus status;
+	size_t n;
+
+	if (retCnt) {
+		*retCnt = 0;
+	}
+	if (NULL == s) {
+		return VI_ERROR_INV_OBJECT;
+	}
+
+	pthread_mutex_lock(&s->mutex);
+
+	if (injectFailure(s, FAIL_READ)) {
+		status = s->inst->fail[FAIL_READ].status;
+		pthread_mutex_unlock(&s->mutex);
+		return status;
+	}
+
+	if (s->outPos == s->outLen) {
+		/* Nothing to read: wait for timeout like a real instrument */
+		ViUInt32 timeout = (ViUInt32) getAttrDefault(s, VI_ATTR_TMO_VALUE, 2000);
+		pthread_mutex_unlock(&s->mutex);
+		sleepMs(VI_TMO_INFINITE == timeout ? 0 : timeout);
+		return VI_ERROR_TMO;
+	}
+
+	n = s->outLen - s->outPos;
+	if (n > cnt) {
+		n = cnt;
+	}
+	if (getAttrDefault(s, VI_ATTR_TERMCHAR_EN, VI_FALSE) != VI_FALSE) {
+		/* Read stops after termination character */
+		char* term = memchr(s->output + s->outPos, (int) getAttrDefault(s, VI_ATTR_TERMCHAR, '\n'), n);
+		if (term) {
+			n = (size_t) (term - (s->output + s->outPos)) + 1;
+		}
+	}
+
+	memcpy(buf, s->output + s->outPos, n);
+	s->outPos += n;
+	if (retCnt) {
+		*retCnt = (ViUInt32) n;
+	}
+
+	/* END is sent with the last byte of a response */
+	if (s->outPos == s->outLen) {
+		status = VI_SUCCESS;
+	} else if (n > 0 && buf[n - 1] == (ViByte) getAttrDefault(s, VI_ATTR_TERMCHAR, '\n')
+		&& getAttrDefault(s, VI_ATTR_TERMCHAR_EN, VI_FALSE) != VI_FALSE) {
+		status = VI_SUCCESS_TERM_CHAR;
+	} else {
+		status = VI_SUCCESS_MAX_CNT;
+	}
+
+	pthread_mutex_unlock(&s->mutex);
+
+	ioDelay(s->inst, n);
+	return status;
+}
+
+ViStatus _VI_FUNC viReadToFile(ViSession vi, const char* filename, ViUInt32 cnt, ViUInt32* retCnt) {
+	char* buf = (char*) malloc(cnt ? cnt : 1);
+	ViStatus status = viRead(vi, (ViPBuf) buf, cnt, retCnt);
+	FILE* f;
+
+	if (status >= 0) {
+		f = fopen(filename, "wb");
+		if (NULL == f) {
+			status = VI_ERROR_FILE_ACCESS;
+		} else {
+			if (fwrite(buf, 1, *retCnt, f) != *retCnt) {
+				status = VI_ERROR_FILE_IO;
+			}
+			fclose(f);
+		}
+	}
+
+	free(buf);
+	return status;
+}
+
+ViStatus _VI_FUNC viWriteFromFile(ViSession vi, const char* filename, ViUInt32 cnt, ViUInt32* retCnt) {
+	char* buf = (char*) malloc(cnt ? cnt : 1);
+	ViStatus status;
+	size_t n;
+	FILE* f;
+
+	f = fopen(filename, "rb");
+	if (NULL == f) {
+		free(buf);
+		return VI_ERROR_FILE_ACCESS;
+	}
+	n = fread(buf, 1, cnt, f);
+	fclose(f);
+
+	status = viWrite(vi, (ViBuf) buf, (ViUInt32) n, retCnt);
+	free(buf);
+	return status;
+}
+
+ViStatus _VI_FUNC viReadSTB(ViSession vi, ViUInt16* status) {
+	Session* s = getInstrSession(vi);
+
+	if (NULL == s) {
+		return VI_ERROR_INV_OBJECT;
+	}
+
+	ioDelay(s->inst, 1);
+
+	pthread_mutex_lock(&s->mutex);
+	*status = (ViUInt16) ((s->errorCount ? STB_EAV : 0) | (s->outPos < s->outLen ? STB_MAV : 0) | (s->rqs ? STB_RQS : 0));
+	/* Serial poll clears request */
+	s->rqs = 0;
+	pthread_mutex_unlock(&s->mutex);
+
+	return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viClear(ViSession vi) {
+	Session* s = getInstrSession(vi);
+
+	if (NULL == s) {
+		return VI_ERROR_INV_OBJECT;
+	}
+
+	pthread_mutex_lock(&s->mutex);
+	s->outPos = s->outLen = 0;
+	s->inLen = 0;
+	pthread_mutex_unlock(&s->mutex);
+
+	return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viFlush(ViSession vi, ViUInt16 mask) {
+	(void) mask;
+	return getSession(vi) ? VI_SUCCESS : VI_ERROR_INV_OBJECT;
+}
+
+ViStatus _VI_FUNC viSetAttribute(ViObject vi, ViAttr attrName, ViAttrState attrValue) {
+	Session* s = getSession(vi);
+
+	if (NULL == s) {
+		return VI_ERROR_INV_OBJECT;
+	}
+
+	pthread_mutex_lock(&s->mutex);
+	setAttr(s, attrName, attrValue);
+	pthread_mutex_unlock(&s->mutex);
+
+	return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viGetAttribute(ViObject vi, ViAttr attrName, void* attrValue) {
+	Session* s = getSession(vi);
+	ViAttrState value;
+	int found;
+
+	if (NULL == s) {
+		return VI_ERROR_INV_OBJECT;
+	}
+
+	pthread_mutex_lock(&s->mutex);
+	if (VI_ATTR_ASRL_AVAIL_NUM == attrName) {
+		value = (ViAttrState) (s->outLen - s->outPos);
+		found = 1;
+	} else {
+		found = getAttr(s, attrName, &value);
+	}
+	pthread_mutex_unlock(&s->mutex);
+
+	if (!found) {
+		return VI_ERROR_NSUP_ATTR;
+	}
+
+	switch (attrSize(attrName)) {
+	case sizeof(ViUInt8):
+		*(ViUInt8*) attrValue = (ViUInt8) value;
+		break;
+	case sizeof(ViUInt16):
+		*(ViUInt16*) attrValue = (ViUInt16) value;
+		break;
+	default:
+		*(ViUInt32*) attrValue = (ViUInt32) value;
+	}
+
+	return VI_SUCCESS;
+}
+
+/* VISA regular expression: "?" matches any character, "*" repeats previous one */
+static int matchExpr(const char* expr, const char* name) {
+	if (!*expr) {
+		return !*name;
+	}
+
+	if (expr[1] == '*') {
+		/* Zero or more repetitions of expr[0] */
+		do {
+			if (matchExpr(expr + 2, name)) {
+				return 1;
+			}
+		} while (*name && (expr[0] == '?' || toupper((unsigned char) expr[0]) == toupper((unsigned char) *name)) && ++name);
+		return 0;
+	}
+
+	if (*name && (expr[0] == '?' || toupper((unsigned char) expr[0]) == toupper((unsigned char) *name))) {
+		return matchExpr(expr + 1, name + 1);
+	}
+
+	return 0;
+}
+
+ViStatus _VI_FUNC viFindRsrc(ViSession sesn, ViString expr, ViFindList* vi, ViUInt32* retCnt, ViChar desc[]) {
+	Session* rm = getSession(sesn);
+	Session* s;
+	Instrument* inst;
+
+	if (NULL == rm || rm->kind != SESSION_RM) {
+		return VI_ERROR_INV_OBJECT;
+	}
+
+	s = newSession(SESSION_FIND);
+	if (NULL == s) {
+		return VI_ERROR_ALLOC;
+	}
+	for (inst = instruments; inst; inst = inst->next) {
+		if (strcmp(inst->name, "*") != 0 && matchExpr(expr, inst->name)) {
+			s->found = (char**) realloc(s->found, sizeof(char*) * (s->foundCount + 1));
+			s->found[s->foundCount++] = copyString(inst->name);
+		}
+	}
+
+	if (0 == s->foundCount) {
+		viClose(s->vi);
+		return VI_ERROR_RSRC_NFOUND;
+	}
+
+	strcpy(desc, s->found[s->foundPos++]);
+	if (retCnt) {
+		*retCnt = (ViUInt32) s->foundCount;
+	}
+	if (vi) {
+		*vi = s->vi;
+	} else {
+		viClose(s->vi);
+	}
+
+	return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viFindNext(ViFindList vi, ViChar desc[]) {
+	Session* s = getSession(vi);
+	ViStatus status = VI_SUCCESS;
+
+	if (NULL == s || s->kind != SESSION_FIND) {
+		return VI_ERROR_INV_OBJECT;
+	}
+
+	pthread_mutex_lock(&s->mutex);
+	if (s->foundPos < s->foundCount) {
+		strcpy(desc, s->found[s->foundPos++]);
+	} else {
+		status = VI_ERROR_RSRC_NFOUND;
+	}
+	pthread_mutex_unlock(&s->mutex);
+
+	return status;
+}
+
+ViStatus _VI_FUNC viParseRsrc(ViSession rmSesn, ViRsrc rsrcName, ViUInt16* intfType, ViUInt16* intfNum) {
+	if (NULL == getSession(rmSesn)) {
+		return VI_ERROR_INV_OBJECT;
+	}
+	return parseName(rsrcName, intfType, intfNum, NULL) ? VI_SUCCESS : VI_ERROR_INV_RSRC_NAME;
+}
+
+ViStatus _VI_FUNC viParseRsrcEx(ViSession rmSesn, ViRsrc rsrcName, ViUInt16* intfType, ViUInt16* intfNum, ViChar rsrcClass[], ViChar expandedUnaliasedName[], ViChar aliasIfExists[]) {
+	if (NULL == getSession(rmSesn)) {
+		return VI_ERROR_INV_OBJECT;
+	}
+	if (!parseName(rsrcName, intfType, intfNum, rsrcClass)) {
+		return VI_ERROR_INV_RSRC_NAME;
+	}
+
+	strncpy(expandedUnaliasedName, rsrcName, VI_FIND_BUFLEN - 1);
+	expandedUnaliasedName[VI_FIND_BUFLEN - 1] = 0;
+	aliasIfExists[0] = 0;
+	return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viInstallHandler(ViSession vi, ViEventType eventType, ViHndlr handler, ViAddr userHandle) {
+	Session* s = getInstrSession(vi);
+
+	if (NULL == s) {
+		return VI_ERROR_INV_OBJECT;
+	}
+	if (VI_EVENT_SERVICE_REQ != eventType) {
+		return VI_ERROR_INV_EVENT;
+	}
+
+	pthread_mutex_lock(&s->mutex);
+	s->handler = handler;
+	s->userHandle = userHandle;
+	pthread_mutex_unlock(&s->mutex);
+
+	return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viUninstallHandler(ViSession vi, ViEventType eventType, ViHndlr handler, ViAddr userHandle) {
+	Session* s = getInstrSession(vi);
+
+	(void) handler;
+	(void) userHandle;
+
+	if (NULL == s) {
+		return VI_ERROR_INV_OBJECT;
+	}
+	if (VI_EVENT_SERVICE_REQ != eventType) {
+		return VI_ERROR_INV_EVENT;
+	}
+
+	pthread_mutex_lock(&s->mutex);
+	s->handler = NULL;
+	pthread_mutex_unlock(&s->mutex);
+
+	return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viEnableEvent(ViSession vi, ViEventType eventType, ViUInt16 mechanism, ViEventFilter context) {
+	Session* s = getInstrSession(vi);
+	int start = 0;
+
+	(void) context;
+
+	if (NULL == s) {
+		return VI_ERROR_INV_OBJECT;
+	}
+	if (VI_EVENT_SERVICE_REQ != eventType && VI_ALL_ENABLED_EVENTS != eventType) {
+		/* Other events are accepted, but never occur */
+		return VI_SUCCESS;
+	}
+
+	pthread_mutex_lock(&s->mutex);
+	if ((mechanism & VI_QUEUE) && !s->srqQueue) {
+		s->srqQueue = 1;
+		s->srqStart = nowMs();
+		s->srqDelivered = 0;
+	}
+	if ((mechanism & VI_HNDLR) && !s->srqHandler) {
+		if (NULL == s->handler) {
+			pthread_mutex_unlock(&s->mutex);
+			return VI_ERROR_HNDLR_NINSTALLED;
+		}
+		s->srqHandler = 1;
+		start = s->inst->srqPeriod > 0 && !s->handlerRunning;
+		s->handlerRunning |= start;
+	}
+	pthread_mutex_unlock(&s->mutex);
+
+	if (start && 0 != pthread_create(&s->handlerThread, NULL, handlerProc, s)) {
+		pthread_mutex_lock(&s->mutex);
+		s->srqHandler = s->handlerRunning = 0;
+		pthread_mutex_unlock(&s->mutex);
+		return VI_ERROR_SYSTEM_ERROR;
+	}
+
+	return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viDisableEvent(ViSession vi, ViEventType eventType, ViUInt16 mechanism) {
+	Session* s = getInstrSession(vi);
+
+	if (NULL == s) {
+		return VI_ERROR_INV_OBJECT;
+	}
+	if (VI_EVENT_SERVICE_REQ != eventType && VI_ALL_ENABLED_EVENTS != eventType) {
+		return VI_SUCCESS;
+	}
+
+	if (mechanism & VI_QUEUE) {
+		pthread_mutex_lock(&s->mutex);
+		s->srqQueue = 0;
+		pthread_mutex_unlock(&s->mutex);
+	}
+	if (mechanism & VI_HNDLR) {
+		stopHandlerThread(s);
+	}
+
+	return VI_SUCCESS;
+}
+
+/* Sleeps for ms milliseconds or forever if ms is negative, returns non-zero if aborted by viTerminate() */
+static int waitAbortable(Session* s, double ms) {
+	struct timespec ts;
+	unsigned int abortCount;
+	int aborted;
+
+	if (ms >= 0) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += (time_t) (ms / 1000);
+		ts.tv_nsec += (long) ((ms - (time_t) (ms / 1000) * 1000.0) * 1e6);
+		if (ts.tv_nsec >= 1000000000L) {
+			ts.tv_nsec -= 1000000000L;
+			++ts.tv_sec;
+		}
+	}
+
+	pthread_mutex_lock(&s->mutex);
+	abortCount = s->abortCount;
+	++s->waiting;
+	while (abortCount == s->abortCount) {
+		if (ms < 0) {
+			pthread_cond_wait(&s->abortCond, &s->mutex);
+		} else if (ETIMEDOUT == pthread_cond_timedwait(&s->abortCond, &s->mutex, &ts)) {
+			break;
+		}
+	}
+	--s->waiting;
+	aborted = abortCount != s->abortCount;
+	pthread_mutex_unlock(&s->mutex);
+
+	return aborted;
+}
+
+ViStatus _VI_FUNC viWaitOnEvent(ViSession vi, ViEventType inEventType, ViUInt32 timeout, ViEventType* outEventType, ViEvent* outContext) {
+	Session* s = getInstrSession(vi);
+	double wait, next;
+	int srq;
+
+	if (NULL == s) {
+		return VI_ERROR_INV_OBJECT;
+	}
+
+	pthread_mutex_lock(&s->mutex);
+	srq = s->srqQueue && s->inst->srqPeriod > 0
+		&& (VI_EVENT_SERVICE_REQ == inEventType || VI_ALL_ENABLED_EVENTS == inEventType);
+	next = srq ? s->srqStart + (double) (s->srqDelivered + 1) * s->inst->srqPeriod : 0;
+	pthread_mutex_unlock(&s->mutex);
+
+	if (!srq) {
+		/* Event never occurs */
+		return waitAbortable(s, VI_TMO_INFINITE == timeout ? -1 : (double) timeout) ? VI_ERROR_ABORT : VI_ERROR_TMO;
+	}
+
+	wait = next - nowMs();
+	if (VI_TMO_INFINITE != timeout && wait > timeout) {
+		/* Event does not occur within timeout */
+		return waitAbortable(s, timeout) ? VI_ERROR_ABORT : VI_ERROR_TMO;
+	}
+
+	if (waitAbortable(s, wait > 0 ? wait : 0)) {
+		return VI_ERROR_ABORT;
+	}
+
+	pthread_mutex_lock(&s->mutex);
+	++s->srqDelivered;
+	s->rqs = 1;
+	pthread_mutex_unlock(&s->mutex);
+
+	if (outEventType) {
+		*outEventType = VI_EVENT_SERVICE_REQ;
+	}
+	if (outContext) {
+		*outContext = VI_NULL;
+	}
+
+	return VI_SUCCESS;
+}
+
+/* Asynchronous jobs are not simulated, only calls of viWaitOnEvent() are aborted */
+ViStatus _VI_FUNC viTerminate(ViObject vi, ViUInt16 degree, ViJobId jobId) {
+	Session* s = getInstrSession(vi);
+
+	(void) degree;
+
+	if (NULL == s) {
+		return VI_ERROR_INV_OBJECT;
+	}
+	if (VI_NULL != jobId) {
+		return VI_ERROR_NSUP_OPER;
+	}
+
+	pthread_mutex_lock(&s->mutex);
+	if (s->waiting) {
+		++s->abortCount;
+		pthread_cond_broadcast(&s->abortCond);
+	}
+	pthread_mutex_unlock(&s->mutex);
+
+	return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viLock(ViSession vi, ViAccessMode lockType, ViUInt32 timeout, ViKeyId requestedKey, ViChar accessKey[]) {
+	(void) lockType;
+	(void) timeout;
+
+	if (NULL == getInstrSession(vi)) {
+		return VI_ERROR_INV_OBJECT;
+	}
+	if (accessKey) {
+		strcpy(accessKey, requestedKey ? requestedKey : "mockvisa");
+	}
+
+	return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viUnlock(ViSession vi) {
+	return getInstrSession(vi) ? VI_SUCCESS : VI_ERROR_INV_OBJECT;
+}
+
+ViStatus _VI_FUNC viAssertTrigger(ViSession vi, ViUInt16 protocol) {
+	Session* s = getInstrSession(vi);
+
+	(void) protocol;
+
+	if (NULL == s) {
+		return VI_ERROR_INV_OBJECT;
+	}
+
+	ioDelay(s->inst, 1);
+	return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viAssertIntrSignal(ViSession vi, ViInt16 mode, ViUInt32 statusID) {
+	(void) mode;
+	(void) statusID;
+	return getInstrSession(vi) ? VI_SUCCESS : VI_ERROR_INV_OBJECT;
+}
+
+ViStatus _VI_FUNC viAssertUtilSignal(ViSession vi, ViUInt16 line) {
+	(void) line;
+	return getInstrSession(vi) ? VI_SUCCESS : VI_ERROR_INV_OBJECT;
+}
+
+ViStatus _VI_FUNC viGpibCommand(ViSession vi, ViBuf cmd, ViUInt32 cnt, ViUInt32* retCnt) {
+	Session* s = getInstrSession(vi);
+
+	(void) cmd;
+
+	if (NULL == s) {
+		return VI_ERROR_INV_OBJECT;
+	}
+
+	ioDelay(s->inst, cnt);
+	if (retCnt) {
+		*retCnt = cnt;
+	}
+	return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viGpibControlATN(ViSession vi, ViUInt16 mode) {
+	(void) mode;
+	return getInstrSession(vi) ? VI_SUCCESS : VI_ERROR_INV_OBJECT;
+}
+
+ViStatus _VI_FUNC viGpibControlREN(ViSession vi, ViUInt16 mode) {
+	(void) mode;
+	return getInstrSession(vi) ? VI_SUCCESS : VI_ERROR_INV_OBJECT;
+}
+
+ViStatus _VI_FUNC viGpibPassControl(ViSession vi, ViUInt16 primAddr, ViUInt16 secAddr) {
+	(void) primAddr;
+	(void) secAddr;
+	return getInstrSession(vi) ? VI_SUCCESS : VI_ERROR_INV_OBJECT;
+}
+
+ViStatus _VI_FUNC viGpibSendIFC(ViSession vi) {
+	return getInstrSession(vi) ? VI_SUCCESS : VI_ERROR_INV_OBJECT;
+}
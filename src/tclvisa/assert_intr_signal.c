@@ -13,6 +13,7 @@
 
 #include <tcl.h>
 #include "visa_channel.h"
+#include "visa_reconnect.h"
 #include "visa_utils.h"
 #include "tcl_utils.h"
 #include "tclvisa_utils.h"
@@ -32,7 +33,7 @@ int tclvisa_assert_intr_signal(const ClientData clientData, Tcl_Interp* const in
 	}
 
 	/* Convert first argument to valid Tcl channel reference */
-    session = getVisaChannelFromObj(interp, objv[1]);
+    session = getConnectedVisaChannelFromObj(interp, objv[1]);
 	if (session == NULL) {
 		return TCL_ERROR;
 	}
@@ -13,10 +13,15 @@
 
 #include <tcl.h>
 #include "visa_channel.h"
+#include "visa_reconnect.h"
 #include "visa_utils.h"
 #include "tcl_utils.h"
 #include "tclvisa_utils.h"
 
+ViStatus assertVisaTrigger(VisaChannelData* session, ViUInt16 protocol) {
+	return viAssertTrigger(session->session, protocol);
+}
+
 int tclvisa_assert_trigger(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]) {
 	VisaChannelData* session;
 	ViStatus status;
@@ -31,7 +36,7 @@ int tclvisa_assert_trigger(const ClientData clientData, Tcl_Interp* const interp
 	}
 
 	/* Convert first argument to valid Tcl channel reference */
-    session = getVisaChannelFromObj(interp, objv[1]);
+    session = getConnectedVisaChannelFromObj(interp, objv[1]);
 	if (session == NULL) {
 		return TCL_ERROR;
 	}
@@ -41,7 +46,7 @@ int tclvisa_assert_trigger(const ClientData clientData, Tcl_Interp* const interp
 	}
 
 	/* Assert the trigger */
-	status = viAssertTrigger(session->session, protocol);
+	status = assertVisaTrigger(session, protocol);
 	/* Check status returned */
 	storeLastError(session, status, interp);
 
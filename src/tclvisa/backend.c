@@ -0,0 +1,78 @@
+/*
+ * backend.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+#include <tcl.h>
+#include "visa_api.h"
+#include "visa_native.h"
+#include "tcl_utils.h"
+#include "tclvisa_utils.h"
+
+int tclvisa_backend(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]) {
+	static const char* options[] = { "load", "native", NULL };
+	enum { OPT_LOAD, OPT_NATIVE };
+	int index;
+
+	UNREFERENCED_PARAMETER(clientData);	/* avoid "unused parameter" warning */
+
+	/* Check number of arguments */
+	if (objc > 3) {
+		Tcl_WrongNumArgs(interp, 1, objv, "?load path? | ?native ?boolean??");
+		return TCL_ERROR;
+	}
+
+	if (objc > 1) {
+		if (TCL_OK != Tcl_GetIndexFromObj(interp, objv[1], options, "option", 0, &index)) {
+			return TCL_ERROR;
+		}
+
+		if (OPT_NATIVE == index) {
+			/* Query or switch native sessions, see visa_native.c */
+			if (objc > 2) {
+				int enabled;
+
+				if (TCL_OK != Tcl_GetBooleanFromObj(interp, objv[2], &enabled)) {
+					return TCL_ERROR;
+				}
+#ifndef TCLVISA_NATIVE
+				if (enabled) {
+					Tcl_AppendResult(interp, "native sessions are not supported on this platform", NULL);
+					return TCL_ERROR;
+				}
+#endif
+				setVisaNativeEnabled(enabled);
+			}
+
+			Tcl_SetObjResult(interp, Tcl_NewBooleanObj(isVisaNativeEnabled()));
+			return TCL_OK;
+		}
+
+		if (objc != 3) {
+			Tcl_WrongNumArgs(interp, 2, objv, "path");
+			return TCL_ERROR;
+		}
+
+		/* Load library specified */
+		if (TCL_OK != loadVisaApi(interp, TclGetString(objv[2]), 1)) {
+			return TCL_ERROR;
+		}
+	} else {
+		/* Load default library unless some library is already loaded */
+		if (TCL_OK != loadVisaApi(interp, NULL, 1)) {
+			return TCL_ERROR;
+		}
+	}
+
+	/* Return path of library in use */
+	Tcl_SetObjResult(interp, Tcl_NewStringObj(getVisaApiPath(), -1));
+	return TCL_OK;
+}
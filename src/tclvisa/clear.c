@@ -13,6 +13,7 @@
 
 #include <tcl.h>
 #include "visa_channel.h"
+#include "visa_reconnect.h"
 #include "visa_utils.h"
 #include "tcl_utils.h"
 #include "tclvisa_utils.h"
@@ -30,13 +31,18 @@ int tclvisa_clear(const ClientData clientData, Tcl_Interp* const interp, const i
 	}
 
 	/* Convert first argument to valid Tcl channel reference */
-    session = getVisaChannelFromObj(interp, objv[1]);
+    session = getConnectedVisaChannelFromObj(interp, objv[1]);
 	if (session == NULL) {
 		return TCL_ERROR;
 	}
 
 	/* Attempt to clear instrument */
 	status = viClear(session->session);
+	if (status >= 0) {
+		/* Pending response is discarded by instrument */
+		session->queryPending = 0;
+	}
+
 	/* Check status returned */
 	storeLastError(session, status, interp);
 
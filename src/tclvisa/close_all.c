@@ -0,0 +1,97 @@
+/*
+ * close_all.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+/*
+ * Channels are unregistered one by one in the calling thread, as usual.
+ * Their close procedures only collect sessions into a batch, then the
+ * sessions are flushed and closed by worker threads in parallel.
+ */
+
+#include <tcl.h>
+#include "visa_channel.h"
+#include "visa_close.h"
+#include "visa_pool.h"
+#include "visa_utils.h"
+#include "tcl_utils.h"
+#include "tclvisa_utils.h"
+
+int tclvisa_close_all(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]) {
+	static const char* options[] = {"-threads", NULL};
+
+	VisaChannelData* rmSession;
+	VisaChannelData** channels;
+	VisaCloseBatch batch;
+	ViStatus status;
+	int threadCount = VISA_POOL_DEFAULT_THREADS, count;
+	int i, index;
+
+	UNREFERENCED_PARAMETER(clientData);	/* avoid "unused parameter" warning */
+
+	/* Check number of arguments */
+	if (objc != 2 && objc != 4) {
+		Tcl_WrongNumArgs(interp, 1, objv, "RMsession ?-threads n?");
+		return TCL_ERROR;
+	}
+
+	/* Convert first argument to valid Tcl channel reference */
+	rmSession = getVisaChannelFromObj(interp, objv[1]);
+	if (rmSession == NULL) {
+		return TCL_ERROR;
+	}
+
+	if (!rmSession->isRMSession) {
+		Tcl_AppendResult(interp, "channel \"", Tcl_GetChannelName(rmSession->channel), "\" is not a resource manager session", NULL);
+		return TCL_ERROR;
+	}
+
+	if (objc == 4) {
+		if (TCL_OK != Tcl_GetIndexFromObj(interp, objv[2], options, "option", 0, &index)
+			|| TCL_OK != Tcl_GetIntFromObj(interp, objv[3], &threadCount)) {
+			return TCL_ERROR;
+		}
+		if (threadCount < 1) {
+			Tcl_AppendResult(interp, "number of threads must be positive", NULL);
+			return TCL_ERROR;
+		}
+	}
+
+	count = getVisaChannelsOfRM(interp, rmSession->session, &channels);
+	if (count < 0) {
+		return TCL_ERROR;
+	}
+
+	batch.sessions = (ViSession*) ckalloc(sizeof(ViSession) * (count + 1));
+	batch.count = 0;
+
+	for (i = 0; i < count; ++i) {
+		Tcl_Channel channel = channels[i]->channel;
+
+		if (!Tcl_IsChannelShared(channel) && !channels[i]->asyncPending) {
+			/* Channel is closed right now, blocking mode makes Tcl flush it first */
+			channels[i]->closeBatch = &batch;
+			Tcl_SetChannelOption(NULL, channel, "-blocking", "1");
+		}
+
+		/* Channel used elsewhere is closed later in a usual way */
+		Tcl_UnregisterChannel(interp, channel);
+	}
+
+	status = closeVisaBatch(&batch, threadCount);
+	storeLastError(rmSession, status, NULL);
+
+	Tcl_SetObjResult(interp, Tcl_NewIntObj(batch.count));
+
+	ckfree((char*) batch.sessions);
+	ckfree((char*) channels);
+	return TCL_OK;
+}
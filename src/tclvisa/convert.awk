@@ -1,8 +1,11 @@
+# Generates visa_constants.inc from the "#define VI_xxx" lines of visa.h.
+# Input must be sorted by name, because visa_constants.c looks constants up
+# with a binary search, e.g.:
+#   grep '^#define VI_' visa.h | LC_ALL=C sort -k2,2 -u | awk -f convert.awk
 {
 	if ( $2 != "" ) {
 		print "#ifdef", $2
-		print "addIntVar(", $2, ");"
+		print "visaConstant(", $2, ")"
 		print "#endif\n";
 	}
 }
-
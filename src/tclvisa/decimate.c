@@ -0,0 +1,338 @@
+/*
+ * decimate.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+/*
+ * Reduces packed waveform to a number of points suitable for plotting.
+ * Input is split into buckets, every bucket gives its minimum and maximum
+ * in order of appearance, or its mean, or one point selected by
+ * Largest-Triangle-Three-Buckets algorithm. Independent buckets of minmax
+ * and mean modes may be processed by several threads.
+ */
+
+#include <tcl.h>
+#include <string.h>
+#include "visa_pool.h"
+#include "visa_waveform.h"
+#include "tcl_utils.h"
+#include "tclvisa_utils.h"
+
+enum DecimateMode { MODE_MINMAX, MODE_MEAN, MODE_LTTB };
+
+typedef struct _Decimation {
+	const unsigned char* data;
+	int type;	/* SAMPLE_FLOAT32 or SAMPLE_FLOAT64 */
+	size_t count;	/* input samples */
+	size_t buckets;
+	int jobs;
+	int xy;	/* output sample indices too */
+	unsigned char* out;
+} Decimation;
+
+#define SAMPLE(d, i) (SAMPLE_FLOAT64 == (d)->type ? ((const double*) (d)->data)[i] : (double) ((const float*) (d)->data)[i])
+
+/* Bucket b covers samples [bucketStart(b), bucketStart(b + 1)) */
+static size_t bucketStart(const Decimation* d, size_t b) {
+	return (size_t) ((Tcl_WideUInt) d->count * b / d->buckets);
+}
+
+static void put(const Decimation* d, size_t k, double x, double y) {
+	if (d->xy) {
+		k *= 2;
+		if (SAMPLE_FLOAT64 == d->type) {
+			((double*) d->out)[k++] = x;
+		} else {
+			((float*) d->out)[k++] = (float) x;
+		}
+	}
+
+	if (SAMPLE_FLOAT64 == d->type) {
+		((double*) d->out)[k] = y;
+	} else {
+		((float*) d->out)[k] = (float) y;
+	}
+}
+
+/* Index of minimum and maximum in [from, to), loop is the same for both types */
+#define MINMAX_LOOP(T) { \
+		const T* v = (const T*) d->data; \
+		T lo = v[from], hi = v[from]; \
+		for (i = from + 1; i < to; ++i) { \
+			if (v[i] < lo) { lo = v[i]; iMin = i; } \
+			if (v[i] > hi) { hi = v[i]; iMax = i; } \
+		} \
+	}
+
+#define SUM_LOOP(T) { \
+		const T* v = (const T*) d->data; \
+		double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0; \
+		for (i = from; i + 4 <= to; i += 4) { \
+			s0 += v[i]; s1 += v[i + 1]; s2 += v[i + 2]; s3 += v[i + 3]; \
+		} \
+		for (; i < to; ++i) { \
+			s0 += v[i]; \
+		} \
+		sum = (s0 + s1) + (s2 + s3); \
+	}
+
+/* Ties go to earliest sample, as in sequential scan */
+#define PICK_AREA(m, at) \
+		if ((m) > maxArea || ((m) == maxArea && (at) < best)) { \
+			maxArea = (m); \
+			best = (at); \
+		}
+
+/* Maximum of triangle area, four independent maximums keep pipeline busy */
+#define AREA_LOOP(T) { \
+		const T* v = (const T*) d->data; \
+		double m0 = -1.0, m1 = -1.0, m2 = -1.0, m3 = -1.0, x = (double) from; \
+		size_t b0 = from, b1 = from, b2 = from, b3 = from; \
+		for (i = from; i + 4 <= to; i += 4, x += 4.0) { \
+			double a0 = k1 * v[i] + k2 * x + k0; \
+			double a1 = k1 * v[i + 1] + k2 * (x + 1.0) + k0; \
+			double a2 = k1 * v[i + 2] + k2 * (x + 2.0) + k0; \
+			double a3 = k1 * v[i + 3] + k2 * (x + 3.0) + k0; \
+			a0 = a0 < 0 ? -a0 : a0; \
+			a1 = a1 < 0 ? -a1 : a1; \
+			a2 = a2 < 0 ? -a2 : a2; \
+			a3 = a3 < 0 ? -a3 : a3; \
+			if (a0 > m0) { m0 = a0; b0 = i; } \
+			if (a1 > m1) { m1 = a1; b1 = i + 1; } \
+			if (a2 > m2) { m2 = a2; b2 = i + 2; } \
+			if (a3 > m3) { m3 = a3; b3 = i + 3; } \
+		} \
+		for (; i < to; ++i, x += 1.0) { \
+			double a0 = k1 * v[i] + k2 * x + k0; \
+			a0 = a0 < 0 ? -a0 : a0; \
+			if (a0 > m0) { m0 = a0; b0 = i; } \
+		} \
+		PICK_AREA(m0, b0) \
+		PICK_AREA(m1, b1) \
+		PICK_AREA(m2, b2) \
+		PICK_AREA(m3, b3) \
+	}
+
+static void minMaxBucket(const Decimation* d, size_t b) {
+	size_t from = bucketStart(d, b), to = bucketStart(d, b + 1), i;
+	size_t iMin = from, iMax = from;
+
+	if (SAMPLE_FLOAT64 == d->type) {
+		MINMAX_LOOP(double)
+	} else {
+		MINMAX_LOOP(float)
+	}
+
+	if (iMin > iMax) {
+		size_t t = iMin;
+		iMin = iMax;
+		iMax = t;
+	}
+	put(d, 2 * b, (double) iMin, SAMPLE(d, iMin));
+	put(d, 2 * b + 1, (double) iMax, SAMPLE(d, iMax));
+}
+
+static double meanOf(const Decimation* d, size_t from, size_t to) {
+	double sum;
+	size_t i;
+
+	if (SAMPLE_FLOAT64 == d->type) {
+		SUM_LOOP(double)
+	} else {
+		SUM_LOOP(float)
+	}
+
+	return sum / (double) (to - from);
+}
+
+static void meanBucket(const Decimation* d, size_t b) {
+	size_t from = bucketStart(d, b), to = bucketStart(d, b + 1);
+
+	put(d, b, (double) (from + to - 1) / 2.0, meanOf(d, from, to));
+}
+
+/* Job processes a range of buckets */
+static void minMaxJob(ClientData clientData, int index) {
+	Decimation* d = (Decimation*) clientData;
+	size_t b, last = d->buckets * (index + 1) / d->jobs;
+
+	for (b = d->buckets * index / d->jobs; b < last; ++b) {
+		minMaxBucket(d, b);
+	}
+}
+
+static void meanJob(ClientData clientData, int index) {
+	Decimation* d = (Decimation*) clientData;
+	size_t b, last = d->buckets * (index + 1) / d->jobs;
+
+	for (b = d->buckets * index / d->jobs; b < last; ++b) {
+		meanBucket(d, b);
+	}
+}
+
+/* First and last samples are kept, every bucket in between gives one point */
+static void lttb(const Decimation* d) {
+	size_t points = d->buckets + 2, a = 0, b;
+	double every = (double) (d->count - 2) / (double) d->buckets;
+
+	put(d, 0, 0.0, SAMPLE(d, 0));
+
+	for (b = 0; b < d->buckets; ++b) {
+		size_t from = (size_t) (b * every) + 1, to = (size_t) ((b + 1) * every) + 1;
+		size_t nextFrom = to, nextTo = (size_t) ((b + 2) * every) + 1;
+		size_t i, best = from;
+		double ax = (double) a, ay = SAMPLE(d, a), avgX, avgY, k0, k1, k2, maxArea = -1.0;
+
+		if (nextTo > d->count) {
+			nextTo = d->count;
+		}
+		if (nextFrom >= nextTo) {
+			nextFrom = d->count - 1;
+			nextTo = d->count;
+		}
+		avgX = (double) (nextFrom + nextTo - 1) / 2.0;
+		avgY = meanOf(d, nextFrom, nextTo);
+
+		/* Doubled area of triangle is linear in sample index and value */
+		k1 = ax - avgX;
+		k2 = avgY - ay;
+		k0 = -k1 * ay - k2 * ax;
+		if (SAMPLE_FLOAT64 == d->type) {
+			AREA_LOOP(double)
+		} else {
+			AREA_LOOP(float)
+		}
+
+		put(d, b + 1, (double) best, SAMPLE(d, best));
+		a = best;
+	}
+
+	put(d, points - 1, (double) (d->count - 1), SAMPLE(d, d->count - 1));
+}
+
+int tclvisa_decimate(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]) {
+	static const char* options[] = {"-mode", "-points", "-threads", "-type", "-xy", NULL};
+	enum { OPT_MODE, OPT_POINTS, OPT_THREADS, OPT_TYPE, OPT_XY };
+	static const char* modes[] = {"minmax", "mean", "lttb", NULL};
+	static const char* types[] = {"float32", "float64", NULL};
+
+	Decimation d;
+	Tcl_Obj* res;
+	Tcl_Size length;
+	Tcl_WideInt points = 1000;
+	size_t outCount;
+	int mode = MODE_MINMAX, threadCount = 1, size, i, index;
+
+	UNREFERENCED_PARAMETER(clientData);	/* avoid "unused parameter" warning */
+
+	/* Check number of arguments */
+	if (objc < 2) {
+		Tcl_WrongNumArgs(interp, 1, objv, "data ?-points n? ?-mode minmax|mean|lttb? ?-type float32|float64? ?-threads n? ?-xy?");
+		return TCL_ERROR;
+	}
+
+	memset((void*) &d, 0, sizeof(d));
+	d.type = SAMPLE_FLOAT64;
+
+	/* Parse options */
+	for (i = 2; i < objc; ++i) {
+		if (TCL_OK != Tcl_GetIndexFromObj(interp, objv[i], options, "option", 0, &index)) {
+			return TCL_ERROR;
+		}
+
+		if (OPT_XY == index) {
+			d.xy = 1;
+			continue;
+		}
+
+		if (++i == objc) {
+			Tcl_AppendResult(interp, "value for \"", TclGetString(objv[i - 1]), "\" missing", NULL);
+			return TCL_ERROR;
+		}
+
+		switch (index) {
+		case OPT_MODE:
+			if (TCL_OK != Tcl_GetIndexFromObj(interp, objv[i], modes, "mode", 0, &mode)) {
+				return TCL_ERROR;
+			}
+			break;
+
+		case OPT_POINTS:
+			if (TCL_OK != Tcl_GetWideIntFromObj(interp, objv[i], &points)) {
+				return TCL_ERROR;
+			}
+			break;
+
+		case OPT_THREADS:
+			if (TCL_OK != Tcl_GetIntFromObj(interp, objv[i], &threadCount)) {
+				return TCL_ERROR;
+			}
+			if (threadCount < 1) {
+				Tcl_AppendResult(interp, "number of threads must be positive", NULL);
+				return TCL_ERROR;
+			}
+			break;
+
+		case OPT_TYPE:
+			if (TCL_OK != Tcl_GetIndexFromObj(interp, objv[i], types, "type", 0, &index)) {
+				return TCL_ERROR;
+			}
+			d.type = 0 == index ? SAMPLE_FLOAT32 : SAMPLE_FLOAT64;
+			break;
+		}
+	}
+
+	if (points < (MODE_LTTB == mode ? 3 : MODE_MINMAX == mode ? 2 : 1)) {
+		Tcl_AppendResult(interp, "too few points for mode \"", modes[mode], "\"", NULL);
+		return TCL_ERROR;
+	}
+
+	d.data = Tcl_GetBytesFromObj(interp, objv[1], &length);
+	if (NULL == d.data) {
+		return TCL_ERROR;
+	}
+	size = getVisaSampleSize(d.type);
+	d.count = (size_t) length / size;
+
+	if ((Tcl_WideInt) d.count <= points) {
+		/* Nothing to reduce, every sample is a point */
+		d.buckets = d.count;
+		mode = MODE_MEAN;
+	} else if (MODE_MINMAX == mode) {
+		d.buckets = (size_t) points / 2;
+	} else if (MODE_LTTB == mode) {
+		d.buckets = (size_t) points - 2;
+	} else {
+		d.buckets = (size_t) points;
+	}
+
+	outCount = MODE_MINMAX == mode ? 2 * d.buckets : MODE_LTTB == mode ? d.buckets + 2 : d.buckets;
+	res = Tcl_NewByteArrayObj(NULL, 0);
+	d.out = Tcl_SetByteArrayLength(res, (Tcl_Size) (outCount * size * (d.xy ? 2 : 1)));
+
+	if (MODE_LTTB == mode) {
+		lttb(&d);
+	} else if (d.buckets > 0) {
+		/* Several ranges per thread even out uneven progress */
+		d.jobs = threadCount > 1 ? threadCount * 4 : 1;
+		if ((size_t) d.jobs > d.buckets) {
+			d.jobs = (int) d.buckets;
+		}
+		if (1 == threadCount) {
+			(MODE_MINMAX == mode ? minMaxJob : meanJob)((ClientData) &d, 0);
+		} else {
+			runVisaPool(MODE_MINMAX == mode ? minMaxJob : meanJob, (ClientData) &d, d.jobs, threadCount);
+		}
+	}
+
+	Tcl_SetObjResult(interp, res);
+	return TCL_OK;
+}
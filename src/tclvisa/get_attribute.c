@@ -15,6 +15,7 @@
 #include <tcl.h>
 #include "tclvisa_utils.h"
 #include "visa_channel.h"
+#include "visa_reconnect.h"
 #include "visa_utils.h"
 
 int tclvisa_get_attribute(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]) {
@@ -32,7 +33,7 @@ int tclvisa_get_attribute(const ClientData clientData, Tcl_Interp* const interp,
 	}
 
 	/* Convert first argument to valid Tcl channel reference */
-    session = getVisaChannelFromObj(interp, objv[1]);
+    session = getConnectedVisaChannelFromObj(interp, objv[1]);
 	if (session == NULL) {
 		return TCL_ERROR;
 	}
@@ -59,5 +59,11 @@ int tclvisa_get_last_error(const ClientData clientData, Tcl_Interp* const interp
 	}
 	Tcl_SetObjResult(interp, res);
 
+	if (session->instrumentError) {
+		/* Instrument errors are reported once */
+		session->instrumentError = 0;
+		storeLastError(session, VI_SUCCESS, NULL);
+	}
+
 	return TCL_OK;
 }
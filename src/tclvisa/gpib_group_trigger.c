@@ -0,0 +1,127 @@
+/*
+ * gpib_group_trigger.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+#include <tcl.h>
+#include "visa_channel.h"
+#include "visa_reconnect.h"
+#include "visa_utils.h"
+#include "tcl_utils.h"
+#include "tclvisa_utils.h"
+
+/* IEEE 488.1 bus commands */
+#define GPIB_GET 0x08	/* Group Execute Trigger */
+#define GPIB_LAG 0x20	/* Listen Address Group, ORed with primary address */
+#define GPIB_UNL 0x3F	/* Unlisten */
+#define GPIB_SCG 0x60	/* Secondary Command Group, ORed with secondary address */
+
+#define GPIB_MAX_ADDR 30
+
+static int getGpibAddrFromObj(Tcl_Interp* const interp, Tcl_Obj* const obj, const char* what, unsigned char* addr) {
+	int value;
+
+	if (TCL_OK != Tcl_GetIntFromObj(interp, obj, &value)) {
+		return TCL_ERROR;
+	}
+
+	if (value < 0 || value > GPIB_MAX_ADDR) {
+		Tcl_AppendResult(interp, "invalid ", what, " address \"", Tcl_GetString(obj), "\": must be 0..30", NULL);
+		return TCL_ERROR;
+	}
+
+	*addr = (unsigned char) value;
+	return TCL_OK;
+}
+
+int tclvisa_gpib_group_trigger(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]) {
+	VisaChannelData* session;
+	ViStatus status;
+	ViUInt32 count = 0, retCount;
+	Tcl_Obj** addrs;
+	int addrc, i;
+	unsigned char* buf;
+
+	UNREFERENCED_PARAMETER(clientData);	/* avoid "unused parameter" warning */
+
+	/* Check number of arguments */
+	if (objc != 3) {
+		Tcl_WrongNumArgs(interp, 1, objv, "session addrList");
+		return TCL_ERROR;
+	}
+
+	/* Convert first argument to valid Tcl channel reference */
+	session = getConnectedVisaChannelFromObj(interp, objv[1]);
+	if (session == NULL) {
+		return TCL_ERROR;
+	}
+
+	if (TCL_OK != Tcl_ListObjGetElements(interp, objv[2], &addrc, &addrs)) {
+		return TCL_ERROR;
+	}
+
+	if (addrc == 0) {
+		Tcl_AppendResult(interp, "address list is empty", NULL);
+		return TCL_ERROR;
+	}
+
+	/* UNL, then LAG and optional secondary address per device, then GET */
+	buf = (unsigned char*) ckalloc(2 * addrc + 2);
+	buf[count++] = GPIB_UNL;
+
+	for (i = 0; i < addrc; ++i) {
+		Tcl_Obj** parts;
+		int partc;
+		unsigned char addr;
+
+		/* Element is either primary address or {primary secondary} pair */
+		if (TCL_OK != Tcl_ListObjGetElements(interp, addrs[i], &partc, &parts)) {
+			goto error;
+		}
+
+		if (partc < 1 || partc > 2) {
+			Tcl_AppendResult(interp, "invalid address \"", Tcl_GetString(addrs[i]), "\": must be primary address or {primary secondary} pair", NULL);
+			goto error;
+		}
+
+		if (TCL_OK != getGpibAddrFromObj(interp, parts[0], "primary", &addr)) {
+			goto error;
+		}
+		buf[count++] = GPIB_LAG | addr;
+
+		if (partc > 1) {
+			if (TCL_OK != getGpibAddrFromObj(interp, parts[1], "secondary", &addr)) {
+				goto error;
+			}
+			buf[count++] = GPIB_SCG | addr;
+		}
+	}
+
+	buf[count++] = GPIB_GET;
+
+	/* All listeners receive GET in the same bus transaction */
+	status = viGpibCommand(session->session, (ViBuf) buf, count, &retCount);
+	ckfree((char*) buf);
+	storeLastError(session, status, interp);
+
+	/* Check status returned */
+	if (status >= 0) {
+		/* Return number of bytes transmitted */
+		Tcl_SetObjResult(interp, Tcl_NewLongObj((long) retCount));
+		return TCL_OK;
+	} else {
+		return TCL_ERROR;
+	}
+
+error:
+	ckfree((char*) buf);
+	return TCL_ERROR;
+}
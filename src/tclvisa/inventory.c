@@ -0,0 +1,300 @@
+/*
+ * inventory.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+/*
+ * Discovery, parsing and identification of resources in one command.
+ * Expressions starting with "?*" are searched separately per interface
+ * type, so that slow interfaces (LAN, GPIB) are searched concurrently.
+ * The whole expression is searched at the same time too, so that
+ * resources of interfaces not listed (RIO, FIREWIRE, remote) are not lost.
+ * Then every resource found is parsed and optionally identified by a
+ * worker pool.
+ */
+
+#include <tcl.h>
+#include <stdlib.h>
+#include <string.h>
+#include "visa_channel.h"
+#include "visa_pool.h"
+#include "visa_utils.h"
+#include "tcl_utils.h"
+#include "tclvisa_utils.h"
+
+#define IDN_QUERY "*IDN?\n"
+#define IDN_BUFLEN 256
+
+static const char* interfacePrefixes[] = {"ASRL", "GPIB", "PXI", "TCPIP", "USB", "VXI", NULL};
+
+typedef struct _FindJob {
+	char* expr;
+	ViStatus status;
+	char** names;
+	int count, size;
+} FindJob;
+
+typedef struct _InventoryRecord {
+	const char* rsrcName;
+	ViStatus status;	/* parse status */
+	ViUInt16 intfType, intfNum;
+	ViChar rsrcClass[VI_FIND_BUFLEN];
+	ViChar expandedName[VI_FIND_BUFLEN];
+	ViChar alias[VI_FIND_BUFLEN];
+	ViStatus idnStatus;
+	char idn[IDN_BUFLEN];
+} InventoryRecord;
+
+typedef struct _InventoryParams {
+	ViSession rm;
+	FindJob* finds;
+	InventoryRecord* records;
+	int identify;
+	ViUInt32 timeout;
+} InventoryParams;
+
+static void findJob(ClientData clientData, int index) {
+	InventoryParams* params = (InventoryParams*) clientData;
+	FindJob* job = &params->finds[index];
+	ViChar rsrcName[VI_FIND_BUFLEN];
+	ViUInt32 retCount;
+	ViFindList flist;
+
+	job->status = viFindRsrc(params->rm, job->expr, &flist, &retCount, rsrcName);
+	if (job->status < 0) {
+		return;
+	}
+
+	while (job->status >= 0 && retCount--) {
+		if (job->count == job->size) {
+			job->size = job->size ? job->size * 2 : 16;
+			job->names = (char**) ckrealloc((char*) job->names, sizeof(char*) * job->size);
+		}
+		job->names[job->count] = ckalloc(strlen(rsrcName) + 1);
+		strcpy(job->names[job->count], rsrcName);
+		++job->count;
+
+		if (retCount) {
+			job->status = viFindNext(flist, rsrcName);
+		}
+	}
+
+	viClose(flist);
+}
+
+static ViStatus identify(InventoryParams* params, InventoryRecord* rec) {
+	ViSession vi;
+	ViUInt32 retCount;
+	ViStatus status;
+
+	status = viOpen(params->rm, (ViRsrc) rec->rsrcName, VI_NULL, params->timeout, &vi);
+	if (status < 0) {
+		return status;
+	}
+
+	if (params->timeout) {
+		viSetAttribute(vi, VI_ATTR_TMO_VALUE, (ViAttrState) params->timeout);
+	}
+
+	status = viWrite(vi, (ViBuf) IDN_QUERY, (ViUInt32) strlen(IDN_QUERY), &retCount);
+	if (status >= 0) {
+		status = viRead(vi, (ViPBuf) rec->idn, IDN_BUFLEN - 1, &retCount);
+		if (status >= 0) {
+			while (retCount > 0 && (rec->idn[retCount - 1] == '\n' || rec->idn[retCount - 1] == '\r')) {
+				--retCount;
+			}
+			rec->idn[retCount] = 0;
+		}
+	}
+
+	viClose(vi);
+	return status;
+}
+
+static void recordJob(ClientData clientData, int index) {
+	InventoryParams* params = (InventoryParams*) clientData;
+	InventoryRecord* rec = &params->records[index];
+
+	rec->status = viParseRsrcEx(params->rm, (ViRsrc) rec->rsrcName, &rec->intfType, &rec->intfNum, rec->rsrcClass, rec->expandedName, rec->alias);
+	if (VI_ERROR_LIBRARY_NFOUND == rec->status) {
+		/* VISA older than 4.0, only basic information is available */
+		rec->status = viParseRsrc(params->rm, (ViRsrc) rec->rsrcName, &rec->intfType, &rec->intfNum);
+	}
+
+	if (params->identify) {
+		rec->idnStatus = identify(params, rec);
+	}
+}
+
+static void appendField(Tcl_Obj* dict, const char* key, Tcl_Obj* value) {
+	Tcl_DictObjPut(NULL, dict, Tcl_NewStringObj(key, -1), value);
+}
+
+static Tcl_Obj* newRecordObj(InventoryParams* params, InventoryRecord* rec) {
+	Tcl_Obj* res = Tcl_NewDictObj();
+
+	if (rec->status >= 0) {
+		appendField(res, "intftype", Tcl_NewIntObj(rec->intfType));
+		appendField(res, "intfnum", Tcl_NewIntObj(rec->intfNum));
+		appendField(res, "class", Tcl_NewStringObj(rec->rsrcClass, -1));
+		appendField(res, "name", Tcl_NewStringObj(rec->expandedName[0] ? rec->expandedName : rec->rsrcName, -1));
+		appendField(res, "alias", Tcl_NewStringObj(rec->alias, -1));
+	} else {
+		appendField(res, "error", Tcl_NewStringObj(visaErrorMessage(rec->status), -1));
+	}
+
+	if (params->identify) {
+		appendField(res, "idn", Tcl_NewStringObj(rec->idnStatus >= 0 ? rec->idn : "", -1));
+		if (rec->idnStatus < 0 && rec->status >= 0) {
+			appendField(res, "error", Tcl_NewStringObj(visaErrorMessage(rec->idnStatus), -1));
+		}
+	}
+
+	return res;
+}
+
+int tclvisa_inventory(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]) {
+	static const char* options[] = {"-identify", "-threads", "-timeout", NULL};
+	enum { OPT_IDENTIFY, OPT_THREADS, OPT_TIMEOUT };
+
+	VisaChannelData* rmSession;
+	InventoryParams params;
+	Tcl_HashTable found;
+	Tcl_Obj* res;
+	const char* expr;
+	int findCount, recordCount = 0, threadCount = VISA_POOL_DEFAULT_THREADS;
+	int i, j, index, isNew, code = TCL_ERROR;
+
+	UNREFERENCED_PARAMETER(clientData);	/* avoid "unused parameter" warning */
+
+	/* Check number of arguments */
+	if (objc < 3) {
+		Tcl_WrongNumArgs(interp, 1, objv, "RMsession expr ?-identify? ?-threads n? ?-timeout ms?");
+		return TCL_ERROR;
+	}
+
+	/* Convert first argument to valid Tcl channel reference */
+	rmSession = getVisaChannelFromObj(interp, objv[1]);
+	if (rmSession == NULL) {
+		return TCL_ERROR;
+	}
+
+	memset((void*) &params, 0, sizeof(params));
+	params.rm = rmSession->session;
+
+	/* Parse options */
+	for (i = 3; i < objc; ++i) {
+		int value;
+
+		if (TCL_OK != Tcl_GetIndexFromObj(interp, objv[i], options, "option", 0, &index)) {
+			return TCL_ERROR;
+		}
+
+		if (OPT_IDENTIFY == index) {
+			params.identify = 1;
+			continue;
+		}
+
+		if (i + 1 == objc) {
+			Tcl_AppendResult(interp, "value for \"", Tcl_GetString(objv[i]), "\" missing", NULL);
+			return TCL_ERROR;
+		}
+		if (TCL_OK != Tcl_GetIntFromObj(interp, objv[++i], &value)) {
+			return TCL_ERROR;
+		}
+
+		if (OPT_THREADS == index) {
+			if (value < 1) {
+				Tcl_AppendResult(interp, "number of threads must be positive", NULL);
+				return TCL_ERROR;
+			}
+			threadCount = value;
+		} else {
+			params.timeout = (ViUInt32) value;
+		}
+	}
+
+	/* Split generic expression per interface type, the last search is the whole expression */
+	expr = Tcl_GetString(objv[2]);
+	findCount = strncmp(expr, "?*", 2) == 0 ? (int) (sizeof(interfacePrefixes) / sizeof(interfacePrefixes[0])) : 1;
+	params.finds = (FindJob*) ckalloc(sizeof(FindJob) * findCount);
+	memset((void*) params.finds, 0, sizeof(FindJob) * findCount);
+
+	for (i = 0; i < findCount; ++i) {
+		const char* prefix = i < findCount - 1 ? interfacePrefixes[i] : "";
+
+		params.finds[i].expr = ckalloc(strlen(prefix) + strlen(expr) + 1);
+		strcpy(params.finds[i].expr, prefix);
+		strcat(params.finds[i].expr, expr);
+	}
+
+	runVisaPool(findJob, (ClientData) &params, findCount, findCount);
+
+	/* Merge results, the same resource may match several expressions */
+	Tcl_InitHashTable(&found, TCL_STRING_KEYS);
+	for (i = 0; i < findCount; ++i) {
+		FindJob* job = &params.finds[i];
+
+		if (job->status < 0 && job->status != VI_ERROR_RSRC_NFOUND) {
+			storeLastError(rmSession, job->status, interp);
+			goto cleanup;
+		}
+
+		for (j = 0; j < job->count; ++j) {
+			Tcl_CreateHashEntry(&found, job->names[j], &isNew);
+			recordCount += isNew;
+		}
+	}
+
+	params.records = (InventoryRecord*) ckalloc(sizeof(InventoryRecord) * (recordCount + 1));
+	memset((void*) params.records, 0, sizeof(InventoryRecord) * recordCount);
+
+	Tcl_DeleteHashTable(&found);
+	Tcl_InitHashTable(&found, TCL_STRING_KEYS);
+	recordCount = 0;
+	for (i = 0; i < findCount; ++i) {
+		for (j = 0; j < params.finds[i].count; ++j) {
+			Tcl_CreateHashEntry(&found, params.finds[i].names[j], &isNew);
+			if (isNew) {
+				params.records[recordCount++].rsrcName = params.finds[i].names[j];
+			}
+		}
+	}
+
+	runVisaPool(recordJob, (ClientData) &params, recordCount, threadCount);
+
+	res = Tcl_NewDictObj();
+	for (i = 0; i < recordCount; ++i) {
+		Tcl_DictObjPut(interp, res, Tcl_NewStringObj(params.records[i].rsrcName, -1), newRecordObj(&params, &params.records[i]));
+	}
+
+	storeLastError(rmSession, VI_SUCCESS, NULL);
+	Tcl_SetObjResult(interp, res);
+	code = TCL_OK;
+
+cleanup:
+	Tcl_DeleteHashTable(&found);
+	for (i = 0; i < findCount; ++i) {
+		for (j = 0; j < params.finds[i].count; ++j) {
+			ckfree(params.finds[i].names[j]);
+		}
+		if (params.finds[i].names) {
+			ckfree((char*) params.finds[i].names);
+		}
+		ckfree(params.finds[i].expr);
+	}
+	ckfree((char*) params.finds);
+	if (params.records) {
+		ckfree((char*) params.records);
+	}
+
+	return code;
+}
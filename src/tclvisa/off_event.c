@@ -0,0 +1,45 @@
+/*
+ * off_event.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+#include <tcl.h>
+#include "visa_channel.h"
+#include "visa_events.h"
+#include "visa_utils.h"
+#include "tcl_utils.h"
+#include "tclvisa_utils.h"
+
+int tclvisa_off_event(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]) {
+	VisaChannelData* session;
+	ViEventType eventType;
+
+	UNREFERENCED_PARAMETER(clientData);	/* avoid "unused parameter" warning */
+
+	/* Check number of arguments */
+	if (objc != 3) {
+		Tcl_WrongNumArgs(interp, 1, objv, "session eventType");
+		return TCL_ERROR;
+	}
+
+	/* Convert first argument to valid Tcl channel reference */
+	session = getVisaChannelFromObj(interp, objv[1]);
+	if (session == NULL) {
+		return TCL_ERROR;
+	}
+
+	/* Parse event type */
+	if (TCL_OK != getVisaEventTypeFromObj(interp, objv[2], &eventType)) {
+		return TCL_ERROR;
+	}
+
+	return setVisaEventHandler(interp, session, eventType, NULL);
+}
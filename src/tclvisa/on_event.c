@@ -0,0 +1,59 @@
+/*
+ * on_event.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+#include <tcl.h>
+#include "visa_channel.h"
+#include "visa_reconnect.h"
+#include "visa_events.h"
+#include "visa_utils.h"
+#include "tcl_utils.h"
+#include "tclvisa_utils.h"
+
+int tclvisa_on_event(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]) {
+	VisaChannelData* session;
+	ViEventType eventType;
+	int len;
+
+	UNREFERENCED_PARAMETER(clientData);	/* avoid "unused parameter" warning */
+
+	/* Check number of arguments */
+	if (objc < 3 || objc > 4) {
+		Tcl_WrongNumArgs(interp, 1, objv, "session eventType ?script?");
+		return TCL_ERROR;
+	}
+
+	/* Convert first argument to valid Tcl channel reference */
+	session = getConnectedVisaChannelFromObj(interp, objv[1]);
+	if (session == NULL) {
+		return TCL_ERROR;
+	}
+
+	/* Parse event type */
+	if (TCL_OK != getVisaEventTypeFromObj(interp, objv[2], &eventType)) {
+		return TCL_ERROR;
+	}
+
+	if (objc == 3) {
+		/* Return script currently installed */
+		Tcl_Obj* script = getVisaEventHandler(session, eventType);
+		if (script) {
+			Tcl_SetObjResult(interp, script);
+		}
+		return TCL_OK;
+	}
+
+	/* Empty script removes handler */
+	Tcl_GetStringFromObj(objv[3], &len);
+
+	return setVisaEventHandler(interp, session, eventType, len ? objv[3] : NULL);
+}
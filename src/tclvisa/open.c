@@ -12,7 +12,9 @@
  */
 
 #include <tcl.h>
+#include <string.h>
 #include "visa_channel.h"
+#include "visa_reconnect.h"
 #include "visa_utils.h"
 #include "tcl_utils.h"
 #include "tclvisa_utils.h"
@@ -23,12 +25,33 @@ int tclvisa_open(const ClientData clientData, Tcl_Interp* const interp, const in
 	ViSession vi;
 	ViAccessMode accessMode = VI_NULL;
 	ViUInt32 timeOut = VI_NULL;
+	ViUInt32 backoff = 0;
+	int maxTries = 0;
+	int argc = objc;
 
 	UNREFERENCED_PARAMETER(clientData);	/* avoid "unused parameter" warning */
 
+	/* Option -reconnect {backoff maxTries} follows positional arguments */
+	if (argc > 4 && strcmp(TclGetString(objv[argc - 2]), "-reconnect") == 0) {
+		Tcl_Obj** elems;
+		int elemc;
+
+		if (TCL_OK != Tcl_ListObjGetElements(interp, objv[argc - 1], &elemc, &elems)) {
+			return TCL_ERROR;
+		}
+		if (elemc != 2) {
+			Tcl_AppendResult(interp, "reconnect parameters must be {backoff maxTries}", NULL);
+			return TCL_ERROR;
+		}
+		if (Tcl_GetUInt32FromObj(interp, elems[0], &backoff) || Tcl_GetIntFromObj(interp, elems[1], &maxTries)) {
+			return TCL_ERROR;
+		}
+		argc -= 2;
+	}
+
 	/* Check number of arguments */
-	if (objc < 3 || objc > 5) {
-		Tcl_WrongNumArgs(interp, 1, objv, "RMsession rsrcName ?accessMode? ?timeout?");
+	if (argc < 3 || argc > 5) {
+		Tcl_WrongNumArgs(interp, 1, objv, "RMsession rsrcName ?accessMode? ?timeout? ?-reconnect {backoff maxTries}?");
 		return TCL_ERROR;
 	}
 
@@ -38,7 +61,7 @@ int tclvisa_open(const ClientData clientData, Tcl_Interp* const interp, const in
 		return TCL_ERROR;
 	}
 
-	if (objc > 3) {
+	if (argc > 3) {
 		/* Access mode specified */
 		long l;
 		if (Tcl_GetLongFromObj(interp, objv[3], &l)) {
@@ -47,7 +70,7 @@ int tclvisa_open(const ClientData clientData, Tcl_Interp* const interp, const in
 		accessMode = (ViAccessMode) l;
 	}
 
-	if (objc > 4) {
+	if (argc > 4) {
 		/* Timeout specified */
 		long l;
 		if (Tcl_GetLongFromObj(interp, objv[4], &l)) {
@@ -70,6 +93,11 @@ int tclvisa_open(const ClientData clientData, Tcl_Interp* const interp, const in
 	if (NULL == channel) {
 		return TCL_ERROR;
 	}
+	channel->rm = rmSession->session;
+
+	if (maxTries > 0) {
+		enableVisaReconnect(channel, rmSession->session, TclGetString(objv[2]), accessMode, timeOut, backoff, maxTries);
+	}
 
 	/* Return channel string representation as a procedure result */
 	Tcl_AppendResult(interp, Tcl_GetChannelName(channel->channel), NULL);
@@ -14,6 +14,8 @@
 #include <tcl.h>
 #include <visa.h>
 #include "visa_utils.h"
+#include "visa_api.h"
+#include "visa_native.h"
 #include "visa_channel.h"
 #include "tclvisa_utils.h"
 
@@ -30,6 +32,12 @@ int tclvisa_open_default_rm(const ClientData clientData, Tcl_Interp* const inter
 		return TCL_ERROR;
 	}
 
+	/* Make sure VISA library is available, report why if it is not */
+	if (TCL_OK != loadVisaApi(interp, NULL, 0) && !isVisaNativeEnabled()) {
+		return TCL_ERROR;
+	}
+	Tcl_ResetResult(interp);
+
 	/* Attempt to open resource manager */
 	status = viOpenDefaultRM(&session);
 
@@ -0,0 +1,179 @@
+/*
+ * open_many.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+/*
+ * viOpen() on LAN and USB resources takes a long time, mostly waiting for
+ * the instrument. Worker threads open resources in parallel, channels are
+ * created afterwards in the calling thread, since Tcl channels belong to it.
+ */
+
+#include <tcl.h>
+#include <string.h>
+#include "visa_channel.h"
+#include "visa_pool.h"
+#include "visa_utils.h"
+#include "tcl_utils.h"
+#include "tclvisa_utils.h"
+
+typedef struct _OpenRequest {
+	const char* rsrcName;
+	ViSession vi;
+	ViStatus status;
+} OpenRequest;
+
+typedef struct _OpenParams {
+	OpenRequest* requests;
+	ViSession rm;
+	ViAccessMode accessMode;
+	ViUInt32 timeout;
+} OpenParams;
+
+static void openJob(ClientData clientData, int index) {
+	OpenParams* params = (OpenParams*) clientData;
+	OpenRequest* req = &params->requests[index];
+
+	req->status = viOpen(params->rm, (ViRsrc) req->rsrcName, params->accessMode, params->timeout, &req->vi);
+}
+
+static int checkUniqueNames(Tcl_Interp* const interp, Tcl_Obj* const rsrcObjs[], int count) {
+	Tcl_HashTable names;
+	int i, isNew, result = TCL_OK;
+
+	Tcl_InitHashTable(&names, TCL_STRING_KEYS);
+	for (i = 0; i < count; ++i) {
+		Tcl_CreateHashEntry(&names, TclGetString(rsrcObjs[i]), &isNew);
+		if (!isNew) {
+			Tcl_AppendResult(interp, "resource \"", TclGetString(rsrcObjs[i]), "\" is listed twice", NULL);
+			result = TCL_ERROR;
+			break;
+		}
+	}
+	Tcl_DeleteHashTable(&names);
+
+	return result;
+}
+
+int tclvisa_open_many(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]) {
+	static const char* options[] = {"-accessmode", "-threads", "-timeout", NULL};
+	enum { OPT_ACCESS_MODE, OPT_THREADS, OPT_TIMEOUT };
+
+	VisaChannelData* rmSession;
+	OpenParams params;
+	Tcl_Obj** rsrcObjs;
+	Tcl_Obj* res;
+	ViStatus firstError = VI_SUCCESS;
+	int threadCount = VISA_POOL_DEFAULT_THREADS, count;
+	int i, index;
+	long l;
+
+	UNREFERENCED_PARAMETER(clientData);	/* avoid "unused parameter" warning */
+
+	/* Check number of arguments */
+	if (objc < 3 || objc % 2 != 1) {
+		Tcl_WrongNumArgs(interp, 1, objv, "RMsession rsrcList ?-accessmode mode? ?-timeout ms? ?-threads n?");
+		return TCL_ERROR;
+	}
+
+	/* Convert first argument to valid Tcl channel reference */
+	rmSession = getVisaChannelFromObj(interp, objv[1]);
+	if (rmSession == NULL) {
+		return TCL_ERROR;
+	}
+
+	memset((void*) &params, 0, sizeof(params));
+	params.rm = rmSession->session;
+	params.accessMode = VI_NULL;
+	params.timeout = VI_NULL;
+
+	if (TCL_OK != Tcl_ListObjGetElements(interp, objv[2], &count, &rsrcObjs)) {
+		return TCL_ERROR;
+	}
+
+	/* Parse options */
+	for (i = 3; i < objc; i += 2) {
+		if (TCL_OK != Tcl_GetIndexFromObj(interp, objv[i], options, "option", 0, &index)
+			|| TCL_OK != Tcl_GetLongFromObj(interp, objv[i + 1], &l)) {
+			return TCL_ERROR;
+		}
+
+		switch (index) {
+		case OPT_ACCESS_MODE:
+			params.accessMode = (ViAccessMode) l;
+			break;
+
+		case OPT_THREADS:
+			if (l < 1) {
+				Tcl_AppendResult(interp, "number of threads must be positive", NULL);
+				return TCL_ERROR;
+			}
+			threadCount = (int) l;
+			break;
+
+		case OPT_TIMEOUT:
+			params.timeout = (ViUInt32) l;
+			break;
+		}
+	}
+
+	/* Names are keys of the result, so every resource may be opened once */
+	if (TCL_OK != checkUniqueNames(interp, rsrcObjs, count)) {
+		return TCL_ERROR;
+	}
+
+	params.requests = (OpenRequest*) ckalloc(sizeof(OpenRequest) * (count + 1));
+	memset((void*) params.requests, 0, sizeof(OpenRequest) * count);
+	for (i = 0; i < count; ++i) {
+		params.requests[i].rsrcName = TclGetString(rsrcObjs[i]);
+	}
+
+	runVisaPool(openJob, (ClientData) &params, count, threadCount);
+
+	/* Channels are created here, they belong to the calling thread */
+	res = Tcl_NewDictObj();
+	for (i = 0; i < count; ++i) {
+		OpenRequest* req = &params.requests[i];
+		Tcl_Obj* value;
+
+		if (req->status < 0) {
+			if (firstError >= 0) {
+				firstError = req->status;
+			}
+
+			value = Tcl_NewListObj(0, NULL);
+			Tcl_ListObjAppendElement(interp, value, Tcl_NewStringObj("error", -1));
+			Tcl_ListObjAppendElement(interp, value, Tcl_NewStringObj(visaErrorMessage(req->status), -1));
+		} else {
+			VisaChannelData* channel = createVisaChannel(interp, req->vi);
+
+			if (NULL == channel) {
+				value = Tcl_NewListObj(0, NULL);
+				Tcl_ListObjAppendElement(interp, value, Tcl_NewStringObj("error", -1));
+				Tcl_ListObjAppendElement(interp, value, Tcl_GetObjResult(interp));
+				Tcl_ResetResult(interp);
+			} else {
+				channel->rm = params.rm;
+				value = Tcl_NewStringObj(Tcl_GetChannelName(channel->channel), -1);
+			}
+		}
+
+		Tcl_DictObjPut(interp, res, rsrcObjs[i], value);
+	}
+
+	/* Resource Manager session holds the first error occured */
+	storeLastError(rmSession, firstError, NULL);
+
+	ckfree((char*) params.requests);
+
+	Tcl_SetObjResult(interp, res);
+	return TCL_OK;
+}
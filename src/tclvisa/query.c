@@ -0,0 +1,72 @@
+/*
+ * query.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+#include <tcl.h>
+#include <string.h>
+#include "visa_channel.h"
+#include "visa_reconnect.h"
+#include "visa_async.h"
+#include "visa_utils.h"
+#include "tcl_utils.h"
+#include "tclvisa_utils.h"
+
+static int query(Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[], int nre) {
+	VisaChannelData* session;
+	int async = 0, first = 1;
+	Tcl_WideInt count = -1;
+
+	if (objc > 1 && strcmp(TclGetString(objv[1]), "-async") == 0) {
+		async = 1;
+		first = 2;
+	}
+
+	/* Check number of arguments */
+	if (objc - first < 2 || objc - first > 3) {
+		Tcl_WrongNumArgs(interp, 1, objv, "?-async? session data ?count?");
+		return TCL_ERROR;
+	}
+
+	/* Convert first argument to valid Tcl channel reference */
+	session = getConnectedVisaChannelFromObj(interp, objv[first]);
+	if (session == NULL) {
+		return TCL_ERROR;
+	}
+
+	if (objc - first == 3) {
+		if (getVisaIOCount(interp, objv[first + 2], &count)) {
+			return TCL_ERROR;
+		}
+	}
+
+#ifdef TCLVISA_NRE
+	if (async && nre) {
+		/* Yields when called inside coroutine */
+		return runVisaAsyncIO(interp, session, objv[first + 1], count);
+	}
+#else
+	UNREFERENCED_PARAMETER(nre);
+	UNREFERENCED_PARAMETER(async);
+#endif
+
+	return runVisaIO(interp, session, objv[first + 1], count);
+}
+
+int tclvisa_query(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]) {
+	UNREFERENCED_PARAMETER(clientData);	/* avoid "unused parameter" warning */
+	return query(interp, objc, objv, 0);
+}
+
+int tclvisa_query_nr(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]) {
+	UNREFERENCED_PARAMETER(clientData);	/* avoid "unused parameter" warning */
+	return query(interp, objc, objv, 1);
+}
@@ -0,0 +1,64 @@
+/*
+ * read_async.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+#include <tcl.h>
+#include "visa_channel.h"
+#include "visa_reconnect.h"
+#include "visa_async.h"
+#include "visa_utils.h"
+#include "tcl_utils.h"
+#include "tclvisa_utils.h"
+
+static int readAsync(Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[], int nre) {
+	VisaChannelData* session;
+	Tcl_WideInt count = -1;
+
+	/* Check number of arguments */
+	if (objc < 2 || objc > 3) {
+		Tcl_WrongNumArgs(interp, 1, objv, "session ?count?");
+		return TCL_ERROR;
+	}
+
+	/* Convert first argument to valid Tcl channel reference */
+	session = getConnectedVisaChannelFromObj(interp, objv[1]);
+	if (session == NULL) {
+		return TCL_ERROR;
+	}
+
+	if (objc == 3) {
+		if (getVisaIOCount(interp, objv[2], &count)) {
+			return TCL_ERROR;
+		}
+	}
+
+#ifdef TCLVISA_NRE
+	if (nre) {
+		/* Yields when called inside coroutine */
+		return runVisaAsyncIO(interp, session, NULL, count);
+	}
+#else
+	UNREFERENCED_PARAMETER(nre);
+#endif
+
+	return runVisaIO(interp, session, NULL, count);
+}
+
+int tclvisa_read_async(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]) {
+	UNREFERENCED_PARAMETER(clientData);	/* avoid "unused parameter" warning */
+	return readAsync(interp, objc, objv, 0);
+}
+
+int tclvisa_read_async_nr(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]) {
+	UNREFERENCED_PARAMETER(clientData);	/* avoid "unused parameter" warning */
+	return readAsync(interp, objc, objv, 1);
+}
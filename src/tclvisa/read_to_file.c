@@ -14,39 +14,112 @@
 #include <tcl.h>
 #include <stdio.h>
 #include "visa_channel.h"
+#include "visa_reconnect.h"
 #include "visa_utils.h"
+#include "visa_transfer.h"
+#include "visa_capture.h"
 #include "tcl_utils.h"
 #include "tclvisa_utils.h"
 
+#ifdef TCLVISA_ZLIB
+static const int formats[] = { TCL_ZLIB_FORMAT_GZIP, TCL_ZLIB_FORMAT_RAW, TCL_ZLIB_FORMAT_ZLIB };
+#endif
+
 int read_to_file(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]) {
+	static const char* options[] = { "-chunk", "-compress", "-level", NULL };
+	enum { OPT_CHUNK, OPT_COMPRESS, OPT_LEVEL };
+	static const char* formatNames[] = { "gzip", "raw", "zlib", NULL };
+
 	VisaChannelData* session;
-	ViStatus status;
-	ViUInt32 retCount;
-	unsigned int count;
+	ViStatus status = VI_SUCCESS;
+	Tcl_WideUInt count, retCount = 0;
 	const char* fileName;
+	ViUInt32 chunk = VISA_CAPTURE_DEFAULT_CHUNK;
+	int format = -1, level = -1, tuned = 0, i, index;
 
 	UNREFERENCED_PARAMETER(clientData);	/* avoid "unused parameter" warning */
 
 	/* Check number of arguments */
-	if (objc != 4) {
-		Tcl_WrongNumArgs(interp, 1, objv, "session fileName count");
+	if (objc < 4 || objc % 2 != 0) {
+		Tcl_WrongNumArgs(interp, 1, objv, "session fileName count ?-compress gzip|zlib|raw? ?-level n? ?-chunk bytes?");
 		return TCL_ERROR;
 	}
 
 	/* Convert first argument to valid Tcl channel reference */
-    session = getVisaChannelFromObj(interp, objv[1]);
+    session = getConnectedVisaChannelFromObj(interp, objv[1]);
 	if (session == NULL) {
 		return TCL_ERROR;
 	}
 
 	fileName = Tcl_GetString(objv[2]);
 
-	if (Tcl_GetUIntFromObj(interp, objv[3], &count)) {
+	if (Tcl_GetUInt64FromObj(interp, objv[3], &count)) {
 		return TCL_ERROR;
 	}
 
-	/* Attempt to read */
-	status = viReadToFile(session->session, fileName, (ViUInt32) count, &retCount);
+	/* Parse options */
+	for (i = 4; i < objc; i += 2) {
+		if (TCL_OK != Tcl_GetIndexFromObj(interp, objv[i], options, "option", 0, &index)) {
+			return TCL_ERROR;
+		}
+
+		switch (index) {
+		case OPT_CHUNK:
+			if (TCL_OK != Tcl_GetUInt32FromObj(interp, objv[i + 1], &chunk)) {
+				return TCL_ERROR;
+			}
+			if (0 == chunk || chunk > (ViUInt32) TCL_SIZE_MAX) {
+				Tcl_AppendResult(interp, "invalid chunk size", NULL);
+				return TCL_ERROR;
+			}
+			tuned = 1;
+			break;
+
+		case OPT_COMPRESS:
+			if (TCL_OK != Tcl_GetIndexFromObj(interp, objv[i + 1], formatNames, "format", 0, &format)) {
+				return TCL_ERROR;
+			}
+			break;
+
+		case OPT_LEVEL:
+			if (TCL_OK != Tcl_GetIntFromObj(interp, objv[i + 1], &level)) {
+				return TCL_ERROR;
+			}
+			if (level < 0 || level > 9) {
+				Tcl_AppendResult(interp, "compression level must be 0 to 9", NULL);
+				return TCL_ERROR;
+			}
+			tuned = 1;
+			break;
+		}
+	}
+
+	if (TCL_OK != checkVisaChannelBusy(interp, session, 1)) {
+		return TCL_ERROR;
+	}
+
+	if (format < 0) {
+		if (tuned) {
+			Tcl_AppendResult(interp, "-chunk and -level options require -compress", NULL);
+			return TCL_ERROR;
+		}
+
+		/* Attempt to read, large counts are read in chunks */
+		status = readVisaToFile(session->session, fileName, count, &retCount);
+	} else if (!isVisaCaptureAvailable()) {
+		Tcl_AppendResult(interp, "compression requires Tcl 8.6 or newer", NULL);
+		return TCL_ERROR;
+	} else {
+#ifdef TCLVISA_ZLIB
+		/* Compressor runs in this thread while next chunk is being read */
+		if (TCL_OK != readVisaToCompressedFile(interp, session->session, fileName, count,
+			formats[format], level, chunk, &status, &retCount)) {
+
+			storeLastError(session, status, NULL);
+			return TCL_ERROR;
+		}
+#endif
+	}
 
 	/* Check status returned */
 	if (status < 0 && VI_ERROR_TMO != status) {
@@ -54,7 +127,7 @@ int read_to_file(const ClientData clientData, Tcl_Interp* const interp, const in
 		return TCL_ERROR;
 	} else {
 		storeLastError(session, status, NULL);
-		Tcl_SetObjResult(interp, Tcl_NewLongObj((long) retCount));
+		Tcl_SetObjResult(interp, Tcl_NewWideIntObj((Tcl_WideInt) retCount));
 		return TCL_OK;
 	}
 }
@@ -0,0 +1,323 @@
+/*
+ * read_waveform.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+/*
+ * Waveform is read by chunks. Every chunk is converted to scaled values and
+ * added to statistics as soon as it arrives, while the next one is still
+ * on its way, so conversion costs nearly nothing compared to transfer.
+ * Values are stored into a packed byte array, no Tcl object is created
+ * per sample.
+ */
+
+#include <tcl.h>
+#include <string.h>
+#include "visa_channel.h"
+#include "visa_reconnect.h"
+#include "visa_waveform.h"
+#include "visa_utils.h"
+#include "tcl_utils.h"
+#include "tclvisa_utils.h"
+
+/* Multiple of any sample size */
+#define WAVEFORM_CHUNK 65536
+
+typedef struct _WaveReader {
+	ViSession vi;
+	int type, size, bigEndian;
+	int outType, outSize;
+	double scale, offset;
+
+	unsigned char* raw;	/* bytes received but not converted yet */
+	size_t rawLen;
+	double* values;	/* converted chunk */
+
+	Tcl_Obj* data;	/* packed values */
+	unsigned char* packed;
+	Tcl_Size samples, capacity;
+	int tooLarge;
+
+	VisaWaveStats stats;
+} WaveReader;
+
+/* Makes room for count more samples in packed array */
+static int reserve(WaveReader* r, Tcl_WideInt count) {
+	Tcl_WideInt need = (Tcl_WideInt) r->samples + count;
+
+	if (need <= (Tcl_WideInt) r->capacity) {
+		return 1;
+	}
+	if (need > (Tcl_WideInt) (TCL_SIZE_MAX / r->outSize)) {
+		r->tooLarge = 1;
+		return 0;
+	}
+
+	if (need < 2 * (Tcl_WideInt) r->capacity && 2 * (Tcl_WideInt) r->capacity <= (Tcl_WideInt) (TCL_SIZE_MAX / r->outSize)) {
+		need = 2 * (Tcl_WideInt) r->capacity;
+	}
+	r->packed = Tcl_SetByteArrayLength(r->data, (Tcl_Size) need * r->outSize);
+	r->capacity = (Tcl_Size) need;
+	return 1;
+}
+
+/* Converts complete samples received, except last keep bytes */
+static int consume(WaveReader* r, size_t keep) {
+	size_t count = r->rawLen > keep ? (r->rawLen - keep) / r->size : 0;
+	size_t used = count * r->size;
+
+	if (0 == count) {
+		return 1;
+	}
+	if (!reserve(r, (Tcl_WideInt) count)) {
+		return 0;
+	}
+
+	convertVisaSamples(r->type, r->bigEndian, r->raw, count, r->scale, r->offset, r->values);
+	addVisaWaveStats(&r->stats, r->values, count);
+	storeVisaSamples(r->outType, r->values, count, r->packed + (size_t) r->samples * r->outSize);
+	r->samples += (Tcl_Size) count;
+
+	memmove(r->raw, r->raw + used, r->rawLen - used);
+	r->rawLen -= used;
+	return 1;
+}
+
+/* Reads length bytes of definite length block, or data until END if length is negative */
+static ViStatus readData(WaveReader* r, Tcl_WideInt length, size_t keep) {
+	ViStatus status;
+
+	do {
+		ViUInt32 want = (ViUInt32) (WAVEFORM_CHUNK - r->rawLen), retCount = 0;
+
+		if (length >= 0 && (Tcl_WideInt) want > length) {
+			want = (ViUInt32) length;
+		}
+
+		status = viRead(r->vi, r->raw + r->rawLen, want, &retCount);
+		r->rawLen += retCount;
+		if (length >= 0) {
+			length -= retCount;
+		}
+
+		if (status >= 0 && !consume(r, keep)) {
+			return VI_ERROR_ALLOC;
+		}
+	} while ((VI_SUCCESS_MAX_CNT == status || (length > 0 && VI_SUCCESS_TERM_CHAR == status)) && length != 0);
+
+	return status;
+}
+
+static ViStatus readWaveform(WaveReader* r) {
+	unsigned char header[16];
+	ViUInt32 retCount = 0;
+	ViStatus status;
+	Tcl_WideInt length = 0;
+	int digits, i;
+
+	status = viRead(r->vi, header, 2, &retCount);
+	if (status < 0) {
+		return status;
+	}
+
+	if (retCount < 2 || header[0] != '#' || header[1] < '0' || header[1] > '9') {
+		/* No block header, raw data until END */
+		memcpy(r->raw, header, retCount);
+		r->rawLen = retCount;
+		if (VI_SUCCESS_MAX_CNT == status) {
+			status = readData(r, -1, 0);
+		}
+		return status < 0 || consume(r, 0) ? status : VI_ERROR_ALLOC;
+	}
+
+	digits = header[1] - '0';
+	if (0 == digits) {
+		/* Indefinite length block, terminated by line feed with END */
+		status = readData(r, -1, 1);
+		if (status >= 0 && r->rawLen > 0 && '\n' == r->raw[r->rawLen - 1]) {
+			--r->rawLen;
+		}
+		return status < 0 || consume(r, 0) ? status : VI_ERROR_ALLOC;
+	}
+
+	status = viRead(r->vi, header, (ViUInt32) digits, &retCount);
+	if (status < 0) {
+		return status;
+	}
+	if (retCount != (ViUInt32) digits) {
+		return VI_ERROR_INP_PROT_VIOL;
+	}
+	for (i = 0; i < digits; ++i) {
+		if (header[i] < '0' || header[i] > '9') {
+			return VI_ERROR_INP_PROT_VIOL;
+		}
+		length = length * 10 + (header[i] - '0');
+	}
+
+	/* Whole waveform size is known, allocate it at once */
+	if (!reserve(r, length / r->size)) {
+		return VI_ERROR_ALLOC;
+	}
+
+	status = length ? readData(r, length, 0) : VI_SUCCESS_MAX_CNT;
+	if (VI_SUCCESS_MAX_CNT == status || VI_SUCCESS_TERM_CHAR == status) {
+		/*
+		 * Skip message terminator following block. Only one byte is read,
+		 * so that the next response is not swallowed, and block sent
+		 * without terminator is not an error.
+		 */
+		status = viRead(r->vi, header, 1, &retCount);
+		if (VI_ERROR_TMO == status) {
+			status = VI_SUCCESS;
+		}
+	}
+
+	return status;
+}
+
+int tclvisa_read_waveform(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]) {
+	static const char* options[] = {"-byteorder", "-output", "-scale", "-stats", "-type", NULL};
+	enum { OPT_BYTE_ORDER, OPT_OUTPUT, OPT_SCALE, OPT_STATS, OPT_TYPE };
+	static const char* byteOrders[] = {"big", "little", NULL};
+	static const char* outputs[] = {"float32", "float64", NULL};
+
+	VisaChannelData* session;
+	WaveReader r;
+	ViStatus status;
+	int withStats = 0, i, index;
+	double ymult = 1.0, yoff = 0.0, yzero = 0.0;
+
+	UNREFERENCED_PARAMETER(clientData);	/* avoid "unused parameter" warning */
+
+	/* Check number of arguments */
+	if (objc < 2) {
+		Tcl_WrongNumArgs(interp, 1, objv, "session ?-type type? ?-byteorder big|little? ?-scale {ymult yoff yzero}? ?-output float32|float64? ?-stats?");
+		return TCL_ERROR;
+	}
+
+	/* Convert first argument to valid Tcl channel reference */
+	session = getConnectedVisaChannelFromObj(interp, objv[1]);
+	if (session == NULL) {
+		return TCL_ERROR;
+	}
+
+	memset((void*) &r, 0, sizeof(r));
+	r.vi = session->session;
+	r.type = SAMPLE_INT16;
+	r.bigEndian = 1;
+	r.outType = SAMPLE_FLOAT64;
+
+	/* Parse options */
+	for (i = 2; i < objc; ++i) {
+		if (TCL_OK != Tcl_GetIndexFromObj(interp, objv[i], options, "option", 0, &index)) {
+			return TCL_ERROR;
+		}
+
+		if (OPT_STATS == index) {
+			withStats = 1;
+			continue;
+		}
+
+		if (++i == objc) {
+			Tcl_AppendResult(interp, "value for \"", TclGetString(objv[i - 1]), "\" missing", NULL);
+			return TCL_ERROR;
+		}
+
+		switch (index) {
+		case OPT_BYTE_ORDER:
+			if (TCL_OK != Tcl_GetIndexFromObj(interp, objv[i], byteOrders, "byte order", 0, &index)) {
+				return TCL_ERROR;
+			}
+			r.bigEndian = 0 == index;
+			break;
+
+		case OPT_OUTPUT:
+			if (TCL_OK != Tcl_GetIndexFromObj(interp, objv[i], outputs, "output type", 0, &index)) {
+				return TCL_ERROR;
+			}
+			r.outType = 0 == index ? SAMPLE_FLOAT32 : SAMPLE_FLOAT64;
+			break;
+
+		case OPT_SCALE: {
+			Tcl_Obj** elems;
+			int count;
+
+			if (TCL_OK != Tcl_ListObjGetElements(interp, objv[i], &count, &elems)) {
+				return TCL_ERROR;
+			}
+			if (3 != count) {
+				Tcl_AppendResult(interp, "scale must be a list of ymult, yoff and yzero", NULL);
+				return TCL_ERROR;
+			}
+			if (TCL_OK != Tcl_GetDoubleFromObj(interp, elems[0], &ymult)
+				|| TCL_OK != Tcl_GetDoubleFromObj(interp, elems[1], &yoff)
+				|| TCL_OK != Tcl_GetDoubleFromObj(interp, elems[2], &yzero)) {
+				return TCL_ERROR;
+			}
+			break;
+		}
+
+		case OPT_TYPE:
+			if (TCL_OK != Tcl_GetIndexFromObj(interp, objv[i], visaSampleTypes, "type", 0, &r.type)) {
+				return TCL_ERROR;
+			}
+			break;
+		}
+	}
+
+	if (TCL_OK != checkVisaChannelBusy(interp, session, 1)) {
+		return TCL_ERROR;
+	}
+
+	/* y = (raw - yoff) * ymult + yzero */
+	r.scale = ymult;
+	r.offset = yzero - yoff * ymult;
+	r.size = getVisaSampleSize(r.type);
+	r.outSize = getVisaSampleSize(r.outType);
+	r.raw = (unsigned char*) ckalloc(WAVEFORM_CHUNK);
+	r.values = (double*) ckalloc(sizeof(double) * WAVEFORM_CHUNK);
+	r.data = Tcl_NewByteArrayObj(NULL, 0);
+	Tcl_IncrRefCount(r.data);
+	initVisaWaveStats(&r.stats);
+
+	status = readWaveform(&r);
+
+	ckfree((char*) r.raw);
+	ckfree((char*) r.values);
+
+	if (r.tooLarge) {
+		Tcl_DecrRefCount(r.data);
+		storeLastError(session, VI_ERROR_ALLOC, NULL);
+		Tcl_AppendResult(interp, "waveform exceeds maximum size of Tcl value", NULL);
+		return TCL_ERROR;
+	}
+	if (status < 0) {
+		Tcl_DecrRefCount(r.data);
+		storeLastError(session, status, interp);
+		return TCL_ERROR;
+	}
+	storeLastError(session, status, NULL);
+
+	/* Drop unused capacity */
+	Tcl_SetByteArrayLength(r.data, r.samples * r.outSize);
+
+	if (withStats) {
+		Tcl_Obj* res = newVisaWaveStatsObj(&r.stats);
+
+		Tcl_DictObjPut(NULL, res, Tcl_NewStringObj("data", -1), r.data);
+		Tcl_SetObjResult(interp, res);
+	} else {
+		Tcl_SetObjResult(interp, r.data);
+	}
+
+	Tcl_DecrRefCount(r.data);
+	return TCL_OK;
+}
@@ -0,0 +1,581 @@
+/*
+ * sequence.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+/*
+ * Measurement sequences: a list of IO operations compiled once into an array
+ * of steps and then executed many times without returning to Tcl.
+ * Loops are compiled into a pair of LOOP/END steps pointing to each other.
+ */
+
+#include <tcl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "visa_channel.h"
+#include "visa_reconnect.h"
+#include "visa_stb.h"
+#include "visa_utils.h"
+#include "visa_transfer.h"
+#include "tcl_utils.h"
+#include "tclvisa_utils.h"
+
+#define SEQUENCE_NAME_PREFIX "visa_sequence"
+#define SEQUENCE_ASSOC_KEY "tclvisa_sequences"
+#define SEQUENCE_READ_CHUNK 4096
+
+enum StepType {
+	STEP_WRITE, STEP_READ, STEP_READ_BLOCK, STEP_ASSERT_TRIGGER, STEP_WAIT_STB, STEP_SLEEP, STEP_LOOP, STEP_END
+};
+
+static const char* stepNames[] = {
+	"write", "read", "read-block", "assert-trigger", "wait-stb", "sleep", "loop", NULL
+};
+
+typedef struct _SequenceStep {
+	enum StepType type;
+	int session;	/* index in sequence's session list */
+	Tcl_Obj* data;	/* data to write */
+	ViUInt32 arg;	/* protocol, mask, milliseconds or loop count */
+	ViUInt32 timeout;	/* wait-stb timeout */
+	int jump;	/* index of matching LOOP/END step */
+} SequenceStep;
+
+typedef struct _Sequence {
+	Tcl_Obj* sessions;	/* list of channel names */
+	SequenceStep* steps;
+	int stepCount;
+	int stepCapacity;
+} Sequence;
+
+/* Growing buffer for packed results */
+typedef struct _Buffer {
+	unsigned char* bytes;
+	size_t length;
+	size_t capacity;
+} Buffer;
+
+static void freeSequence(Sequence* seq) {
+	int i;
+
+	for (i = 0; i < seq->stepCount; ++i) {
+		if (seq->steps[i].data) {
+			Tcl_DecrRefCount(seq->steps[i].data);
+		}
+	}
+	Tcl_DecrRefCount(seq->sessions);
+	if (seq->steps) {
+		ckfree((char*) seq->steps);
+	}
+	ckfree((char*) seq);
+}
+
+/* Sequences of interpreter, interpreter belongs to one thread */
+typedef struct _SequenceTable {
+	Tcl_HashTable sequences;
+	int counter;	/* used to name sequences */
+} SequenceTable;
+
+static void deleteSequences(ClientData clientData, Tcl_Interp* interp) {
+	SequenceTable* table = (SequenceTable*) clientData;
+	Tcl_HashSearch search;
+	Tcl_HashEntry* entry;
+
+	UNREFERENCED_PARAMETER(interp);
+
+	for (entry = Tcl_FirstHashEntry(&table->sequences, &search); entry; entry = Tcl_NextHashEntry(&search)) {
+		freeSequence((Sequence*) Tcl_GetHashValue(entry));
+	}
+	Tcl_DeleteHashTable(&table->sequences);
+	ckfree((char*) table);
+}
+
+static SequenceTable* getSequenceTable(Tcl_Interp* const interp) {
+	SequenceTable* table = (SequenceTable*) Tcl_GetAssocData(interp, SEQUENCE_ASSOC_KEY, NULL);
+
+	if (NULL == table) {
+		table = (SequenceTable*) ckalloc(sizeof(SequenceTable));
+		Tcl_InitHashTable(&table->sequences, TCL_STRING_KEYS);
+		table->counter = 0;
+		Tcl_SetAssocData(interp, SEQUENCE_ASSOC_KEY, deleteSequences, (ClientData) table);
+	}
+
+	return table;
+}
+
+static Tcl_HashEntry* findSequence(Tcl_Interp* const interp, Tcl_Obj* nameObj) {
+	Tcl_HashEntry* entry = Tcl_FindHashEntry(&getSequenceTable(interp)->sequences, TclGetString(nameObj));
+
+	if (NULL == entry) {
+		Tcl_AppendResult(interp, "sequence \"", TclGetString(nameObj), "\" does not exist", NULL);
+	}
+
+	return entry;
+}
+
+/*
+ * Compilation
+ */
+
+static SequenceStep* addStep(Sequence* seq, enum StepType type) {
+	SequenceStep* step;
+
+	if (seq->stepCount == seq->stepCapacity) {
+		seq->stepCapacity = seq->stepCapacity ? seq->stepCapacity * 2 : 16;
+		seq->steps = (SequenceStep*) ckrealloc((char*) seq->steps, sizeof(SequenceStep) * seq->stepCapacity);
+	}
+
+	step = &seq->steps[seq->stepCount++];
+	memset((void*) step, 0, sizeof(*step));
+	step->type = type;
+	step->session = -1;
+	step->jump = -1;
+
+	return step;
+}
+
+/* Returns index of session in sequence's list, adding it when necessary */
+static int addSession(Tcl_Interp* const interp, Sequence* seq, Tcl_Obj* nameObj) {
+	Tcl_Obj** names;
+	int count, i;
+
+	/* Channel must exist at compile time, though it is resolved again at run time */
+	if (NULL == getVisaChannelFromObj(interp, nameObj)) {
+		return -1;
+	}
+
+	Tcl_ListObjGetElements(NULL, seq->sessions, &count, &names);
+	for (i = 0; i < count; ++i) {
+		if (0 == strcmp(TclGetString(names[i]), TclGetString(nameObj))) {
+			return i;
+		}
+	}
+
+	Tcl_ListObjAppendElement(NULL, seq->sessions, nameObj);
+	return count;
+}
+
+static int compileOps(Tcl_Interp* const interp, Sequence* seq, Tcl_Obj* opsObj) {
+	static const char* usage[] = {
+		"write session data",
+		"read session",
+		"read-block session",
+		"assert-trigger session ?protocol?",
+		"wait-stb session mask ?timeout?",
+		"sleep ms",
+		"loop count ops"
+	};
+	static const int minArgs[] = { 3, 2, 2, 2, 3, 2, 3 };
+	static const int maxArgs[] = { 3, 2, 2, 3, 4, 2, 3 };
+
+	Tcl_Obj** ops;
+	int opCount, i;
+
+	if (TCL_OK != Tcl_ListObjGetElements(interp, opsObj, &opCount, &ops)) {
+		return TCL_ERROR;
+	}
+
+	for (i = 0; i < opCount; ++i) {
+		Tcl_Obj** args;
+		int argCount, type, start;
+		SequenceStep* step;
+
+		if (TCL_OK != Tcl_ListObjGetElements(interp, ops[i], &argCount, &args)) {
+			return TCL_ERROR;
+		}
+		if (argCount == 0) {
+			continue;
+		}
+		if (TCL_OK != Tcl_GetIndexFromObj(interp, args[0], stepNames, "operation", 0, &type)) {
+			return TCL_ERROR;
+		}
+		if (argCount < minArgs[type] || argCount > maxArgs[type]) {
+			Tcl_AppendResult(interp, "wrong # args: should be \"", usage[type], "\"", NULL);
+			return TCL_ERROR;
+		}
+
+		start = seq->stepCount;
+		step = addStep(seq, (enum StepType) type);
+
+		switch (type) {
+		case STEP_SLEEP:
+			if (TCL_OK != Tcl_GetUInt32FromObj(interp, args[1], &step->arg)) {
+				return TCL_ERROR;
+			}
+			break;
+
+		case STEP_LOOP:
+			if (TCL_OK != Tcl_GetUInt32FromObj(interp, args[1], &step->arg)) {
+				return TCL_ERROR;
+			}
+			if (TCL_OK != compileOps(interp, seq, args[2])) {
+				return TCL_ERROR;
+			}
+			/* Steps array might be reallocated */
+			step = addStep(seq, STEP_END);
+			step->jump = start;
+			seq->steps[start].jump = seq->stepCount - 1;
+			break;
+
+		default:
+			/* Operations on session */
+			if ((step->session = addSession(interp, seq, args[1])) < 0) {
+				return TCL_ERROR;
+			}
+
+			if (type == STEP_WRITE) {
+				Tcl_Size len;
+
+				/* Fail early if data cannot be sent as bytes */
+				if (NULL == Tcl_GetBytesFromObj(interp, args[2], &len)) {
+					return TCL_ERROR;
+				}
+				step->data = args[2];
+				Tcl_IncrRefCount(step->data);
+			} else if (type == STEP_ASSERT_TRIGGER) {
+				step->arg = VI_TRIG_PROT_DEFAULT;
+				if (argCount > 2 && TCL_OK != Tcl_GetUInt32FromObj(interp, args[2], &step->arg)) {
+					return TCL_ERROR;
+				}
+			} else if (type == STEP_WAIT_STB) {
+				step->timeout = VI_TMO_INFINITE;
+				if (TCL_OK != Tcl_GetUInt32FromObj(interp, args[2], &step->arg)) {
+					return TCL_ERROR;
+				}
+				if (argCount > 3 && TCL_OK != Tcl_GetUInt32FromObj(interp, args[3], &step->timeout)) {
+					return TCL_ERROR;
+				}
+			}
+		}
+	}
+
+	return TCL_OK;
+}
+
+static int sequenceCompile(Tcl_Interp* const interp, Tcl_Obj* opsObj) {
+	SequenceTable* table = getSequenceTable(interp);
+	char name[sizeof(SEQUENCE_NAME_PREFIX) + TCL_INTEGER_SPACE];
+	Sequence* seq = (Sequence*) ckalloc(sizeof(Sequence));
+	Tcl_HashEntry* entry;
+	int isNew;
+
+	memset((void*) seq, 0, sizeof(*seq));
+	seq->sessions = Tcl_NewListObj(0, NULL);
+	Tcl_IncrRefCount(seq->sessions);
+
+	if (TCL_OK != compileOps(interp, seq, opsObj)) {
+		freeSequence(seq);
+		return TCL_ERROR;
+	}
+
+	sprintf(name, "%s%d", SEQUENCE_NAME_PREFIX, ++table->counter);
+	entry = Tcl_CreateHashEntry(&table->sequences, name, &isNew);
+	Tcl_SetHashValue(entry, (ClientData) seq);
+
+	Tcl_AppendResult(interp, name, NULL);
+	return TCL_OK;
+}
+
+/*
+ * Execution
+ */
+
+static void bufferReserve(Buffer* buf, size_t size) {
+	if (buf->length + size > buf->capacity) {
+		size_t capacity = buf->capacity ? buf->capacity : SEQUENCE_READ_CHUNK;
+		while (capacity < buf->length + size) {
+			capacity *= 2;
+		}
+		buf->bytes = (unsigned char*) ckrealloc((char*) buf->bytes, capacity);
+		buf->capacity = capacity;
+	}
+}
+
+static void bufferAppend(Buffer* buf, const void* data, size_t size) {
+	bufferReserve(buf, size);
+	memcpy(buf->bytes + buf->length, data, size);
+	buf->length += size;
+}
+
+static Tcl_Obj* bufferToObj(Buffer* buf) {
+	Tcl_Obj* obj = Tcl_NewByteArrayObj(buf->bytes, (Tcl_Size) buf->length);
+	if (buf->bytes) {
+		ckfree((char*) buf->bytes);
+	}
+	return obj;
+}
+
+/* Reads complete message, appending it to buffer */
+static ViStatus readMessage(ViSession vi, Buffer* buf) {
+	ViStatus status;
+	ViUInt32 retCount;
+
+	do {
+		bufferReserve(buf, SEQUENCE_READ_CHUNK);
+		status = viRead(vi, buf->bytes + buf->length, SEQUENCE_READ_CHUNK, &retCount);
+		buf->length += retCount;
+	} while (status == VI_SUCCESS_MAX_CNT);
+
+	return status;
+}
+
+/* Reads exactly count bytes, appending them to buffer */
+static ViStatus readExactly(ViSession vi, Buffer* buf, ViUInt32 count) {
+	ViStatus status = VI_SUCCESS_MAX_CNT;
+	ViUInt32 retCount;
+
+	bufferReserve(buf, count);
+	while (count > 0) {
+		status = viRead(vi, buf->bytes + buf->length, count, &retCount);
+		buf->length += retCount;
+		count -= retCount;
+		if (status < 0 || (count > 0 && status != VI_SUCCESS_MAX_CNT)) {
+			/* Error or message is shorter than expected */
+			return status < 0 ? status : VI_ERROR_INP_PROT_VIOL;
+		}
+	}
+
+	return status;
+}
+
+/* Reads IEEE 488.2 definite length block #<n><length><data>, appending data to buffer */
+static ViStatus readBlock(ViSession vi, Buffer* buf) {
+	unsigned char header[12];
+	ViUInt32 retCount, length = 0;
+	ViStatus status;
+	int digits, i;
+
+	status = viRead(vi, header, 2, &retCount);
+	if (status < 0) {
+		return status;
+	}
+	if (retCount != 2 || header[0] != '#' || header[1] < '1' || header[1] > '9') {
+		return VI_ERROR_INP_PROT_VIOL;
+	}
+
+	digits = header[1] - '0';
+	status = viRead(vi, header, (ViUInt32) digits, &retCount);
+	if (status < 0) {
+		return status;
+	}
+	if (retCount != (ViUInt32) digits) {
+		return VI_ERROR_INP_PROT_VIOL;
+	}
+	for (i = 0; i < digits; ++i) {
+		length = length * 10 + (header[i] - '0');
+	}
+
+	status = length ? readExactly(vi, buf, length) : VI_SUCCESS_MAX_CNT;
+	if (status == VI_SUCCESS_MAX_CNT) {
+		/* Skip one byte of message terminator following block, if any */
+		status = viRead(vi, header, 1, &retCount);
+		if (status == VI_ERROR_TMO) {
+			status = VI_SUCCESS;
+		}
+	}
+
+	return status;
+}
+
+static int sequenceRun(Tcl_Interp* const interp, Sequence* seq, Tcl_WideInt count) {
+	VisaChannelData** sessions;
+	Tcl_Obj** names;
+	Buffer data, lengths, timestamps;
+	ViUInt32* loopCounters;
+	Tcl_Time start, now;
+	Tcl_Obj* res;
+	Tcl_WideInt steps = 0, n;
+	int sessionCount, i, code = TCL_ERROR;
+
+	/* Resolve channels, they might be closed since sequence was compiled */
+	Tcl_ListObjGetElements(NULL, seq->sessions, &sessionCount, &names);
+	sessions = (VisaChannelData**) ckalloc(sizeof(VisaChannelData*) * (sessionCount + 1));
+	for (i = 0; i < sessionCount; ++i) {
+		if (NULL == (sessions[i] = getConnectedVisaChannelFromObj(interp, names[i]))) {
+			ckfree((char*) sessions);
+			return TCL_ERROR;
+		}
+		if (TCL_OK != checkVisaChannelBusy(interp, sessions[i], 1)) {
+			ckfree((char*) sessions);
+			return TCL_ERROR;
+		}
+	}
+
+	loopCounters = (ViUInt32*) ckalloc(sizeof(ViUInt32) * (seq->stepCount + 1));
+	memset((void*) &data, 0, sizeof(data));
+	memset((void*) &lengths, 0, sizeof(lengths));
+	memset((void*) &timestamps, 0, sizeof(timestamps));
+
+	Tcl_GetTime(&start);
+
+	for (n = 0; n < count; ++n) {
+		for (i = 0; i < seq->stepCount; ++i) {
+			SequenceStep* step = &seq->steps[i];
+			VisaChannelData* session = step->session >= 0 ? sessions[step->session] : NULL;
+			ViStatus status = VI_SUCCESS;
+			ViUInt32 retCount;
+			size_t offset;
+			double t;
+
+			switch (step->type) {
+			case STEP_WRITE: {
+				Tcl_Size len;
+				Tcl_WideUInt written;
+				unsigned char* bytes = Tcl_GetBytesFromObj(NULL, step->data, &len);
+				status = writeVisa(session->session, bytes, (Tcl_WideUInt) len, &written);
+				break;
+			}
+
+			case STEP_READ:
+			case STEP_READ_BLOCK:
+				offset = data.length;
+				status = step->type == STEP_READ ? readMessage(session->session, &data) : readBlock(session->session, &data);
+				retCount = (ViUInt32) (data.length - offset);
+				bufferAppend(&lengths, &retCount, sizeof(retCount));
+				break;
+
+			case STEP_ASSERT_TRIGGER:
+				status = viAssertTrigger(session->session, (ViUInt16) step->arg);
+				break;
+
+			case STEP_WAIT_STB: {
+				ViUInt16 stb;
+				status = waitVisaStb(session->session, (ViUInt16) step->arg, step->timeout, VISA_STB_DEFAULT_INTERVAL, 0, &stb);
+				break;
+			}
+
+			case STEP_SLEEP:
+				Tcl_Sleep((int) step->arg);
+				break;
+
+			case STEP_LOOP:
+				loopCounters[i] = step->arg;
+				if (loopCounters[i] == 0) {
+					i = step->jump;
+				}
+				continue;
+
+			case STEP_END:
+				if (--loopCounters[step->jump] > 0) {
+					i = step->jump;
+				}
+				continue;
+			}
+
+			if (session) {
+				storeLastError(session, status, NULL);
+				if (status < 0) {
+					char buf[TCL_INTEGER_SPACE];
+					sprintf(buf, "%d", i);
+					Tcl_AppendResult(interp, visaErrorMessage(status), "\n    (step ", buf, " \"", stepNames[step->type],
+						"\" on ", Tcl_GetChannelName(session->channel), ")", NULL);
+					goto cleanup;
+				}
+			}
+
+			Tcl_GetTime(&now);
+			t = (double) (now.sec - start.sec) + (double) (now.usec - start.usec) / 1000000.0;
+			bufferAppend(&timestamps, &t, sizeof(t));
+			++steps;
+		}
+	}
+
+	res = Tcl_NewListObj(0, NULL);
+	Tcl_ListObjAppendElement(NULL, res, Tcl_NewStringObj("data", -1));
+	Tcl_ListObjAppendElement(NULL, res, bufferToObj(&data));
+	Tcl_ListObjAppendElement(NULL, res, Tcl_NewStringObj("lengths", -1));
+	Tcl_ListObjAppendElement(NULL, res, bufferToObj(&lengths));
+	Tcl_ListObjAppendElement(NULL, res, Tcl_NewStringObj("timestamps", -1));
+	Tcl_ListObjAppendElement(NULL, res, bufferToObj(&timestamps));
+	Tcl_ListObjAppendElement(NULL, res, Tcl_NewStringObj("steps", -1));
+	Tcl_ListObjAppendElement(NULL, res, Tcl_NewWideIntObj(steps));
+	Tcl_SetObjResult(interp, res);
+	data.bytes = lengths.bytes = timestamps.bytes = NULL;
+	code = TCL_OK;
+
+cleanup:
+	if (data.bytes) {
+		ckfree((char*) data.bytes);
+	}
+	if (lengths.bytes) {
+		ckfree((char*) lengths.bytes);
+	}
+	if (timestamps.bytes) {
+		ckfree((char*) timestamps.bytes);
+	}
+	ckfree((char*) loopCounters);
+	ckfree((char*) sessions);
+
+	return code;
+}
+
+int tclvisa_sequence(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]) {
+	static const char* subcommands[] = { "compile", "delete", "run", NULL };
+	enum { CMD_COMPILE, CMD_DELETE, CMD_RUN };
+
+	Tcl_HashEntry* entry;
+	Tcl_WideInt count = 1;
+	int index;
+
+	UNREFERENCED_PARAMETER(clientData);	/* avoid "unused parameter" warning */
+
+	/* Check number of arguments */
+	if (objc < 3) {
+		Tcl_WrongNumArgs(interp, 1, objv, "subcommand arg ?arg ...?");
+		return TCL_ERROR;
+	}
+
+	if (TCL_OK != Tcl_GetIndexFromObj(interp, objv[1], subcommands, "subcommand", 0, &index)) {
+		return TCL_ERROR;
+	}
+
+	switch (index) {
+	case CMD_COMPILE:
+		if (objc != 3) {
+			Tcl_WrongNumArgs(interp, 2, objv, "ops");
+			return TCL_ERROR;
+		}
+		return sequenceCompile(interp, objv[2]);
+
+	case CMD_DELETE:
+		if (objc != 3) {
+			Tcl_WrongNumArgs(interp, 2, objv, "sequence");
+			return TCL_ERROR;
+		}
+		if (NULL == (entry = findSequence(interp, objv[2]))) {
+			return TCL_ERROR;
+		}
+		freeSequence((Sequence*) Tcl_GetHashValue(entry));
+		Tcl_DeleteHashEntry(entry);
+		return TCL_OK;
+
+	case CMD_RUN:
+		if (objc != 3 && objc != 5) {
+			Tcl_WrongNumArgs(interp, 2, objv, "sequence ?-count n?");
+			return TCL_ERROR;
+		}
+		if (NULL == (entry = findSequence(interp, objv[2]))) {
+			return TCL_ERROR;
+		}
+		if (objc == 5) {
+			static const char* options[] = { "-count", NULL };
+			int opt;
+			if (TCL_OK != Tcl_GetIndexFromObj(interp, objv[3], options, "option", 0, &opt)
+				|| TCL_OK != Tcl_GetWideIntFromObj(interp, objv[4], &count)) {
+				return TCL_ERROR;
+			}
+		}
+		return sequenceRun(interp, (Sequence*) Tcl_GetHashValue(entry), count);
+	}
+
+	return TCL_ERROR;
+}
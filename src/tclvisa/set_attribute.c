@@ -14,6 +14,7 @@
 #include <visa.h>
 #include <tcl.h>
 #include "visa_channel.h"
+#include "visa_reconnect.h"
 #include "visa_utils.h"
 #include "tclvisa_utils.h"
 
@@ -31,7 +32,7 @@ int tclvisa_set_attribute(const ClientData clientData, Tcl_Interp* const interp,
 	}
 
 	/* Convert first argument to valid Tcl channel reference */
-    session = getVisaChannelFromObj(interp, objv[1]);
+    session = getConnectedVisaChannelFromObj(interp, objv[1]);
 	if (session == NULL) {
 		return TCL_ERROR;
 	}
@@ -52,7 +53,7 @@ int tclvisa_set_attribute(const ClientData clientData, Tcl_Interp* const interp,
 	} 
 
 	/* Attempt to set attribute */
-	status = viSetAttribute(session->session, (ViAttr) attr, (ViAttrState) value);
+	status = setVisaAttribute(session, (ViAttr) attr, (ViAttrState) value);
 	storeLastError(session, status, interp);
 	
 	return status < 0 ? TCL_ERROR : TCL_OK;
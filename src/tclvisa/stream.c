@@ -0,0 +1,117 @@
+/*
+ * stream.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+#include <tcl.h>
+#include "visa_channel.h"
+#include "visa_reconnect.h"
+#include "visa_stream.h"
+#include "visa_utils.h"
+#include "tcl_utils.h"
+#include "tclvisa_utils.h"
+
+static int streamStart(Tcl_Interp* const interp, VisaChannelData* session, const int objc, Tcl_Obj* const objv[]) {
+	static const char* options[] = { "-chunk", "-overflow", "-ringsize", NULL };
+	enum { OPT_CHUNK, OPT_OVERFLOW, OPT_RINGSIZE };
+	static const char* overflowModes[] = { "block", "drop", NULL };
+	enum { OVERFLOW_BLOCK, OVERFLOW_DROP };
+
+	ViUInt32 chunk = VISA_STREAM_DEFAULT_CHUNK;
+	ViUInt32 ringSize = VISA_STREAM_DEFAULT_RING_SIZE;
+	int overflow = OVERFLOW_DROP;
+	int i, index;
+
+	if (objc % 2 != 1) {
+		Tcl_WrongNumArgs(interp, 2, objv, "session ?-chunk bytes? ?-ringsize bytes? ?-overflow drop|block?");
+		return TCL_ERROR;
+	}
+
+	for (i = 3; i < objc; i += 2) {
+		if (TCL_OK != Tcl_GetIndexFromObj(interp, objv[i], options, "option", 0, &index)) {
+			return TCL_ERROR;
+		}
+
+		switch (index) {
+		case OPT_CHUNK:
+			if (TCL_OK != Tcl_GetUInt32FromObj(interp, objv[i + 1], &chunk)) {
+				return TCL_ERROR;
+			}
+			break;
+
+		case OPT_RINGSIZE:
+			if (TCL_OK != Tcl_GetUInt32FromObj(interp, objv[i + 1], &ringSize)) {
+				return TCL_ERROR;
+			}
+			break;
+
+		case OPT_OVERFLOW:
+			if (TCL_OK != Tcl_GetIndexFromObj(interp, objv[i + 1], overflowModes, "overflow mode", 0, &overflow)) {
+				return TCL_ERROR;
+			}
+			break;
+		}
+	}
+
+	return startVisaStream(interp, session, chunk, ringSize, overflow == OVERFLOW_BLOCK);
+}
+
+int tclvisa_stream(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]) {
+	static const char* subcommands[] = { "read", "start", "stats", "stop", NULL };
+	enum { CMD_READ, CMD_START, CMD_STATS, CMD_STOP };
+
+	VisaChannelData* session;
+	ViUInt32 maxBytes = (ViUInt32) 0x7FFFFFFF;
+	int index;
+
+	UNREFERENCED_PARAMETER(clientData);	/* avoid "unused parameter" warning */
+
+	/* Check number of arguments */
+	if (objc < 3) {
+		Tcl_WrongNumArgs(interp, 1, objv, "subcommand session ?arg ...?");
+		return TCL_ERROR;
+	}
+
+	if (TCL_OK != Tcl_GetIndexFromObj(interp, objv[1], subcommands, "subcommand", 0, &index)) {
+		return TCL_ERROR;
+	}
+
+	/* Convert second argument to valid Tcl channel reference */
+	session = getConnectedVisaChannelFromObj(interp, objv[2]);
+	if (session == NULL) {
+		return TCL_ERROR;
+	}
+
+	switch (index) {
+	case CMD_START:
+		return streamStart(interp, session, objc, objv);
+
+	case CMD_READ:
+		if (objc > 4) {
+			Tcl_WrongNumArgs(interp, 2, objv, "session ?maxBytes?");
+			return TCL_ERROR;
+		}
+		if (objc == 4 && TCL_OK != Tcl_GetUInt32FromObj(interp, objv[3], &maxBytes)) {
+			return TCL_ERROR;
+		}
+		return readVisaStream(interp, session, maxBytes);
+
+	case CMD_STATS:
+	case CMD_STOP:
+		if (objc != 3) {
+			Tcl_WrongNumArgs(interp, 2, objv, "session");
+			return TCL_ERROR;
+		}
+		return index == CMD_STATS ? getVisaStreamStats(interp, session) : stopVisaStream(interp, session);
+	}
+
+	return TCL_ERROR;
+}
@@ -89,3 +89,24 @@ int Tcl_GetUInt32FromObj(Tcl_Interp *interp, Tcl_Obj *objPtr, ViUInt32 *uintPtr)
 
 	return TCL_OK;
 }
+
+int Tcl_GetUInt64FromObj(Tcl_Interp *interp, Tcl_Obj *objPtr, Tcl_WideUInt *uintPtr) {
+	Tcl_WideInt w;
+
+	if (Tcl_GetWideIntFromObj(interp, objPtr, &w)) {
+		return TCL_ERROR;
+	}
+
+	if (w < 0) {
+		if (interp) {
+			Tcl_AppendResult(interp, "expected unsigned integer but got negative value", NULL);
+		}
+		return TCL_ERROR;
+	}
+
+	if (uintPtr) {
+		*uintPtr = (Tcl_WideUInt) w;
+	}
+
+	return TCL_OK;
+}
@@ -16,6 +16,18 @@
 
 #include <tcl.h>
 #include <visa.h> 
+#include <limits.h>
+
+/* Type of string, list and byte array lengths, appeared in Tcl 8.7 */
+#ifndef TCL_SIZE_MAX
+typedef int Tcl_Size;
+#define TCL_SIZE_MAX INT_MAX
+#endif
+
+/* Tcl 9 refuses to treat strings with characters above \xFF as bytes */
+#if TCL_MAJOR_VERSION == 8 && TCL_MINOR_VERSION < 7
+#define Tcl_GetBytesFromObj(interp, objPtr, lengthPtr) Tcl_GetByteArrayFromObj((objPtr), (lengthPtr))
+#endif
 
 /*
  *----------------------------------------------------------------
@@ -39,4 +51,6 @@ int Tcl_GetUInt16FromObj(Tcl_Interp *interp, Tcl_Obj *objPtr, ViUInt16 *uintPtr)
 
 int Tcl_GetUInt32FromObj(Tcl_Interp *interp, Tcl_Obj *objPtr, ViUInt32 *uintPtr);
 
+int Tcl_GetUInt64FromObj(Tcl_Interp *interp, Tcl_Obj *objPtr, Tcl_WideUInt *uintPtr);
+
 #endif /* TCL_UTILS_H_34237856365464 */
@@ -24,9 +24,21 @@
 #include <windows.h>
 #endif
 #include "tclvisa_utils.h"
+#include "visa_async.h"
 
 #define NAMESPACE "visa::"
 
+#if TCL_MAJOR_VERSION > 8
+#define TCLVISA_TCL_VERSION "9.0"
+#else
+#define TCLVISA_TCL_VERSION "8.1"
+#endif
+
+/* Event handlers and worker threads share data guarded by Tcl mutexes, which are no-ops otherwise */
+#ifndef TCL_THREADS
+#error "tclvisa must be built with TCL_THREADS defined"
+#endif
+
 /*
  * Forward declarations
  */
@@ -35,6 +47,7 @@ int tclvisa_open_default_rm(const ClientData clientData, Tcl_Interp * const inte
 int tclvisa_set_attribute(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
 int tclvisa_get_attribute(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
 int tclvisa_clear(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
+int tclvisa_close_all(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
 int tclvisa_lock(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
 int tclvisa_unlock(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
 int tclvisa_find(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
@@ -50,12 +63,43 @@ int tclvisa_gpib_control_atn(const ClientData clientData, Tcl_Interp* const inte
 int tclvisa_gpib_control_ren(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
 int tclvisa_gpib_pass_control(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
 int tclvisa_gpib_send_ifc(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
+int tclvisa_gpib_group_trigger(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
+int tclvisa_decimate(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
+int tclvisa_const(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
+int tclvisa_backend(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
+int tclvisa_on_event(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
+int tclvisa_off_event(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
+int tclvisa_wait_any(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
+int tclvisa_stream(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
+int tclvisa_sequence(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
+int tclvisa_wait_stb(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
+int tclvisa_trigger_all(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
+int tclvisa_open_many(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
+int tclvisa_inventory(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
+int tclvisa_query(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
+int tclvisa_query_nr(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
+int tclvisa_read_async(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
+int tclvisa_read_waveform(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
+int tclvisa_read_async_nr(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]);
+
+int setVisaVersion(Tcl_Interp* const interp, const char *version);
+
+#define addCommandData(tcl_name, proc, data)	\
+	if (NULL == Tcl_CreateObjCommand(interp, NAMESPACE tcl_name, proc, (ClientData) (data), NULL))	\
+		goto error
 
-int setVisaConstants(Tcl_Interp* const interp, const char* prefix, const char *version);
+#define addCommand(tcl_name, proc)	addCommandData(tcl_name, proc, NULL)
 
-#define addCommand(tcl_name, proc)	\
-	if (NULL == Tcl_CreateObjCommand(interp, NAMESPACE tcl_name, proc, NULL, NULL))	\
+/* Command which can suspend coroutine, plain command if Tcl has no coroutines */
+#ifdef TCLVISA_NRE
+#define addNRCommand(tcl_name, proc, nreProc)	\
+	if (NULL == (isVisaAsyncAvailable()	\
+			? Tcl_NRCreateCommand(interp, NAMESPACE tcl_name, proc, nreProc, NULL, NULL)	\
+			: Tcl_CreateObjCommand(interp, NAMESPACE tcl_name, proc, NULL, NULL)))	\
 		goto error
+#else
+#define addNRCommand(tcl_name, proc, nreProc)	addCommand(tcl_name, proc)
+#endif
 
 int createTclvisaCommands(Tcl_Interp* const interp) {
 	addCommand("open", tclvisa_open);
@@ -63,6 +107,7 @@ int createTclvisaCommands(Tcl_Interp* const interp) {
 	addCommand("set-attribute", tclvisa_set_attribute);
 	addCommand("get-attribute", tclvisa_get_attribute);
 	addCommand("clear", tclvisa_clear);
+	addCommand("close-all", tclvisa_close_all);
 	addCommand("lock", tclvisa_lock);
 	addCommand("unlock", tclvisa_unlock);
 	addCommand("find", tclvisa_find);
@@ -78,8 +123,24 @@ int createTclvisaCommands(Tcl_Interp* const interp) {
 	addCommand("gpib-control-ren", tclvisa_gpib_control_ren);
 	addCommand("gpib-pass-control", tclvisa_gpib_pass_control);
 	addCommand("gpib-send-ifc", tclvisa_gpib_send_ifc);
-
-	if (TCL_OK != setVisaConstants(interp, NAMESPACE, PACKAGE_VERSION)) {
+	addCommand("gpib-group-trigger", tclvisa_gpib_group_trigger);
+	addCommandData("const", tclvisa_const, NAMESPACE);
+	addCommand("backend", tclvisa_backend);
+	addCommand("on-event", tclvisa_on_event);
+	addCommand("off-event", tclvisa_off_event);
+	addCommand("wait-any", tclvisa_wait_any);
+	addCommand("stream", tclvisa_stream);
+	addCommand("sequence", tclvisa_sequence);
+	addCommand("wait-stb", tclvisa_wait_stb);
+	addCommand("trigger-all", tclvisa_trigger_all);
+	addCommand("open-many", tclvisa_open_many);
+	addCommand("inventory", tclvisa_inventory);
+	addNRCommand("query", tclvisa_query, tclvisa_query_nr);
+	addNRCommand("read-async", tclvisa_read_async, tclvisa_read_async_nr);
+	addCommand("read-waveform", tclvisa_read_waveform);
+	addCommand("decimate", tclvisa_decimate);
+
+	if (TCL_OK != setVisaVersion(interp, PACKAGE_VERSION)) {
 		goto error;
 	}
 
@@ -95,13 +156,14 @@ __declspec(dllexport)
 int Tclvisa_Init(Tcl_Interp* const interp) {
     /*
      * This may work with 8.0, but we are using strictly stubs here,
-     * which requires 8.1.
+     * which requires 8.1. Tcl 9 does not satisfy "8.1" requirement and
+     * cannot load extensions built for 8.x anyway.
      */
 	if (
 #ifdef USE_TCL_STUBS
-		Tcl_InitStubs(interp, "8.1", 0)
+		Tcl_InitStubs(interp, TCLVISA_TCL_VERSION, 0)
 #else
-		Tcl_PkgRequire(interp, "Tcl", "8.1", 0)
+		Tcl_PkgRequire(interp, "Tcl", TCLVISA_TCL_VERSION, 0)
 #endif
 			== NULL) {
 		return TCL_ERROR;
@@ -22,4 +22,14 @@
 #endif
 #endif	//	UNREFERENCED_PARAMETER
 
+/* Access to variables shared between threads without lock */
+#if defined(__GNUC__)
+#define loadAcquire(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define storeRelease(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else
+/* MSVC gives volatile accesses acquire/release semantics */
+#define loadAcquire(p) (*(p))
+#define storeRelease(p, v) (*(p) = (v))
+#endif
+
 #endif /* TCLVISA_UTILS_H_34237856365464 */
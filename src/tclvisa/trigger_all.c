@@ -0,0 +1,251 @@
+/*
+ * trigger_all.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+/*
+ * Every session gets its own thread, which is started in advance and
+ * waits at a barrier. When all threads are ready they are released at once
+ * and call viAssertTrigger() in parallel, so trigger skew does not grow
+ * with number of sessions.
+ */
+
+#include <tcl.h>
+#include <string.h>
+#ifdef _WINDOWS
+#include <windows.h>
+#define yieldThread() SwitchToThread()
+#else
+#include <sched.h>
+#define yieldThread() sched_yield()
+#endif
+#include "visa_channel.h"
+#include "visa_reconnect.h"
+#include "visa_utils.h"
+#include "tcl_utils.h"
+#include "tclvisa_utils.h"
+
+typedef struct _TriggerGroup {
+	Tcl_Mutex mutex;
+	Tcl_Condition cond;
+	int staged;	/* number of threads waiting at barrier */
+	volatile int go;	/* barrier is open */
+	volatile int cancel;	/* threads should finish without triggering */
+} TriggerGroup;
+
+typedef struct _SessionTrigger {
+	TriggerGroup* group;
+	VisaChannelData* data;
+	ViUInt16 protocol;
+	ViStatus status;
+	int software;	/* trigger identifier below is to be restored */
+	ViInt16 trigId;
+	Tcl_Time start, end;
+	Tcl_ThreadId threadId;
+} SessionTrigger;
+
+static Tcl_ThreadCreateType triggerProc(ClientData clientData) {
+	SessionTrigger* t = (SessionTrigger*) clientData;
+	TriggerGroup* g = t->group;
+
+	Tcl_MutexLock(&g->mutex);
+	++g->staged;
+	Tcl_ConditionNotify(&g->cond);
+	Tcl_MutexUnlock(&g->mutex);
+
+	/*
+	 * Spin instead of waiting on condition: threads woken by a condition
+	 * would leave it one by one, since they all need its mutex.
+	 * Yield while spinning, so that with more sessions than processors
+	 * waiting threads do not hold back those still being started.
+	 */
+	while (!loadAcquire(&g->go)) {
+		yieldThread();
+	}
+
+	if (!loadAcquire(&g->cancel)) {
+		/* Status is stored to session by Tcl thread after join */
+		Tcl_GetTime(&t->start);
+		t->status = assertVisaTrigger(t->data, t->protocol);
+		Tcl_GetTime(&t->end);
+	}
+
+	TCL_THREAD_CREATE_RETURN;
+}
+
+/* Microseconds passed from "from" to "to" */
+static Tcl_WideInt timeDiff(const Tcl_Time* from, const Tcl_Time* to) {
+	return ((Tcl_WideInt) to->sec - from->sec) * 1000000 + (to->usec - from->usec);
+}
+
+static int getProtocolFromObj(Tcl_Interp* const interp, Tcl_Obj* obj, ViUInt16* protocol, int* software) {
+	static const char* names[] = {"default", "on", "off", "sync", "sw", NULL};
+	static const ViUInt16 values[] = {VI_TRIG_PROT_DEFAULT, VI_TRIG_PROT_ON, VI_TRIG_PROT_OFF, VI_TRIG_PROT_SYNC, VI_TRIG_PROT_DEFAULT};
+	enum { PROT_SW = 4 };
+	int index;
+
+	*software = 0;
+
+	if (TCL_OK == Tcl_GetUInt16FromObj(NULL, obj, protocol)) {
+		return TCL_OK;
+	}
+
+	if (TCL_OK != Tcl_GetIndexFromObj(interp, obj, names, "protocol", 0, &index)) {
+		return TCL_ERROR;
+	}
+
+	*protocol = values[index];
+	*software = index == PROT_SW;
+	return TCL_OK;
+}
+
+int tclvisa_trigger_all(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]) {
+	ViUInt16 protocol = VI_TRIG_PROT_DEFAULT;
+	int software = 0;
+	Tcl_Obj** sessionObjs;
+	int sessionCount;
+	SessionTrigger* triggers = NULL;
+	TriggerGroup group;
+	Tcl_Time release;
+	Tcl_Obj* res;
+	int i, j, result, started = 0, code = TCL_ERROR;
+
+	UNREFERENCED_PARAMETER(clientData);	/* avoid "unused parameter" warning */
+
+	/* Check number of arguments */
+	if (objc != 2 && objc != 4) {
+		Tcl_WrongNumArgs(interp, 1, objv, "sessionList ?-protocol protocol?");
+		return TCL_ERROR;
+	}
+
+	if (TCL_OK != Tcl_ListObjGetElements(interp, objv[1], &sessionCount, &sessionObjs)) {
+		return TCL_ERROR;
+	}
+
+	if (objc > 2) {
+		static const char* options[] = {"-protocol", NULL};
+		int index;
+
+		if (TCL_OK != Tcl_GetIndexFromObj(interp, objv[2], options, "option", 0, &index)) {
+			return TCL_ERROR;
+		}
+		if (TCL_OK != getProtocolFromObj(interp, objv[3], &protocol, &software)) {
+			return TCL_ERROR;
+		}
+	}
+
+	if (sessionCount == 0) {
+		return TCL_OK;
+	}
+
+	triggers = (SessionTrigger*) ckalloc(sizeof(SessionTrigger) * sessionCount);
+	memset((void*) triggers, 0, sizeof(SessionTrigger) * sessionCount);
+	memset((void*) &group, 0, sizeof(group));
+
+	/* Prepare sessions before any thread is started */
+	for (i = 0; i < sessionCount; ++i) {
+		SessionTrigger* t = &triggers[i];
+
+		t->data = getConnectedVisaChannelFromObj(interp, sessionObjs[i]);
+		if (NULL == t->data) {
+			goto cleanup;
+		}
+		for (j = 0; j < i; ++j) {
+			if (triggers[j].data == t->data) {
+				Tcl_AppendResult(interp, "session \"", Tcl_GetString(sessionObjs[i]), "\" is listed twice", NULL);
+				goto cleanup;
+			}
+		}
+		t->group = &group;
+		t->protocol = protocol;
+
+		if (software) {
+			ViStatus status = viGetAttribute(t->data->session, VI_ATTR_TRIG_ID, &t->trigId);
+
+			if (status >= 0) {
+				status = setVisaAttribute(t->data, VI_ATTR_TRIG_ID, (ViAttrState) VI_TRIG_SW);
+			}
+			storeLastError(t->data, status, interp);
+			if (status < 0) {
+				goto cleanup;
+			}
+			t->software = 1;
+		}
+	}
+
+	for (i = 0; i < sessionCount; ++i) {
+		if (TCL_OK != Tcl_CreateThread(&triggers[i].threadId, triggerProc, (ClientData) &triggers[i], TCL_THREAD_STACK_DEFAULT, TCL_THREAD_JOINABLE)) {
+			Tcl_AppendResult(interp, "cannot create thread", NULL);
+			storeRelease(&group.cancel, 1);
+			break;
+		}
+		++started;
+	}
+
+	/* Wait until all threads reach the barrier, then open it */
+	Tcl_MutexLock(&group.mutex);
+	while (group.staged < started) {
+		Tcl_ConditionWait(&group.cond, &group.mutex, NULL);
+	}
+	Tcl_MutexUnlock(&group.mutex);
+
+	Tcl_GetTime(&release);
+	storeRelease(&group.go, 1);
+
+	for (i = 0; i < started; ++i) {
+		Tcl_JoinThread(triggers[i].threadId, &result);
+	}
+
+	for (i = 0; i < started; ++i) {
+		if (!group.cancel) {
+			storeLastError(triggers[i].data, triggers[i].status, NULL);
+		}
+	}
+
+	if (started < sessionCount) {
+		goto cleanup;
+	}
+
+	/* Report the first failed session */
+	for (i = 0; i < sessionCount; ++i) {
+		if (triggers[i].status < 0) {
+			Tcl_AppendResult(interp, "error triggering \"", Tcl_GetString(sessionObjs[i]), "\": ", visaErrorMessage(triggers[i].status), NULL);
+			goto cleanup;
+		}
+	}
+
+	/* Return {session start end} per session, microseconds from release */
+	res = Tcl_NewListObj(0, NULL);
+	for (i = 0; i < sessionCount; ++i) {
+		Tcl_Obj* elem[3];
+
+		elem[0] = sessionObjs[i];
+		elem[1] = Tcl_NewWideIntObj(timeDiff(&release, &triggers[i].start));
+		elem[2] = Tcl_NewWideIntObj(timeDiff(&release, &triggers[i].end));
+		Tcl_ListObjAppendElement(interp, res, Tcl_NewListObj(3, elem));
+	}
+	Tcl_SetObjResult(interp, res);
+	code = TCL_OK;
+
+cleanup:
+	/* Trigger has been asserted or command fails anyway, so failure to restore is not reported */
+	for (i = 0; i < sessionCount; ++i) {
+		if (triggers[i].software) {
+			setVisaAttribute(triggers[i].data, VI_ATTR_TRIG_ID, (ViAttrState) triggers[i].trigId);
+		}
+	}
+
+	Tcl_ConditionFinalize(&group.cond);
+	Tcl_MutexFinalize(&group.mutex);
+	ckfree((char*) triggers);
+
+	return code;
+}
@@ -0,0 +1,243 @@
+/*
+ * visa_api.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+#define VISA_API_IMPLEMENTATION
+
+#include <tcl.h>
+#include <stdlib.h>
+#include <string.h>
+#include "visa_api.h"
+#include "tclvisa_utils.h"
+
+#ifdef _WINDOWS
+#include <windows.h>
+typedef HMODULE LibraryHandle;
+#define openLibrary(path) LoadLibraryA(path)
+#define findSymbol(handle, name) ((void*) GetProcAddress((handle), (name)))
+#define closeLibrary(handle) FreeLibrary(handle)
+#define libraryError() "error loading DLL"
+#else
+#include <dlfcn.h>
+typedef void* LibraryHandle;
+#define openLibrary(path) dlopen((path), RTLD_NOW | RTLD_LOCAL)
+#define findSymbol(handle, name) dlsym((handle), (name))
+#define closeLibrary(handle) dlclose(handle)
+#define libraryError() dlerror()
+#endif
+
+/* Library names probed when no library is specified explicitly */
+static const char* defaultLibraries[] = {
+#if defined(_WINDOWS)
+#ifdef _WIN64
+	"visa64.dll",
+#endif
+	"visa32.dll",
+#elif defined(__APPLE__)
+	"/Library/Frameworks/VISA.framework/VISA",
+#else
+	"libvisa.so",
+	"libvisa.so.0",
+	"librsvisa.so",
+	"libiovisa.so",
+#endif
+	NULL
+};
+
+/* Placeholders used until library is loaded */
+#define VISA_API(name, params) \
+	static ViStatus _VI_FUNC missing_##name params { \
+		return VI_ERROR_LIBRARY_NFOUND; \
+	}
+
+VISA_API_FUNCTIONS
+
+#undef VISA_API
+
+#define VISA_API(name, params) &missing_##name,
+
+static const VisaApi missingApi = {
+	VISA_API_FUNCTIONS
+};
+
+#undef VISA_API
+
+static VisaApi libraryApi;
+static char* libraryPath = NULL;
+
+/*
+ * Default library is probed once, failure is remembered until
+ * visa::backend asks to probe again. Message is kept for error reports.
+ */
+#define LIBRARY_ERROR_SIZE 1024
+#define LIBRARY_ERROR_PREFIX "[VI_ERROR_LIBRARY_NFOUND] "
+static int defaultFailed = 0;
+static char loadError[LIBRARY_ERROR_SIZE];
+
+const VisaApi* visaApiLoaded = NULL;
+
+TCL_DECLARE_MUTEX(visaApiMutex)
+
+static int loadLibrary(const char* path, Tcl_DString* errorPtr) {
+	LibraryHandle handle;
+	void* sym;
+
+	handle = openLibrary(path);
+	if (NULL == handle) {
+		const char* err = libraryError();
+
+		Tcl_DStringAppend(errorPtr, "cannot load VISA library \"", -1);
+		Tcl_DStringAppend(errorPtr, path, -1);
+		Tcl_DStringAppend(errorPtr, "\"", -1);
+		if (err) {
+			Tcl_DStringAppend(errorPtr, ": ", -1);
+			Tcl_DStringAppend(errorPtr, err, -1);
+		}
+		return TCL_ERROR;
+	}
+
+	if (NULL == findSymbol(handle, "viOpenDefaultRM")) {
+		Tcl_DStringAppend(errorPtr, "\"", -1);
+		Tcl_DStringAppend(errorPtr, path, -1);
+		Tcl_DStringAppend(errorPtr, "\" is not a VISA library", -1);
+		closeLibrary(handle);
+		return TCL_ERROR;
+	}
+
+	/* Functions not exported by the library keep their placeholders */
+	libraryApi = missingApi;
+
+#define VISA_API(name, params) \
+	if (NULL != (sym = findSymbol(handle, #name))) { \
+		*(void**) &libraryApi.name = sym; \
+	}
+
+	VISA_API_FUNCTIONS
+
+#undef VISA_API
+
+	libraryPath = (char*) malloc(strlen(path) + 1);
+	strcpy(libraryPath, path);
+	storeRelease(&visaApiLoaded, (const VisaApi*) &libraryApi);
+
+	return TCL_OK;
+}
+
+static int loadDefaultLibrary(Tcl_DString* errorPtr) {
+	const char* path = getenv(TCLVISA_LIBRARY_ENV);
+	const char** p;
+
+	if (path && *path) {
+		/* Library chosen by user, do not fall back to default ones */
+		return loadLibrary(path, errorPtr);
+	}
+
+	for (p = defaultLibraries; *p; ++p) {
+		Tcl_DStringSetLength(errorPtr, 0);
+		if (TCL_OK == loadLibrary(*p, errorPtr)) {
+			return TCL_OK;
+		}
+	}
+
+	Tcl_DStringSetLength(errorPtr, 0);
+	Tcl_DStringAppend(errorPtr, "cannot find VISA library, tried:", -1);
+	for (p = defaultLibraries; *p; ++p) {
+		Tcl_DStringAppendElement(errorPtr, *p);
+	}
+	Tcl_DStringAppend(errorPtr, "; set " TCLVISA_LIBRARY_ENV " environment variable to specify one", -1);
+
+	return TCL_ERROR;
+}
+
+/* Called with visaApiMutex held */
+static int loadDefaultOnce(Tcl_DString* errorPtr) {
+	if (defaultFailed) {
+		Tcl_DStringAppend(errorPtr, loadError + sizeof(LIBRARY_ERROR_PREFIX) - 1, -1);
+		return TCL_ERROR;
+	}
+
+	if (TCL_OK != loadDefaultLibrary(errorPtr)) {
+		/* Stored in form of VISA error message, see visaErrorMessage() */
+		strcpy(loadError, LIBRARY_ERROR_PREFIX);
+		strncat(loadError, Tcl_DStringValue(errorPtr), LIBRARY_ERROR_SIZE - sizeof(LIBRARY_ERROR_PREFIX));
+		defaultFailed = 1;
+		return TCL_ERROR;
+	}
+
+	return TCL_OK;
+}
+
+const VisaApi* loadDefaultVisaApi(void) {
+	const VisaApi* api;
+	Tcl_DString err;
+
+	Tcl_DStringInit(&err);
+	Tcl_MutexLock(&visaApiMutex);
+
+	if (NULL == visaApiLoaded) {
+		loadDefaultOnce(&err);
+	}
+	api = visaApiLoaded;
+
+	Tcl_MutexUnlock(&visaApiMutex);
+	Tcl_DStringFree(&err);
+
+	return api ? api : &missingApi;
+}
+
+int loadVisaApi(Tcl_Interp* const interp, const char* path, int retry) {
+	int res = TCL_OK;
+	Tcl_DString err;
+
+	Tcl_DStringInit(&err);
+	Tcl_MutexLock(&visaApiMutex);
+
+	if (retry) {
+		defaultFailed = 0;
+	}
+
+	if (NULL != visaApiLoaded) {
+		/* Sessions of one library cannot be passed to another one */
+		if (path && 0 != strcmp(path, libraryPath)) {
+			Tcl_DStringAppend(&err, "VISA library \"", -1);
+			Tcl_DStringAppend(&err, libraryPath, -1);
+			Tcl_DStringAppend(&err, "\" is already loaded", -1);
+			res = TCL_ERROR;
+		}
+	} else {
+		res = path ? loadLibrary(path, &err) : loadDefaultOnce(&err);
+	}
+
+	Tcl_MutexUnlock(&visaApiMutex);
+
+	if (TCL_OK != res && interp) {
+		Tcl_AppendResult(interp, Tcl_DStringValue(&err), NULL);
+	}
+	Tcl_DStringFree(&err);
+
+	return res;
+}
+
+const char* getVisaApiPath(void) {
+	return libraryPath;
+}
+
+const char* getVisaApiError(void) {
+	/* Flag is set after message is complete, under the same mutex */
+	int failed;
+
+	Tcl_MutexLock(&visaApiMutex);
+	failed = defaultFailed;
+	Tcl_MutexUnlock(&visaApiMutex);
+
+	return failed ? loadError : NULL;
+}
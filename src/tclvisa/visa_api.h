@@ -0,0 +1,147 @@
+/*
+ * visa_api.h --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+/*
+ * VISA library is not linked to tclvisa, but loaded at run time on first
+ * VISA call. Every viXxx() call made by tclvisa sources is redirected by
+ * the macros below to the function table of the library loaded.
+ * Until a library is loaded, all functions return VI_ERROR_LIBRARY_NFOUND.
+ */
+
+#ifndef VISA_API_H_34237856365464
+#define VISA_API_H_34237856365464
+
+#include <tcl.h>
+#include <visa.h>
+#include "tclvisa_utils.h"
+
+#ifndef VI_ERROR_LIBRARY_NFOUND
+#define VI_ERROR_LIBRARY_NFOUND (_VI_ERROR+0x3FFF009EL)
+#endif
+
+/* Environment variable with path to VISA library to load */
+#define TCLVISA_LIBRARY_ENV "TCLVISA_LIBRARY"
+
+/* List of all VISA functions called by tclvisa */
+#define VISA_API_FUNCTIONS \
+	VISA_API(viAssertIntrSignal, (ViSession vi, ViInt16 mode, ViUInt32 statusID)) \
+	VISA_API(viAssertTrigger, (ViSession vi, ViUInt16 protocol)) \
+	VISA_API(viAssertUtilSignal, (ViSession vi, ViUInt16 line)) \
+	VISA_API(viClear, (ViSession vi)) \
+	VISA_API(viClose, (ViObject vi)) \
+	VISA_API(viDisableEvent, (ViSession vi, ViEventType eventType, ViUInt16 mechanism)) \
+	VISA_API(viEnableEvent, (ViSession vi, ViEventType eventType, ViUInt16 mechanism, ViEventFilter context)) \
+	VISA_API(viFindNext, (ViFindList vi, ViChar desc[])) \
+	VISA_API(viFindRsrc, (ViSession sesn, ViString expr, ViFindList* vi, ViUInt32* retCnt, ViChar desc[])) \
+	VISA_API(viFlush, (ViSession vi, ViUInt16 mask)) \
+	VISA_API(viGetAttribute, (ViObject vi, ViAttr attrName, void* attrValue)) \
+	VISA_API(viGpibCommand, (ViSession vi, ViBuf cmd, ViUInt32 cnt, ViUInt32* retCnt)) \
+	VISA_API(viGpibControlATN, (ViSession vi, ViUInt16 mode)) \
+	VISA_API(viGpibControlREN, (ViSession vi, ViUInt16 mode)) \
+	VISA_API(viGpibPassControl, (ViSession vi, ViUInt16 primAddr, ViUInt16 secAddr)) \
+	VISA_API(viGpibSendIFC, (ViSession vi)) \
+	VISA_API(viInstallHandler, (ViSession vi, ViEventType eventType, ViHndlr handler, ViAddr userHandle)) \
+	VISA_API(viLock, (ViSession vi, ViAccessMode lockType, ViUInt32 timeout, ViKeyId requestedKey, ViChar accessKey[])) \
+	VISA_API(viOpen, (ViSession sesn, ViRsrc name, ViAccessMode mode, ViUInt32 timeout, ViSession* vi)) \
+	VISA_API(viOpenDefaultRM, (ViSession* vi)) \
+	VISA_API(viParseRsrc, (ViSession rmSesn, ViRsrc rsrcName, ViUInt16* intfType, ViUInt16* intfNum)) \
+	VISA_API(viParseRsrcEx, (ViSession rmSesn, ViRsrc rsrcName, ViUInt16* intfType, ViUInt16* intfNum, ViChar rsrcClass[], ViChar expandedUnaliasedName[], ViChar aliasIfExists[])) \
+	VISA_API(viRead, (ViSession vi, ViPBuf buf, ViUInt32 cnt, ViUInt32* retCnt)) \
+	VISA_API(viReadSTB, (ViSession vi, ViUInt16* status)) \
+	VISA_API(viReadToFile, (ViSession vi, const char* filename, ViUInt32 cnt, ViUInt32* retCnt)) \
+	VISA_API(viSetAttribute, (ViObject vi, ViAttr attrName, ViAttrState attrValue)) \
+	VISA_API(viTerminate, (ViObject vi, ViUInt16 degree, ViJobId jobId)) \
+	VISA_API(viUninstallHandler, (ViSession vi, ViEventType eventType, ViHndlr handler, ViAddr userHandle)) \
+	VISA_API(viUnlock, (ViSession vi)) \
+	VISA_API(viWaitOnEvent, (ViSession vi, ViEventType inEventType, ViUInt32 timeout, ViEventType* outEventType, ViEvent* outContext)) \
+	VISA_API(viWrite, (ViSession vi, ViBuf buf, ViUInt32 cnt, ViUInt32* retCnt)) \
+	VISA_API(viWriteFromFile, (ViSession vi, const char* filename, ViUInt32 cnt, ViUInt32* retCnt))
+
+#define VISA_API(name, params) ViStatus (_VI_FUNC *name) params;
+
+typedef struct _VisaApi {
+	VISA_API_FUNCTIONS
+} VisaApi;
+
+#undef VISA_API
+
+extern const VisaApi* visaApiLoaded;
+
+const VisaApi* loadDefaultVisaApi(void);
+
+/*
+ * Loads library at path, or default one if path is NULL. Failure to load
+ * default library is remembered, retry forgets it and probes again.
+ */
+int loadVisaApi(Tcl_Interp* const interp, const char* path, int retry);
+const char* getVisaApiPath(void);
+
+/* Why default library could not be loaded, NULL if it has not failed */
+const char* getVisaApiError(void);
+
+/* Pointer never changes once set, acquire makes the function table visible */
+#define visaLibraryApi() (loadAcquire(&visaApiLoaded) ? visaApiLoaded : loadDefaultVisaApi())
+
+/*
+ * Some resources can be served by tclvisa itself without VISA library,
+ * see visa_native.c. Define TCLVISA_NO_NATIVE to build without it.
+ */
+#if !defined(_WINDOWS) && !defined(TCLVISA_NO_NATIVE)
+#define TCLVISA_NATIVE 1
+#endif
+
+#ifdef TCLVISA_NATIVE
+extern const VisaApi visaNativeApi;
+#define visaApi() (&visaNativeApi)
+#else
+#define visaApi() visaLibraryApi()
+#endif
+
+#ifndef VISA_API_IMPLEMENTATION
+
+#define viAssertIntrSignal (*visaApi()->viAssertIntrSignal)
+#define viAssertTrigger (*visaApi()->viAssertTrigger)
+#define viAssertUtilSignal (*visaApi()->viAssertUtilSignal)
+#define viClear (*visaApi()->viClear)
+#define viClose (*visaApi()->viClose)
+#define viDisableEvent (*visaApi()->viDisableEvent)
+#define viEnableEvent (*visaApi()->viEnableEvent)
+#define viFindNext (*visaApi()->viFindNext)
+#define viFindRsrc (*visaApi()->viFindRsrc)
+#define viFlush (*visaApi()->viFlush)
+#define viGetAttribute (*visaApi()->viGetAttribute)
+#define viGpibCommand (*visaApi()->viGpibCommand)
+#define viGpibControlATN (*visaApi()->viGpibControlATN)
+#define viGpibControlREN (*visaApi()->viGpibControlREN)
+#define viGpibPassControl (*visaApi()->viGpibPassControl)
+#define viGpibSendIFC (*visaApi()->viGpibSendIFC)
+#define viInstallHandler (*visaApi()->viInstallHandler)
+#define viLock (*visaApi()->viLock)
+#define viOpen (*visaApi()->viOpen)
+#define viOpenDefaultRM (*visaApi()->viOpenDefaultRM)
+#define viParseRsrc (*visaApi()->viParseRsrc)
+#define viParseRsrcEx (*visaApi()->viParseRsrcEx)
+#define viRead (*visaApi()->viRead)
+#define viReadSTB (*visaApi()->viReadSTB)
+#define viReadToFile (*visaApi()->viReadToFile)
+#define viSetAttribute (*visaApi()->viSetAttribute)
+#define viTerminate (*visaApi()->viTerminate)
+#define viUninstallHandler (*visaApi()->viUninstallHandler)
+#define viUnlock (*visaApi()->viUnlock)
+#define viWaitOnEvent (*visaApi()->viWaitOnEvent)
+#define viWrite (*visaApi()->viWrite)
+#define viWriteFromFile (*visaApi()->viWriteFromFile)
+
+#endif /* VISA_API_IMPLEMENTATION */
+
+#endif /* VISA_API_H_34237856365464 */
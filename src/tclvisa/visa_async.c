@@ -0,0 +1,345 @@
+/*
+ * visa_async.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+/*
+ * Write-then-read operations for visa::query and visa::read-async.
+ * Called inside a coroutine, command yields and the operation runs in a
+ * worker thread. When it is done, an event is queued to the owner thread
+ * and event loop resumes the coroutine, which returns the result.
+ * Channel is kept registered while the operation is in progress, so that
+ * closing it from script does not close VISA session under worker's feet.
+ */
+
+#include <tcl.h>
+#include <visa.h>
+#include <string.h>
+#include "visa_async.h"
+#include "visa_utils.h"
+#include "visa_transfer.h"
+#include "tcl_utils.h"
+#include "tclvisa_utils.h"
+
+/* Writes data if any, then reads count bytes or complete message if count is negative */
+static ViStatus transfer(ViSession vi, const unsigned char* out, Tcl_Size outLen, Tcl_WideInt count, unsigned char** bufPtr, Tcl_Size* lenPtr) {
+	ViStatus status = VI_SUCCESS;
+	Tcl_WideUInt retCount;
+	Tcl_Size size = 0, len = 0;
+	unsigned char* buf = NULL;
+
+	if (out && outLen > 0) {
+		status = writeVisa(vi, out, (Tcl_WideUInt) outLen, &retCount);
+		if (status < 0) {
+			*bufPtr = NULL;
+			*lenPtr = 0;
+			return status;
+		}
+	}
+
+	do {
+		Tcl_Size chunk;
+
+		if (count >= 0) {
+			size = (Tcl_Size) count;
+			buf = (unsigned char*) ckalloc(size ? size : 1);
+		} else if (size - len < VISA_ASYNC_READ_CHUNK) {
+			if (len > TCL_SIZE_MAX - VISA_ASYNC_READ_CHUNK) {
+				/* Rest of message does not fit into Tcl value */
+				break;
+			}
+
+			/* Buffer grows twice, so long message is not copied over and over */
+			size = size > TCL_SIZE_MAX / 2 ? TCL_SIZE_MAX : 2 * size;
+			if (size < len + VISA_ASYNC_READ_CHUNK) {
+				size = len + VISA_ASYNC_READ_CHUNK;
+			}
+			buf = (unsigned char*) ckrealloc((char*) buf, size);
+		}
+		chunk = size - len;
+
+		retCount = 0;
+		status = readVisa(vi, buf + len, (Tcl_WideUInt) chunk, &retCount);
+		len += (Tcl_Size) retCount;
+	} while (count < 0 && VI_SUCCESS_MAX_CNT == status);
+
+	*bufPtr = buf;
+	*lenPtr = len;
+	return status;
+}
+
+/* Puts data read or error message into interpreter's result */
+static int setResult(Tcl_Interp* const interp, ViStatus status, unsigned char* buf, Tcl_Size len) {
+	int result = TCL_OK;
+
+	if (status < 0) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, visaErrorMessage(status), NULL);
+		result = TCL_ERROR;
+	} else {
+		Tcl_SetObjResult(interp, Tcl_NewByteArrayObj(buf, len));
+	}
+
+	if (buf) {
+		ckfree((char*) buf);
+	}
+	return result;
+}
+
+int getVisaIOCount(Tcl_Interp* const interp, Tcl_Obj* objPtr, Tcl_WideInt* countPtr) {
+	Tcl_WideInt count;
+
+	if (Tcl_GetWideIntFromObj(interp, objPtr, &count)) {
+		return TCL_ERROR;
+	}
+	if (count <= 0) {
+		Tcl_AppendResult(interp, "count must be positive", NULL);
+		return TCL_ERROR;
+	}
+	if (count > (Tcl_WideInt) TCL_SIZE_MAX) {
+		Tcl_AppendResult(interp, "count exceeds maximum size of Tcl value", NULL);
+		return TCL_ERROR;
+	}
+
+	*countPtr = count;
+	return TCL_OK;
+}
+
+int runVisaIO(Tcl_Interp* const interp, VisaChannelData* session, Tcl_Obj* data, Tcl_WideInt count) {
+	const unsigned char* out = NULL;
+	unsigned char* buf;
+	Tcl_Size outLen = 0, len;
+	ViStatus status;
+
+	if (TCL_OK != checkVisaChannelBusy(interp, session, 1)) {
+		return TCL_ERROR;
+	}
+
+	if (data) {
+		out = Tcl_GetBytesFromObj(interp, data, &outLen);
+		if (NULL == out) {
+			return TCL_ERROR;
+		}
+	}
+
+	status = transfer(session->session, out, outLen, count, &buf, &len);
+	storeLastError(session, status, NULL);
+	return setResult(interp, status, buf, len);
+}
+
+int isVisaAsyncAvailable(void) {
+#ifdef TCLVISA_NRE
+	int major, minor;
+
+	/* Library built with Tcl 8.6 headers may still be loaded into older Tcl */
+	Tcl_GetVersion(&major, &minor, NULL, NULL);
+	return major > 8 || (major == 8 && minor >= 6);
+#else
+	return 0;
+#endif
+}
+
+#ifdef TCLVISA_NRE
+
+typedef struct _VisaAsyncJob {
+	Tcl_Interp* interp;
+	Tcl_ThreadId ownerId;
+	Tcl_Channel channel;
+	VisaChannelData* session;
+	Tcl_Obj* coroutine;	/* fully qualified name of waiting coroutine */
+	ViSession vi;
+	unsigned char* out;	/* data to write, may be NULL */
+	Tcl_Size outLen;
+	Tcl_WideInt count;
+
+	/* Result, filled by worker thread */
+	ViStatus status;
+	unsigned char* buf;
+	Tcl_Size len;
+
+	int done;	/* result is delivered to owner thread */
+	int waiting;	/* coroutine waits for result */
+} VisaAsyncJob;
+
+typedef struct _VisaAsyncEvent {
+	Tcl_Event header;
+	VisaAsyncJob* job;
+} VisaAsyncEvent;
+
+static int resumeProc(ClientData data[], Tcl_Interp* interp, int result);
+
+static void freeJob(VisaAsyncJob* job) {
+	Tcl_DecrRefCount(job->coroutine);
+	if (job->out) {
+		ckfree((char*) job->out);
+	}
+	if (job->buf) {
+		ckfree((char*) job->buf);
+	}
+	Tcl_Release((ClientData) job->interp);
+	ckfree((char*) job);
+}
+
+/* Called in owner thread by Tcl event loop */
+static int eventProc(Tcl_Event* evPtr, int flags) {
+	VisaAsyncJob* job = ((VisaAsyncEvent*) evPtr)->job;
+	Tcl_Interp* interp = job->interp;
+	Tcl_Obj* coroutine = job->coroutine;
+
+	if (!(flags & TCL_FILE_EVENTS)) {
+		return 0;
+	}
+
+	/* Session may be used again, channel may be closed now */
+	job->session->asyncPending = 0;
+	storeLastError(job->session, job->status, NULL);
+	Tcl_UnregisterChannel(NULL, job->channel);
+	job->done = 1;
+
+	if (!job->waiting) {
+		/* Coroutine is gone */
+		freeJob(job);
+		return 1;
+	}
+
+	if (!Tcl_InterpDeleted(interp)) {
+		/* Job is freed by coroutine once it takes the result */
+		Tcl_Preserve((ClientData) interp);
+		Tcl_IncrRefCount(coroutine);
+		if (TCL_OK != Tcl_EvalObjv(interp, 1, &coroutine, TCL_EVAL_GLOBAL)) {
+			Tcl_AddErrorInfo(interp, "\n    (resuming coroutine after VISA operation)");
+			Tcl_BackgroundError(interp);
+		}
+		Tcl_DecrRefCount(coroutine);
+		Tcl_Release((ClientData) interp);
+	}
+
+	return 1;
+}
+
+static Tcl_ThreadCreateType workerProc(ClientData clientData) {
+	VisaAsyncJob* job = (VisaAsyncJob*) clientData;
+	VisaAsyncEvent* ev;
+
+	job->status = transfer(job->vi, job->out, job->outLen, job->count, &job->buf, &job->len);
+
+	ev = (VisaAsyncEvent*) ckalloc(sizeof(VisaAsyncEvent));
+	ev->header.proc = eventProc;
+	ev->job = job;
+	Tcl_ThreadQueueEvent(job->ownerId, (Tcl_Event*) ev, TCL_QUEUE_TAIL);
+	Tcl_ThreadAlert(job->ownerId);
+
+	TCL_THREAD_CREATE_RETURN;
+}
+
+/* Suspends coroutine until job is done */
+static int yieldJob(Tcl_Interp* interp, VisaAsyncJob* job) {
+	Tcl_NRAddCallback(interp, resumeProc, (ClientData) job, NULL, NULL, NULL);
+	return Tcl_NREvalObj(interp, Tcl_NewStringObj("::yield", -1), 0);
+}
+
+static int resumeProc(ClientData data[], Tcl_Interp* interp, int result) {
+	VisaAsyncJob* job = (VisaAsyncJob*) data[0];
+
+	if (TCL_OK != result) {
+		/* Coroutine is deleted, job is freed when worker is done */
+		job->waiting = 0;
+		return result;
+	}
+
+	if (!job->done) {
+		/* Coroutine is resumed by somebody else, keep waiting */
+		return yieldJob(interp, job);
+	}
+
+	result = setResult(interp, job->status, job->buf, job->len);
+	job->buf = NULL;
+	freeJob(job);
+	return result;
+}
+
+/* Name of current coroutine with reference count incremented, NULL if there is none */
+static Tcl_Obj* currentCoroutine(Tcl_Interp* interp) {
+	Tcl_Obj* name;
+
+	if (TCL_OK != Tcl_EvalEx(interp, "::info coroutine", -1, 0)) {
+		Tcl_ResetResult(interp);
+		return NULL;
+	}
+
+	name = Tcl_GetObjResult(interp);
+	if (0 == Tcl_GetCharLength(name)) {
+		return NULL;
+	}
+
+	Tcl_IncrRefCount(name);
+	Tcl_ResetResult(interp);
+	return name;
+}
+
+int runVisaAsyncIO(Tcl_Interp* const interp, VisaChannelData* session, Tcl_Obj* data, Tcl_WideInt count) {
+	VisaAsyncJob* job;
+	Tcl_ThreadId threadId;
+	Tcl_Obj* coroutine;
+	const unsigned char* bytes = NULL;
+	Tcl_Size outLen = 0;
+
+	if (TCL_OK != checkVisaChannelBusy(interp, session, 1)) {
+		return TCL_ERROR;
+	}
+
+	if (data) {
+		bytes = Tcl_GetBytesFromObj(interp, data, &outLen);
+		if (NULL == bytes) {
+			return TCL_ERROR;
+		}
+	}
+
+	coroutine = currentCoroutine(interp);
+	if (NULL == coroutine) {
+		/* Nothing to suspend */
+		return runVisaIO(interp, session, data, count);
+	}
+
+	job = (VisaAsyncJob*) ckalloc(sizeof(VisaAsyncJob));
+	memset((void*) job, 0, sizeof(*job));
+	job->interp = interp;
+	job->ownerId = Tcl_GetCurrentThread();
+	job->channel = session->channel;
+	job->session = session;
+	job->coroutine = coroutine;
+	job->vi = session->session;
+	job->count = count;
+	job->waiting = 1;
+	if (bytes) {
+		/* Worker thread must not touch Tcl objects */
+		job->outLen = outLen;
+		job->out = (unsigned char*) ckalloc(outLen ? outLen : 1);
+		memcpy(job->out, bytes, (size_t) outLen);
+	}
+	Tcl_Preserve((ClientData) interp);
+
+	/* Keep channel open until worker is done */
+	Tcl_RegisterChannel(NULL, session->channel);
+	session->asyncPending = 1;
+
+	if (TCL_OK != Tcl_CreateThread(&threadId, workerProc, (ClientData) job, TCL_THREAD_STACK_DEFAULT, TCL_THREAD_NOFLAGS)) {
+		session->asyncPending = 0;
+		Tcl_UnregisterChannel(NULL, session->channel);
+		job->waiting = 0;
+		freeJob(job);
+		return runVisaIO(interp, session, data, count);
+	}
+
+	return yieldJob(interp, job);
+}
+
+#endif /* TCLVISA_NRE */
@@ -0,0 +1,36 @@
+/*
+ * visa_async.h --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+#ifndef VISA_ASYNC_H_34237856365464
+#define VISA_ASYNC_H_34237856365464
+
+#include <tcl.h>
+#include "visa_channel.h"
+
+/* Non-recursive engine and coroutines appeared in Tcl 8.6 */
+#if TCL_MAJOR_VERSION > 8 || (TCL_MAJOR_VERSION == 8 && TCL_MINOR_VERSION >= 6)
+#define TCLVISA_NRE
+#endif
+
+/* Chunk size used to read complete message */
+#define VISA_ASYNC_READ_CHUNK 4096
+
+int isVisaAsyncAvailable(void);
+int getVisaIOCount(Tcl_Interp* const interp, Tcl_Obj* objPtr, Tcl_WideInt* countPtr);
+int runVisaIO(Tcl_Interp* const interp, VisaChannelData* session, Tcl_Obj* data, Tcl_WideInt count);
+
+#ifdef TCLVISA_NRE
+int runVisaAsyncIO(Tcl_Interp* const interp, VisaChannelData* session, Tcl_Obj* data, Tcl_WideInt count);
+#endif
+
+#endif /* VISA_ASYNC_H_34237856365464 */
@@ -0,0 +1,250 @@
+/*
+ * visa_capture.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+/*
+ * Compressed capture: a reader thread calls viRead() back to back into a
+ * small queue of chunks, Tcl thread compresses every chunk with zlib
+ * stream and writes it to file. So compression of one chunk overlaps with
+ * transfer of the next one. Zlib stream and file channel are Tcl objects
+ * and never leave the thread which created them, reader thread uses VISA
+ * calls only.
+ */
+
+#include <tcl.h>
+#include <visa.h>
+#include <string.h>
+#include "visa_api.h"
+#include "visa_capture.h"
+#include "tcl_utils.h"
+
+int isVisaCaptureAvailable(void) {
+#ifdef TCLVISA_ZLIB
+	int major, minor;
+
+	/* Library built with Tcl 8.6 headers may still be loaded into older Tcl */
+	Tcl_GetVersion(&major, &minor, NULL, NULL);
+	return major > 8 || (major == 8 && minor >= 6);
+#else
+	return 0;
+#endif
+}
+
+#ifdef TCLVISA_ZLIB
+
+typedef struct _VisaCapture {
+	ViSession session;
+	Tcl_WideUInt count;
+	ViUInt32 chunk;
+	unsigned char* bufs[VISA_CAPTURE_BUFFERS];
+	ViUInt32 lens[VISA_CAPTURE_BUFFERS];
+
+	/* Guarded by mutex */
+	Tcl_Mutex mutex;
+	Tcl_Condition cond;
+	unsigned head;	/* chunks filled by reader */
+	unsigned tail;	/* chunks taken by compressor */
+	int stop;	/* compressor failed, reader must quit */
+	int finished;	/* reader has quit */
+	ViStatus status;
+	Tcl_WideUInt total;
+} VisaCapture;
+
+/* Reads chunk number head, returns nonzero when there is nothing more to read */
+static int readChunk(VisaCapture* c, unsigned head, Tcl_WideUInt* total, ViStatus* status) {
+	Tcl_WideUInt left = c->count - *total;
+	ViUInt32 retCount = 0;
+	int slot = head % VISA_CAPTURE_BUFFERS;
+
+	*status = viRead(c->session, c->bufs[slot], left < c->chunk ? (ViUInt32) left : c->chunk, &retCount);
+	c->lens[slot] = retCount;
+	*total += retCount;
+
+	/* Anything but full chunk means END, termination character or error */
+	return VI_SUCCESS_MAX_CNT != *status || *total == c->count;
+}
+
+static Tcl_ThreadCreateType readerProc(ClientData clientData) {
+	VisaCapture* c = (VisaCapture*) clientData;
+	Tcl_WideUInt total = 0;
+	ViStatus status = VI_SUCCESS;
+	unsigned head = 0;
+	int last;
+
+	do {
+		/* Wait for free chunk */
+		Tcl_MutexLock(&c->mutex);
+		while (!c->stop && c->head - c->tail == VISA_CAPTURE_BUFFERS) {
+			Tcl_ConditionWait(&c->cond, &c->mutex, NULL);
+		}
+		if (c->stop) {
+			Tcl_MutexUnlock(&c->mutex);
+			break;
+		}
+		Tcl_MutexUnlock(&c->mutex);
+
+		last = readChunk(c, head, &total, &status);
+
+		Tcl_MutexLock(&c->mutex);
+		c->head = ++head;
+		c->total = total;
+		Tcl_ConditionNotify(&c->cond);
+		Tcl_MutexUnlock(&c->mutex);
+	} while (!last);
+
+	Tcl_MutexLock(&c->mutex);
+	c->status = status;
+	c->finished = 1;
+	Tcl_ConditionNotify(&c->cond);
+	Tcl_MutexUnlock(&c->mutex);
+
+	TCL_THREAD_CREATE_RETURN;
+}
+
+/* Compresses data and writes output available so far */
+static int compress(Tcl_Interp* const interp, Tcl_ZlibStream zs, Tcl_Channel f, Tcl_Obj* in, Tcl_Obj* out, int flush) {
+	Tcl_Size len;
+
+	if (TCL_OK != Tcl_ZlibStreamPut(zs, in, flush)) {
+		Tcl_AppendResult(interp, "compression failed", NULL);
+		return TCL_ERROR;
+	}
+	if (TCL_OK != Tcl_ZlibStreamGet(zs, out, -1)) {
+		Tcl_AppendResult(interp, "compression failed", NULL);
+		return TCL_ERROR;
+	}
+	Tcl_GetBytesFromObj(NULL, out, &len);
+	if (len > 0 && Tcl_WriteObj(f, out) < 0) {
+		Tcl_AppendResult(interp, "error writing file: ", Tcl_ErrnoMsg(Tcl_GetErrno()), NULL);
+		return TCL_ERROR;
+	}
+	Tcl_SetByteArrayLength(out, 0);
+	return TCL_OK;
+}
+
+/* Without reader thread, chunks are read and compressed in turn */
+static int captureLoop(Tcl_Interp* const interp, VisaCapture* c, Tcl_ZlibStream zs, Tcl_Channel f, int noThread) {
+	Tcl_Obj* in = Tcl_NewByteArrayObj(NULL, 0);
+	Tcl_Obj* out = Tcl_NewByteArrayObj(NULL, 0);
+	int result = TCL_OK;
+
+	Tcl_IncrRefCount(in);
+	Tcl_IncrRefCount(out);
+
+	for (;;) {
+		unsigned tail;
+		int slot;
+
+		if (noThread && !c->finished) {
+			c->finished = readChunk(c, c->head, &c->total, &c->status);
+			++c->head;
+		}
+
+		Tcl_MutexLock(&c->mutex);
+		while (!c->finished && c->head == c->tail) {
+			Tcl_ConditionWait(&c->cond, &c->mutex, NULL);
+		}
+		if (c->head == c->tail) {
+			/* Reader has quit and everything is compressed */
+			Tcl_MutexUnlock(&c->mutex);
+			break;
+		}
+		tail = c->tail;
+		Tcl_MutexUnlock(&c->mutex);
+
+		slot = tail % VISA_CAPTURE_BUFFERS;
+		Tcl_SetByteArrayObj(in, c->bufs[slot], (Tcl_Size) c->lens[slot]);
+		result = compress(interp, zs, f, in, out, TCL_ZLIB_NO_FLUSH);
+
+		Tcl_MutexLock(&c->mutex);
+		c->tail = tail + 1;
+		if (TCL_OK != result) {
+			c->stop = 1;
+		}
+		Tcl_ConditionNotify(&c->cond);
+		Tcl_MutexUnlock(&c->mutex);
+
+		if (TCL_OK != result) {
+			break;
+		}
+	}
+
+	if (TCL_OK == result) {
+		Tcl_SetByteArrayLength(in, 0);
+		result = compress(interp, zs, f, in, out, TCL_ZLIB_FINALIZE);
+	}
+
+	Tcl_DecrRefCount(in);
+	Tcl_DecrRefCount(out);
+	return result;
+}
+
+int readVisaToCompressedFile(Tcl_Interp* const interp, ViSession vi, const char* fileName, Tcl_WideUInt count,
+	int format, int level, ViUInt32 chunk, ViStatus* status, Tcl_WideUInt* retCount) {
+
+	VisaCapture c;
+	Tcl_ZlibStream zs;
+	Tcl_Channel f;
+	Tcl_ThreadId threadId;
+	int result, i;
+
+	*status = VI_SUCCESS;
+	*retCount = 0;
+
+	f = Tcl_OpenFileChannel(interp, fileName, "w", 0666);
+	if (NULL == f) {
+		return TCL_ERROR;
+	}
+	if (TCL_OK != Tcl_SetChannelOption(interp, f, "-translation", "binary")
+		|| TCL_OK != Tcl_ZlibStreamInit(NULL, TCL_ZLIB_STREAM_DEFLATE, format, level, NULL, &zs)) {
+
+		Tcl_Close(NULL, f);
+		return TCL_ERROR;
+	}
+
+	memset((void*) &c, 0, sizeof(c));
+	c.session = vi;
+	c.count = count;
+	c.chunk = chunk;
+	for (i = 0; i < VISA_CAPTURE_BUFFERS; ++i) {
+		c.bufs[i] = (unsigned char*) ckalloc(chunk);
+	}
+
+	if (0 == count) {
+		/* Nothing to read, file gets empty stream */
+		c.finished = 1;
+		result = captureLoop(interp, &c, zs, f, 1);
+	} else if (TCL_OK != Tcl_CreateThread(&threadId, readerProc, (ClientData) &c, TCL_THREAD_STACK_DEFAULT, TCL_THREAD_JOINABLE)) {
+		/* Tcl core without threads, no overlap but still a complete file */
+		result = captureLoop(interp, &c, zs, f, 1);
+	} else {
+		result = captureLoop(interp, &c, zs, f, 0);
+		Tcl_JoinThread(threadId, NULL);
+	}
+
+	Tcl_ZlibStreamClose(zs);
+	if (TCL_OK != Tcl_Close(TCL_OK == result ? interp : NULL, f)) {
+		result = TCL_ERROR;
+	}
+
+	for (i = 0; i < VISA_CAPTURE_BUFFERS; ++i) {
+		ckfree((char*) c.bufs[i]);
+	}
+	Tcl_ConditionFinalize(&c.cond);
+	Tcl_MutexFinalize(&c.mutex);
+
+	*status = c.status;
+	*retCount = c.total;
+	return result;
+}
+
+#endif /* TCLVISA_ZLIB */
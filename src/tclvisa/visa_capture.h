@@ -0,0 +1,43 @@
+/*
+ * visa_capture.h --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+#ifndef VISA_CAPTURE_H_34237856365464
+#define VISA_CAPTURE_H_34237856365464
+
+#include <tcl.h>
+#include <visa.h>
+
+/* Zlib streams appeared in Tcl 8.6 */
+#if TCL_MAJOR_VERSION > 8 || (TCL_MAJOR_VERSION == 8 && TCL_MINOR_VERSION >= 6)
+#define TCLVISA_ZLIB
+#endif
+
+#define VISA_CAPTURE_DEFAULT_CHUNK (1024 * 1024)
+
+/* Number of chunks reader thread may get ahead of compressor */
+#define VISA_CAPTURE_BUFFERS 4
+
+int isVisaCaptureAvailable(void);
+
+#ifdef TCLVISA_ZLIB
+/*
+ * Reads up to count bytes like viReadToFile does and stores them compressed.
+ * Format is one of TCL_ZLIB_FORMAT_* constants. Returns TCL_ERROR with
+ * message in interp if file cannot be written, VISA status is returned
+ * in status otherwise.
+ */
+int readVisaToCompressedFile(Tcl_Interp* const interp, ViSession vi, const char* fileName, Tcl_WideUInt count,
+	int format, int level, ViUInt32 chunk, ViStatus* status, Tcl_WideUInt* retCount);
+#endif
+
+#endif /* VISA_CAPTURE_H_34237856365464 */
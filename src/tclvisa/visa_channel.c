@@ -18,6 +18,12 @@
 #include <string.h>
 #include "visa_utils.h"
 #include "visa_channel.h"
+#include "visa_events.h"
+#include "visa_stream.h"
+#include "visa_error_queue.h"
+#include "visa_reconnect.h"
+#include "visa_native.h"
+#include "visa_close.h"
 #include "tcl_utils.h"
 #include "tclvisa_utils.h"
 
@@ -27,8 +33,8 @@
 #endif
 
 #define TCLVISA_NAME_PREFIX "visa_session"
-#define TCLVISA_GET_OPTIONS "handshake mode queue timeout ttystatus xchar"
-#define TCLVISA_SET_OPTIONS "handshake mode timeout ttycontrol xchar"
+#define TCLVISA_GET_OPTIONS "errorcheck errorquery handshake message mode queue reconnects sendend termchar termcharen timeout ttystatus xchar"
+#define TCLVISA_SET_OPTIONS "errorcheck errorquery handshake message mode sendend termchar termcharen timeout ttycontrol xchar"
 #define TCLVISA_OPTION_MODE "-mode"
 #define TCLVISA_OPTION_TIMEOUT "-timeout"
 #define TCLVISA_OPTION_FLOW "-handshake"
@@ -36,8 +42,13 @@
 #define TCLVISA_OPTION_TTY_STATUS "-ttystatus"
 #define TCLVISA_OPTION_TTY_CONTROL "-ttycontrol"
 #define TCLVISA_OPTION_QUEUE "-queue"
-
-#define VISA_MAX_BUF_SIZE	((unsigned int) 0xFFFFFFFF)
+#define TCLVISA_OPTION_MESSAGE "-message"
+#define TCLVISA_OPTION_TERMCHAR "-termchar"
+#define TCLVISA_OPTION_TERMCHAR_EN "-termcharen"
+#define TCLVISA_OPTION_SEND_END "-sendend"
+#define TCLVISA_OPTION_ERROR_CHECK "-errorcheck"
+#define TCLVISA_OPTION_ERROR_QUERY "-errorquery"
+#define TCLVISA_OPTION_RECONNECTS "-reconnects"
 
 typedef struct TtyAttrs {
 	int baud;
@@ -48,6 +59,7 @@ typedef struct TtyAttrs {
 
 /* forward declaration of channel internal handlers */
 static int closeProc(ClientData instanceData, Tcl_Interp *interp);
+static int close2Proc(ClientData instanceData, Tcl_Interp *interp, int flags);
 static int blockModeProc(ClientData instanceData, int mode);
 static int inputProc(ClientData instanceData, char *buf, int bufSize, int *errorCodePtr);
 static int outputProc(ClientData instanceData, const char *buf, int toWrite, int *errorCodePtr);
@@ -55,6 +67,9 @@ static int setOptionProc(ClientData instanceData, Tcl_Interp *interp, const char
 static int getOptionProc(ClientData instanceData, Tcl_Interp *interp, const char *optionName, Tcl_DString *dsPtr);
 static void	watchProc(ClientData instanceData, int mask);
 static int getHandleProc(ClientData instanceData, int direction, ClientData *handlePtr);
+#ifdef TCLVISA_NATIVE
+static void watchNativeSession(VisaChannelData* data, int fd, int mask);
+#endif
 
 static int TtyParseMode(Tcl_Interp *interp,	const char *mode, int *speedPtr, int *parityPtr, int *dataPtr, int *stopPtr);
 static int toVisaParity(int p);
@@ -65,12 +80,18 @@ static int toVisaFlow(Tcl_Interp *interp, const char* value);
 static const char* fromVisaFlow(ViUInt16 flow);
 static void fromVisaModemStatus(VisaChannelData* data, Tcl_DString *dsPtr);
 static ViUInt16 toVisaModemStatus(int v);
+static int setBooleanAttribute(Tcl_Interp *interp, VisaChannelData* data, ViAttr attr, const char* value);
+static int getBooleanAttribute(Tcl_Interp *interp, VisaChannelData* data, ViAttr attr, Tcl_DString *dsPtr);
 
-/* VISA channel definition structure */
+/*
+ * VISA channel definition structure.
+ * Tcl 9 accepts version 5 channels only and calls close2Proc, Tcl 8.5
+ * and 8.6 do the same when closeProc is TCL_CLOSE2PROC.
+ */
 static Tcl_ChannelType visaChannelType = {
 	"visa_session",	/* typeName */
-	TCL_CHANNEL_VERSION_4,	/* version */
-	&closeProc,	/* closeProc */
+	TCL_CHANNEL_VERSION_5,	/* version */
+	TCL_CLOSE2PROC,	/* closeProc */
 	&inputProc,	/* inputProc */
     &outputProc,	/* outputProc */
     NULL,	/* seekProc */
@@ -78,12 +99,13 @@ static Tcl_ChannelType visaChannelType = {
     &getOptionProc,	/* getOptionProc */
     &watchProc,	/* watchProc */
     &getHandleProc,	/* getHandleProc */
-    NULL,	/* close2Proc */
+    &close2Proc,	/* close2Proc */
     &blockModeProc,	/* blockModeProc */
     NULL,	/* flushProc */
     NULL,	/* handlerProc */
     NULL,	/* wideSeekProc */
-    NULL	/* threadActionProc */
+    NULL,	/* threadActionProc */
+    NULL	/* truncateProc */
 };
 
 VisaChannelData* createVisaChannel(Tcl_Interp* const interp, ViSession session) {
@@ -123,7 +145,7 @@ VisaChannelData* createVisaChannel(Tcl_Interp* const interp, ViSession session)
 VisaChannelData* getVisaChannelFromObj(Tcl_Interp* const interp, Tcl_Obj* objPtr) {
 	VisaChannelData* data = NULL;
 	Tcl_Channel channel = NULL;
-	Tcl_ChannelType* type;
+	const Tcl_ChannelType* type;
 	int mode;
 
 	/* Retrieve channel from object passed  */
@@ -144,6 +166,44 @@ VisaChannelData* getVisaChannelFromObj(Tcl_Interp* const interp, Tcl_Obj* objPtr
 	return data;
 }
 
+int getVisaChannelsOfRM(Tcl_Interp* const interp, ViSession rm, VisaChannelData*** listPtr) {
+	Tcl_Obj* names;
+	Tcl_Obj** elems;
+	VisaChannelData** list;
+	int count, i, found = 0;
+
+	/* Channel names are returned as interpreter result */
+	if (TCL_OK != Tcl_GetChannelNamesEx(interp, TCLVISA_NAME_PREFIX "*")) {
+		return -1;
+	}
+	names = Tcl_GetObjResult(interp);
+	Tcl_IncrRefCount(names);
+	Tcl_ResetResult(interp);
+
+	if (TCL_OK != Tcl_ListObjGetElements(interp, names, &count, &elems)) {
+		Tcl_DecrRefCount(names);
+		return -1;
+	}
+
+	list = (VisaChannelData**) ckalloc(sizeof(VisaChannelData*) * (count + 1));
+	for (i = 0; i < count; ++i) {
+		Tcl_Channel channel = Tcl_GetChannel(interp, TclGetString(elems[i]), NULL);
+
+		if (NULL != channel && Tcl_GetChannelType(channel) == &visaChannelType) {
+			VisaChannelData* data = (VisaChannelData*) Tcl_GetChannelInstanceData(channel);
+
+			if (!data->isRMSession && data->rm == rm) {
+				list[found++] = data;
+			}
+		}
+	}
+	Tcl_ResetResult(interp);
+	Tcl_DecrRefCount(names);
+
+	*listPtr = list;
+	return found;
+}
+
 static VisaChannelData* validateData(ClientData instanceData, Tcl_Interp *interp) {
 	VisaChannelData* data = (VisaChannelData*) instanceData;
 	if (!data) {
@@ -162,10 +222,37 @@ static int closeProc(ClientData instanceData, Tcl_Interp *interp) {
 		return TCL_ERROR;
 	}
 
-	if (!data->isRMSession) {
-		viFlush(data->session, VI_WRITE_BUF | VI_IO_OUT_BUF);
+	/* No more callbacks or background reads after session is gone */
+	removeVisaEventHandlers(data);
+	if (data->stream) {
+		stopVisaStream(NULL, data);
+	}
+
+#ifdef TCLVISA_NATIVE
+	if (getVisaNativeHandle(data->session) >= 0) {
+		watchNativeSession(data, getVisaNativeHandle(data->session), 0);
+	}
+#endif
+
+	if (isVisaSessionLost(data)) {
+		/* Session is already closed by failed reconnect */
+		status = VI_SUCCESS;
+	} else if (data->isRMSession) {
+		/* Sessions being closed in background may belong to this one */
+		waitVisaSessionsClosed();
+		status = viClose(data->session);
+	} else if (data->closeBatch) {
+		/* visa::close-all closes session along with others */
+		data->closeBatch->sessions[data->closeBatch->count++] = data->session;
+		status = VI_SUCCESS;
+	} else if (!data->blocking) {
+		/* Do not wait for the instrument, flush with normal timeout in background */
+		viSetAttribute(data->session, VI_ATTR_TMO_VALUE, data->timeout);
+		closeVisaSessionLater(data->session);
+		status = VI_SUCCESS;
+	} else {
+		status = closeVisaSession(data->session);
 	}
-	status = viClose(data->session);
 	if (status < 0) {
 		if (interp) {
 			Tcl_AppendResult(interp, visaErrorMessage(status), NULL);
@@ -174,12 +261,25 @@ static int closeProc(ClientData instanceData, Tcl_Interp *interp) {
 		if (data->lastErrorMsg) {
 			free((void*) data->lastErrorMsg);
 		}
+		if (data->errorQuery) {
+			free((void*) data->errorQuery);
+		}
+		freeVisaReconnect(data);
 		free(data);
 	}
 
 	return status;
 }
 
+static int close2Proc(ClientData instanceData, Tcl_Interp *interp, int flags) {
+	if (flags & (TCL_CLOSE_READ | TCL_CLOSE_WRITE)) {
+		/* Half-close makes no sense for VISA session */
+		return EINVAL;
+	}
+
+	return closeProc(instanceData, interp);
+}
+
 static int blockModeProc(ClientData instanceData, int mode) {
 	VisaChannelData* data = validateData(instanceData, NULL);
 
@@ -192,7 +292,10 @@ static int blockModeProc(ClientData instanceData, int mode) {
 		if (!data->blocking) {
 			/* Restore saved timeout */
 			data->blocking = 1;
-			return setVisaTimeout(NULL, data, data->timeout) ? 0 : -1;
+			if (TCL_OK != setVisaTimeout(NULL, data, data->timeout)) {
+				data->blocking = 0;
+				return -1;
+			}
 		}
 		break;
 
@@ -221,6 +324,40 @@ static int blockModeProc(ClientData instanceData, int mode) {
 	return TCL_OK;
 }
 
+/*
+ * Response cannot survive reconnection, so read is not repeated:
+ * connection error is reported and session is ready for the next command
+ */
+static ViStatus readSession(VisaChannelData* data, char *buf, ViUInt32 count, ViUInt32* retCount) {
+	ViStatus status;
+
+	if (isVisaSessionLost(data)) {
+		reconnectVisaSession(data);
+		return VI_ERROR_CONN_LOST;
+	}
+
+	status = viRead(data->session, (ViPBuf) buf, count, retCount);
+	if (VI_ERROR_CONN_LOST == status) {
+		reconnectVisaSession(data);
+	}
+
+	return status;
+}
+
+/* Write is repeated once on re-opened session */
+static ViStatus writeSession(VisaChannelData* data, const char *buf, ViUInt32 count, ViUInt32* retCount) {
+	ViStatus status = VI_ERROR_CONN_LOST;
+
+	if (!isVisaSessionLost(data)) {
+		status = viWrite(data->session, (ViBuf) buf, count, retCount);
+	}
+	if (VI_ERROR_CONN_LOST == status && reconnectVisaSession(data)) {
+		status = viWrite(data->session, (ViBuf) buf, count, retCount);
+	}
+
+	return status;
+}
+
 static int inputProc(ClientData instanceData, char *buf, int bufSize, int *errorCodePtr) {
 	ViStatus status;
 	ViUInt32 retCount = 0;
@@ -231,23 +368,42 @@ static int inputProc(ClientData instanceData, char *buf, int bufSize, int *error
 		return -1;
 	}
 
-	if ((ViInt64) bufSize > (ViInt64) VISA_MAX_BUF_SIZE) {
-		/* restrict buffer size */
-		bufSize = VISA_MAX_BUF_SIZE;
+	if (TCL_OK != checkVisaChannelBusy(NULL, data, 1)) {
+		*errorCodePtr = EBUSY;
+		return -1;
+	}
+
+	if (data->messageEnd) {
+		/* Report message boundary as end of file, Tcl resets it on next read */
+		data->messageEnd = 0;
+		return 0;
 	}
 
-	status = viRead(data->session, (ViPBuf) buf, (ViUInt32) bufSize, &retCount);
+	status = readSession(data, buf, (ViUInt32) bufSize, &retCount);
 	storeLastError(data, status, NULL);
 	result = (int) retCount;
 
+	if (VI_SUCCESS == status || VI_SUCCESS_TERM_CHAR == status) {
+		/* END or termination character received: message is complete */
+		data->messageEnd = data->messageMode;
+		data->queryPending = 0;
+		if (data->errorCheck) {
+			checkVisaErrorQueue(data);
+		}
+	}
+
 	if (VI_ERROR_TMO == status) {
 		if (!data->blocking && 0 == result) {
 			*errorCodePtr = EAGAIN;
+		} else {
+			/* Response did not come in time, instrument may accept error query again */
+			data->queryPending = 0;
 		}
 	} else if (status < 0) {
 		if (errorCodePtr) {
 			*errorCodePtr = (int) status;
 		}
+		data->queryPending = 0;
 		result = -1;
 	}
 
@@ -264,15 +420,27 @@ static int outputProc(ClientData instanceData, const char *buf, int toWrite, int
 		return -1;
 	}
 
-	if ((ViInt64) toWrite > (ViInt64) VISA_MAX_BUF_SIZE) {
-		/* restrict buffer size */
-		toWrite = VISA_MAX_BUF_SIZE;
+	if (TCL_OK != checkVisaChannelBusy(NULL, data, 0)) {
+		*errorCodePtr = EBUSY;
+		return -1;
 	}
 
-	status = viWrite(data->session, (ViBuf) buf, (ViUInt32) toWrite, &retCount);
+	/* New command is sent, forget boundary of previous response */
+	data->messageEnd = 0;
+
+	status = writeSession(data, buf, (ViUInt32) toWrite, &retCount);
 	storeLastError(data, status, NULL);
 	result = (int) retCount;
 
+	if (status >= 0 && data->errorCheck) {
+		/* Error query sent before response is read would interrupt the query */
+		if (isVisaQuery(buf, (size_t) retCount)) {
+			data->queryPending = 1;
+		} else if (!data->queryPending) {
+			checkVisaErrorQueue(data);
+		}
+	}
+
 	if (VI_ERROR_TMO == status && !data->blocking) {
 		if (0 == result) {
 			*errorCodePtr = EAGAIN;
@@ -288,7 +456,7 @@ static int outputProc(ClientData instanceData, const char *buf, int toWrite, int
 }
 
 static int setOptionProc(ClientData instanceData, Tcl_Interp *interp, const char *optionName, const char *newValue) {
-    size_t len, vlen;
+    size_t len;
 	ViStatus status;
 	int argc;
 	const char** argv;
@@ -299,7 +467,6 @@ static int setOptionProc(ClientData instanceData, Tcl_Interp *interp, const char
 	}
 
 	len = strlen(optionName);
-	vlen = strlen(newValue);
 
     /*
      * Option -mode baud,parity,databits,stopbits
@@ -331,13 +498,96 @@ static int setOptionProc(ClientData instanceData, Tcl_Interp *interp, const char
 		return setVisaTimeout(interp, data, (ViUInt32) msec);
 	}
 
+    /*
+     * Option -message boolean
+     */
+	if (len > 2 && strncmp(optionName, TCLVISA_OPTION_MESSAGE, len) == 0) {
+		int flag;
+
+		if (TCL_OK != Tcl_GetBoolean(interp, newValue, &flag)) {
+			return TCL_ERROR;
+		}
+
+		data->messageMode = (short) flag;
+		data->messageEnd = 0;
+		return TCL_OK;
+	}
+
+    /*
+     * Option -errorcheck boolean
+     */
+	if (len > 6 && strncmp(optionName, TCLVISA_OPTION_ERROR_CHECK, len) == 0) {
+		int flag;
+
+		if (TCL_OK != Tcl_GetBoolean(interp, newValue, &flag)) {
+			return TCL_ERROR;
+		}
+
+		data->errorCheck = (short) flag;
+		data->queryPending = 0;
+		return TCL_OK;
+	}
+
+    /*
+     * Option -errorquery string
+     * Message terminator is appended when missing.
+     */
+	if (len > 6 && strncmp(optionName, TCLVISA_OPTION_ERROR_QUERY, len) == 0) {
+		Tcl_DString ds;
+
+		Tcl_DStringInit(&ds);
+		Tcl_UtfToExternalDString(NULL, newValue, -1, &ds);
+		if (Tcl_DStringLength(&ds) == 0 || Tcl_DStringValue(&ds)[Tcl_DStringLength(&ds) - 1] != '\n') {
+			Tcl_DStringAppend(&ds, "\n", 1);
+		}
+		setVisaErrorQuery(data, Tcl_DStringValue(&ds));
+		Tcl_DStringFree(&ds);
+		return TCL_OK;
+	}
+
+    /*
+     * Option -termcharen boolean
+     * Checked before -termchar which is a prefix of it.
+     */
+	if (len > strlen(TCLVISA_OPTION_TERMCHAR) && strncmp(optionName, TCLVISA_OPTION_TERMCHAR_EN, len) == 0) {
+		return setBooleanAttribute(interp, data, VI_ATTR_TERMCHAR_EN, newValue);
+	}
+
+    /*
+     * Option -termchar char
+     * Either a single character or its integer code is accepted.
+     */
+	if (len > 2 && strncmp(optionName, TCLVISA_OPTION_TERMCHAR, len) == 0) {
+		int code;
+
+		if (1 == Tcl_NumUtfChars(newValue, -1)) {
+			Tcl_DString ds;
+			Tcl_DStringInit(&ds);
+			Tcl_UtfToExternalDString(NULL, newValue, -1, &ds);
+			code = (unsigned char) *Tcl_DStringValue(&ds);
+			Tcl_DStringFree(&ds);
+		} else if (TCL_OK != Tcl_GetInt(interp, newValue, &code)) {
+			return TCL_ERROR;
+		}
+
+		status = setVisaAttribute(data, VI_ATTR_TERMCHAR, (ViAttrState) (ViUInt8) code);
+		goto visa_result;
+	}
+
+    /*
+     * Option -sendend boolean
+     */
+	if (len > 1 && strncmp(optionName, TCLVISA_OPTION_SEND_END, len) == 0) {
+		return setBooleanAttribute(interp, data, VI_ATTR_SEND_END_EN, newValue);
+	}
+
     /*
      * Option -handshake none|xonxoff|rtscts|dtrdsr
      */
 	if (len > 1 && strncmp(optionName, TCLVISA_OPTION_FLOW, len) == 0) {
 		int flow = toVisaFlow(interp, newValue);
 		if (flow >= 0) {
-			status = viSetAttribute(data->session, VI_ATTR_ASRL_FLOW_CNTRL, (ViAttrState) flow);
+			status = setVisaAttribute(data, VI_ATTR_ASRL_FLOW_CNTRL, (ViAttrState) flow);
 			goto visa_result;
 		}
 		return TCL_ERROR;
@@ -356,12 +606,12 @@ static int setOptionProc(ClientData instanceData, Tcl_Interp *interp, const char
 			Tcl_DStringInit(&ds);
 
 			Tcl_UtfToExternalDString(NULL, argv[0], -1, &ds);
-			status = viSetAttribute(data->session, VI_ATTR_ASRL_XON_CHAR, (ViAttrState) *Tcl_DStringValue(&ds));
+			status = setVisaAttribute(data, VI_ATTR_ASRL_XON_CHAR, (ViAttrState) *Tcl_DStringValue(&ds));
 			Tcl_DStringSetLength(&ds, 0);
 
 			if (status >= 0) {
 				Tcl_UtfToExternalDString(NULL, argv[1], -1, &ds);
-				status = viSetAttribute(data->session, VI_ATTR_ASRL_XOFF_CHAR, (ViAttrState) *Tcl_DStringValue(&ds));
+				status = setVisaAttribute(data, VI_ATTR_ASRL_XOFF_CHAR, (ViAttrState) *Tcl_DStringValue(&ds));
 			}
 
 			Tcl_DStringFree(&ds);
@@ -402,14 +652,14 @@ static int setOptionProc(ClientData instanceData, Tcl_Interp *interp, const char
 			}
 
 			if (_strcmpi(argv[i], "DTR") == 0) {
-				if ((status = viSetAttribute(data->session, VI_ATTR_ASRL_DTR_STATE, toVisaModemStatus(flag))) < 0) {
+				if ((status = setVisaAttribute(data, VI_ATTR_ASRL_DTR_STATE, toVisaModemStatus(flag))) < 0) {
 					ckfree((char *) argv);
 					goto visa_result;
 				}
 			}
 
 			else if (_strcmpi(argv[i], "RTS") == 0) {
-				if ((status = viSetAttribute(data->session, VI_ATTR_ASRL_RTS_STATE, toVisaModemStatus(flag))) < 0) {
+				if ((status = setVisaAttribute(data, VI_ATTR_ASRL_RTS_STATE, toVisaModemStatus(flag))) < 0) {
 					ckfree((char *) argv);
 					goto visa_result;
 				}
@@ -417,7 +667,7 @@ static int setOptionProc(ClientData instanceData, Tcl_Interp *interp, const char
 
 #ifdef VI_ATTR_ASRL_BREAK_STATE
 			else if (_strcmpi(argv[i], "BREAK") == 0) {
-				if ((status = viSetAttribute(data->session, VI_ATTR_ASRL_BREAK_STATE, toVisaModemStatus(flag))) < 0) {
+				if ((status = setVisaAttribute(data, VI_ATTR_ASRL_BREAK_STATE, toVisaModemStatus(flag))) < 0) {
 					ckfree((char *) argv);
 					goto visa_result;
 				}
@@ -489,6 +739,82 @@ static int getOptionProc(ClientData instanceData, Tcl_Interp *interp, const char
 		return res;
     }
 
+    /*
+     * Option -message boolean
+     */
+	if (len > 2 && strncmp(optionName, TCLVISA_OPTION_MESSAGE, len) == 0) {
+		Tcl_DStringAppendElement(dsPtr, data->messageMode ? "1" : "0");
+		return TCL_OK;
+	}
+
+    /*
+     * Option -reconnects
+     * Number of times session was re-opened, see -reconnect option of visa::open
+     */
+	if (len > 2 && strncmp(optionName, TCLVISA_OPTION_RECONNECTS, len) == 0) {
+		char buf[TCL_INTEGER_SPACE];
+
+		sprintf(buf, "%d", getVisaReconnectCount(data));
+		Tcl_DStringAppendElement(dsPtr, buf);
+		return TCL_OK;
+	}
+
+    /*
+     * Option -errorcheck boolean
+     */
+	if (len > 6 && strncmp(optionName, TCLVISA_OPTION_ERROR_CHECK, len) == 0) {
+		Tcl_DStringAppendElement(dsPtr, data->errorCheck ? "1" : "0");
+		return TCL_OK;
+	}
+
+    /*
+     * Option -errorquery string
+     */
+	if (len > 6 && strncmp(optionName, TCLVISA_OPTION_ERROR_QUERY, len) == 0) {
+		Tcl_DString ds;
+		const char* query = data->errorQuery ? data->errorQuery : VISA_DEFAULT_ERROR_QUERY;
+
+		Tcl_DStringInit(&ds);
+		Tcl_ExternalToUtfDString(NULL, query, (int) strlen(query) - 1, &ds);
+		Tcl_DStringAppendElement(dsPtr, Tcl_DStringValue(&ds));
+		Tcl_DStringFree(&ds);
+		return TCL_OK;
+	}
+
+    /*
+     * Option -termcharen boolean
+     */
+	if (len > strlen(TCLVISA_OPTION_TERMCHAR) && strncmp(optionName, TCLVISA_OPTION_TERMCHAR_EN, len) == 0) {
+		return getBooleanAttribute(interp, data, VI_ATTR_TERMCHAR_EN, dsPtr);
+	}
+
+    /*
+     * Option -termchar char
+     */
+	if (len > 2 && strncmp(optionName, TCLVISA_OPTION_TERMCHAR, len) == 0) {
+		Tcl_DString ds;
+		ViUInt8 termChar;
+		ViStatus status = viGetAttribute(data->session, VI_ATTR_TERMCHAR, &termChar);
+		storeLastError(data, status, interp);
+
+		if (status < 0) {
+			return TCL_ERROR;
+		}
+
+		Tcl_DStringInit(&ds);
+		Tcl_ExternalToUtfDString(NULL, (const char*) &termChar, 1, &ds);
+		Tcl_DStringAppendElement(dsPtr, Tcl_DStringValue(&ds));
+		Tcl_DStringFree(&ds);
+		return TCL_OK;
+	}
+
+    /*
+     * Option -sendend boolean
+     */
+	if (len > 1 && strncmp(optionName, TCLVISA_OPTION_SEND_END, len) == 0) {
+		return getBooleanAttribute(interp, data, VI_ATTR_SEND_END_EN, dsPtr);
+	}
+
     /*
      * Option -handshake none|xonxoff|rtscts|dtrdsr
      */
@@ -579,6 +905,40 @@ static int getOptionProc(ClientData instanceData, Tcl_Interp *interp, const char
     return Tcl_BadChannelOption(interp, optionName, TCLVISA_GET_OPTIONS);
 }
 
+#ifdef TCLVISA_NATIVE
+
+static void nativeFileProc(ClientData clientData, int mask) {
+	VisaChannelData* data = (VisaChannelData*) clientData;
+	Tcl_NotifyChannel(data->channel, mask);
+}
+
+/* Data kept in read buffer of native session does not make descriptor readable */
+static void nativePendingProc(ClientData clientData) {
+	VisaChannelData* data = (VisaChannelData*) clientData;
+
+	data->nativeTimer = NULL;
+	Tcl_NotifyChannel(data->channel, TCL_READABLE);
+}
+
+static void watchNativeSession(VisaChannelData* data, int fd, int mask) {
+	if (mask) {
+		Tcl_CreateFileHandler(fd, mask, &nativeFileProc, (ClientData) data);
+	} else {
+		Tcl_DeleteFileHandler(fd);
+	}
+
+	if ((mask & TCL_READABLE) && isVisaNativeInputPending(data->session)) {
+		if (NULL == data->nativeTimer) {
+			data->nativeTimer = Tcl_CreateTimerHandler(0, &nativePendingProc, (ClientData) data);
+		}
+	} else if (NULL != data->nativeTimer) {
+		Tcl_DeleteTimerHandler(data->nativeTimer);
+		data->nativeTimer = NULL;
+	}
+}
+
+#endif
+
 static void	watchProc(ClientData instanceData, int mask) {
 	VisaChannelData* data = (VisaChannelData*) instanceData;
 
@@ -586,21 +946,38 @@ static void	watchProc(ClientData instanceData, int mask) {
 		return;
 	}
 
+#ifdef TCLVISA_NATIVE
+	{
+		/* Native sessions are watched by Tcl notifier like sockets */
+		int fd = getVisaNativeHandle(data->session);
+		if (fd >= 0) {
+			watchNativeSession(data, fd, mask);
+		}
+	}
+#endif
+
 	/* avoid "unused parameter" warning */
 	UNREFERENCED_PARAMETER(mask);	
 }
 
 static int getHandleProc(ClientData instanceData, int direction, ClientData *handlePtr) {
 	VisaChannelData* data = (VisaChannelData*) instanceData;
+	int fd;
+
+	/* avoid "unused parameter" warning */
+	UNREFERENCED_PARAMETER(direction);	
 
 	if (!data || data->isRMSession) {
-		return -1;
+		return TCL_ERROR;
 	}
 
-	/* avoid "unused parameter" warning */
-	UNREFERENCED_PARAMETER(direction);	
-	UNREFERENCED_PARAMETER(handlePtr);	
+	/* Descriptor of native session serves both directions, VISA library does not expose its handles */
+	fd = getVisaNativeHandle(data->session);
+	if (fd < 0) {
+		return TCL_ERROR;
+	}
 
+	*handlePtr = (ClientData) (size_t) fd;
 	return TCL_OK;
 }
 
@@ -750,19 +1127,19 @@ error:
 static int setTtyAttributes(Tcl_Interp *interp, VisaChannelData* data, const TtyAttrs* tty) {
 	ViStatus status;
 
-	status = viSetAttribute(data->session, VI_ATTR_ASRL_BAUD, (ViAttrState) tty->baud);
+	status = setVisaAttribute(data, VI_ATTR_ASRL_BAUD, (ViAttrState) tty->baud);
 	if (status < 0) {
 		goto error;
 	}
-	status = viSetAttribute(data->session, VI_ATTR_ASRL_PARITY, (ViAttrState) toVisaParity(tty->parity));
+	status = setVisaAttribute(data, VI_ATTR_ASRL_PARITY, (ViAttrState) toVisaParity(tty->parity));
 	if (status < 0) {
 		goto error;
 	}
-	status = viSetAttribute(data->session, VI_ATTR_ASRL_DATA_BITS, (ViAttrState) tty->data);
+	status = setVisaAttribute(data, VI_ATTR_ASRL_DATA_BITS, (ViAttrState) tty->data);
 	if (status < 0) {
 		goto error;
 	}
-	status = viSetAttribute(data->session, VI_ATTR_ASRL_STOP_BITS, (ViAttrState) toVisaStopBits(tty->stop));
+	status = setVisaAttribute(data, VI_ATTR_ASRL_STOP_BITS, (ViAttrState) toVisaStopBits(tty->stop));
 	if (status < 0) {
 		goto error;
 	}
@@ -797,9 +1174,15 @@ int setVisaTimeout(Tcl_Interp *interp, VisaChannelData* data, ViUInt32 timeout)
 	if (!data->blocking) {
 		/* Save specified specified value for later use */
 		data->timeout = timeout;
+	} else if (data->stream && timeout == VI_TMO_INFINITE) {
+		/* Stream reader would never notice stop request, see visa_stream.c */
+		if (interp) {
+			Tcl_AppendResult(interp, "stream requires finite timeout on channel \"", Tcl_GetChannelName(data->channel), "\"", NULL);
+		}
+		return TCL_ERROR;
 	} else {
 		/* Attempt to set attribute */
-		ViStatus status = viSetAttribute(data->session, (ViAttr) VI_ATTR_TMO_VALUE, (ViAttrState) timeout);
+		ViStatus status = setVisaAttribute(data, (ViAttr) VI_ATTR_TMO_VALUE, (ViAttrState) timeout);
 		storeLastError(data, status, interp);
 		if (status < 0) {
 			return TCL_ERROR;
@@ -809,22 +1192,50 @@ int setVisaTimeout(Tcl_Interp *interp, VisaChannelData* data, ViUInt32 timeout)
 	return TCL_OK;
 }
 
-void storeLastError(VisaChannelData* session, const ViStatus status, Tcl_Interp* const interp) {
-	session->lastError = status;
+int checkVisaChannelBusy(Tcl_Interp* const interp, VisaChannelData* data, int input) {
+	if (data->asyncPending) {
+		/* Session is used by worker thread, see visa_async.c */
+		if (interp) {
+			Tcl_AppendResult(interp, "operation is already in progress on channel \"", Tcl_GetChannelName(data->channel), "\"", NULL);
+		}
+		return TCL_ERROR;
+	}
+
+	if (input && data->stream) {
+		/* Input is consumed by stream reader thread, see visa::stream */
+		if (interp) {
+			Tcl_AppendResult(interp, "stream is started on channel \"", Tcl_GetChannelName(data->channel), "\"", NULL);
+		}
+		return TCL_ERROR;
+	}
+
+	return TCL_OK;
+}
 
+void storeLastError(VisaChannelData* session, const ViStatus status, Tcl_Interp* const interp) {
 	if (status < 0) {
 		const char* msg = visaErrorMessage(status);
+
+		if (session->lastErrorMsg) {
+			free((void*) session->lastErrorMsg);
+		}
+		session->lastError = status;
 		session->lastErrorMsg = (char*) malloc(strlen(msg) + 1);
 		strcpy(session->lastErrorMsg, msg);
+		session->instrumentError = 0;
 
 		if (interp) {
 			Tcl_AppendResult(interp, msg, NULL);
 		}
 	} else {
-		if (session->lastErrorMsg) {
-			free((void*) session->lastErrorMsg);
+		/* Instrument error is kept until it is reported by visa::last-error */
+		if (!session->instrumentError) {
+			session->lastError = status;
+			if (session->lastErrorMsg) {
+				free((void*) session->lastErrorMsg);
+			}
+			session->lastErrorMsg = NULL;
 		}
-		session->lastErrorMsg = NULL;
 
 		if (interp) {
 			Tcl_ResetResult(interp);
@@ -832,6 +1243,33 @@ void storeLastError(VisaChannelData* session, const ViStatus status, Tcl_Interp*
 	}
 }
 
+static int setBooleanAttribute(Tcl_Interp *interp, VisaChannelData* data, ViAttr attr, const char* value) {
+	ViStatus status;
+	int flag;
+
+	if (TCL_OK != Tcl_GetBoolean(interp, value, &flag)) {
+		return TCL_ERROR;
+	}
+
+	status = setVisaAttribute(data, attr, (ViAttrState) (flag ? VI_TRUE : VI_FALSE));
+	storeLastError(data, status, interp);
+
+	return status < 0 ? TCL_ERROR : TCL_OK;
+}
+
+static int getBooleanAttribute(Tcl_Interp *interp, VisaChannelData* data, ViAttr attr, Tcl_DString *dsPtr) {
+	ViBoolean flag;
+	ViStatus status = viGetAttribute(data->session, attr, &flag);
+	storeLastError(data, status, interp);
+
+	if (status < 0) {
+		return TCL_ERROR;
+	}
+
+	Tcl_DStringAppendElement(dsPtr, flag ? "1" : "0");
+	return TCL_OK;
+}
+
 static int toVisaFlow(Tcl_Interp *interp, const char* value) {
 	if (_strcmpi(value, "NONE") == 0) {
 		return VI_ASRL_FLOW_NONE;
@@ -16,20 +16,50 @@
 
 #include <tcl.h>
 #include <visa.h>
+#include "visa_api.h"
+
+struct _VisaEventHandler;
+struct _VisaStream;
+struct _VisaReconnect;
+struct _VisaCloseBatch;
 
 typedef struct _VisaChannelData {
 	ViSession session;
+	ViSession rm;	/* resource manager session was opened with */
 	short blocking, isRMSession;
+	short messageMode, messageEnd;	/* see -message channel option */
+	short errorCheck, instrumentError, queryPending;	/* see visa_error_queue.c */
+	char* errorQuery;
 	Tcl_Channel channel;
 	ViUInt32 timeout;
 	ViStatus lastError;
 	char* lastErrorMsg;
+	struct _VisaEventHandler* eventHandlers;	/* see visa_events.c */
+	struct _VisaStream* stream;	/* see visa_stream.c */
+	struct _VisaReconnect* reconnect;	/* see visa_reconnect.c */
+	Tcl_TimerToken nativeTimer;	/* see watchProc in visa_channel.c */
+	int asyncPending;	/* see visa_async.c */
+	struct _VisaCloseBatch* closeBatch;	/* see close_all.c */
 } VisaChannelData;
 
 VisaChannelData* createVisaChannel(Tcl_Interp* const interp, ViSession session);
 VisaChannelData* getVisaChannelFromObj(Tcl_Interp* const interp, Tcl_Obj* objPtr);
+int getVisaChannelsOfRM(Tcl_Interp* const interp, ViSession rm, VisaChannelData*** listPtr);
 int getVisaTimeout(Tcl_Interp *interp, VisaChannelData* data, ViUInt32* timeout);
 int setVisaTimeout(Tcl_Interp *interp, VisaChannelData* data, ViUInt32 timeout);
 void storeLastError(VisaChannelData* session, const ViStatus status, Tcl_Interp* const interp);
 
+/*
+ * Shared by visa::assert-trigger and visa::trigger-all. Called from worker
+ * threads too, so status is returned and stored by the caller.
+ */
+ViStatus assertVisaTrigger(VisaChannelData* session, ViUInt16 protocol);
+
+/*
+ * Returns TCL_ERROR, with message in interp if it is not NULL, when session
+ * is used by worker thread of asynchronous operation or, for input, by
+ * stream reader thread. Stream takes input only, so output is allowed.
+ */
+int checkVisaChannelBusy(Tcl_Interp* const interp, VisaChannelData* data, int input);
+
 #endif /* VISA_CHANNEL_H_23874237846253613 */
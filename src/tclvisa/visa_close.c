@@ -0,0 +1,141 @@
+/*
+ * visa_close.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+/*
+ * viFlush() and viClose() may wait for the instrument for a long time.
+ * Channel in non-blocking mode is closed at once and its session is closed
+ * by a worker thread later, sessions closed by visa::close-all are closed
+ * by a pool of threads in parallel. Resource manager session is closed
+ * only after all sessions closed in background are gone.
+ */
+
+#include <tcl.h>
+#include <visa.h>
+#include "visa_api.h"
+#include "visa_close.h"
+#include "visa_pool.h"
+#include "tclvisa_utils.h"
+
+/* How long (ms) process exit waits for sessions being closed */
+#define CLOSE_EXIT_WAIT 10000
+
+static Tcl_Mutex closeMutex;
+static Tcl_Condition closeDone;
+static int closePending = 0;
+static int exitHandlerCreated = 0;
+static int closeAbandoned = 0;	/* process is exiting and gave up waiting */
+
+ViStatus closeVisaSession(ViSession vi) {
+	viFlush(vi, VI_WRITE_BUF | VI_IO_OUT_BUF);
+	return viClose(vi);
+}
+
+static Tcl_ThreadCreateType closeWorkerProc(ClientData clientData) {
+	closeVisaSession((ViSession) (size_t) clientData);
+
+	Tcl_MutexLock(&closeMutex);
+	if (0 == --closePending) {
+		Tcl_ConditionNotify(&closeDone);
+	}
+	Tcl_MutexUnlock(&closeMutex);
+
+	TCL_THREAD_CREATE_RETURN;
+}
+
+/* Process should not exit while sessions are being closed, but a dead instrument must not hang it forever */
+static void exitProc(ClientData clientData) {
+	Tcl_Time now, deadline, wait;
+
+	UNREFERENCED_PARAMETER(clientData);
+
+	Tcl_GetTime(&deadline);
+	deadline.sec += CLOSE_EXIT_WAIT / 1000;
+
+	Tcl_MutexLock(&closeMutex);
+	while (closePending > 0) {
+		Tcl_GetTime(&now);
+		if (now.sec > deadline.sec || (now.sec == deadline.sec && now.usec >= deadline.usec)) {
+			break;
+		}
+		wait.sec = deadline.sec - now.sec;
+		wait.usec = deadline.usec - now.usec;
+		if (wait.usec < 0) {
+			--wait.sec;
+			wait.usec += 1000000;
+		}
+		Tcl_ConditionWait(&closeDone, &closeMutex, &wait);
+	}
+
+	/* Resource managers closed later during finalization must not wait either */
+	closeAbandoned = closePending > 0;
+	Tcl_MutexUnlock(&closeMutex);
+}
+
+void closeVisaSessionLater(ViSession vi) {
+	Tcl_ThreadId threadId;
+	int createHandler;
+
+	Tcl_MutexLock(&closeMutex);
+	++closePending;
+	createHandler = !exitHandlerCreated;
+	exitHandlerCreated = 1;
+	Tcl_MutexUnlock(&closeMutex);
+
+	if (createHandler) {
+		Tcl_CreateExitHandler(exitProc, NULL);
+	}
+
+	if (TCL_OK != Tcl_CreateThread(&threadId, closeWorkerProc, (ClientData) (size_t) vi, TCL_THREAD_STACK_DEFAULT, TCL_THREAD_NOFLAGS)) {
+		/* No thread, close it here */
+		closeWorkerProc((ClientData) (size_t) vi);
+	}
+}
+
+void waitVisaSessionsClosed(void) {
+	Tcl_MutexLock(&closeMutex);
+	while (closePending > 0 && !closeAbandoned) {
+		Tcl_ConditionWait(&closeDone, &closeMutex, NULL);
+	}
+	Tcl_MutexUnlock(&closeMutex);
+}
+
+typedef struct _BatchParams {
+	VisaCloseBatch* batch;
+	ViStatus* statuses;
+} BatchParams;
+
+static void closeJob(ClientData clientData, int index) {
+	BatchParams* params = (BatchParams*) clientData;
+
+	params->statuses[index] = closeVisaSession(params->batch->sessions[index]);
+}
+
+ViStatus closeVisaBatch(VisaCloseBatch* batch, int threadCount) {
+	BatchParams params;
+	ViStatus firstError = VI_SUCCESS;
+	int i;
+
+	params.batch = batch;
+	params.statuses = (ViStatus*) ckalloc(sizeof(ViStatus) * (batch->count + 1));
+
+	runVisaPool(closeJob, (ClientData) &params, batch->count, threadCount);
+
+	for (i = 0; i < batch->count; ++i) {
+		if (params.statuses[i] < 0 && firstError >= 0) {
+			firstError = params.statuses[i];
+		}
+	}
+
+	ckfree((char*) params.statuses);
+	return firstError;
+}
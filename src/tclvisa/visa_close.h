@@ -0,0 +1,31 @@
+/*
+ * visa_close.h --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+#ifndef VISA_CLOSE_H_34237856365464
+#define VISA_CLOSE_H_34237856365464
+
+#include <tcl.h>
+#include <visa.h>
+
+/* Sessions detached from their channels by visa::close-all */
+typedef struct _VisaCloseBatch {
+	ViSession* sessions;
+	int count;
+} VisaCloseBatch;
+
+ViStatus closeVisaSession(ViSession vi);
+void closeVisaSessionLater(ViSession vi);
+void waitVisaSessionsClosed(void);
+ViStatus closeVisaBatch(VisaCloseBatch* batch, int threadCount);
+
+#endif /* VISA_CLOSE_H_34237856365464 */
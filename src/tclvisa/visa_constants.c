@@ -14,37 +14,123 @@
 #include <tcl.h>
 #include <visa.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "visa_utils.h"
+#include "tcl_utils.h"
+#include "tclvisa_utils.h"
 
-static int addIntegerVar(Tcl_Interp* const interp, const char* prefix, const char* name, size_t nameOffset, int value) {
-	char qualifiedName[64];
+#define VISA_PREFIX "VI_"
+#define VISA_PREFIX_LEN 3
 
-	sprintf(qualifiedName, "%s%s", prefix, name + nameOffset);
-	return NULL == Tcl_SetVar2Ex(interp, qualifiedName, NULL, Tcl_NewIntObj(value), TCL_LEAVE_ERR_MSG)
-		? TCL_ERROR : TCL_OK;
+typedef struct VisaConstant {
+	const char* name;	/* name without VI_ prefix */
+	int value;
+} VisaConstant;
+
+#define visaConstant(name)	{ #name + VISA_PREFIX_LEN, (int) (name) },
+
+/*
+ * Table of known constants, sorted by name (see convert.awk).
+ * Nothing is created in the interpreter until a constant is asked for.
+ */
+static const VisaConstant visaConstants[] = {
+#include "visa_constants.inc"
+	{ NULL, 0 }
+};
+
+#define VISA_CONSTANT_COUNT (sizeof(visaConstants) / sizeof(visaConstants[0]) - 1)
+
+static int compareConstants(const void* key, const void* item) {
+	return strcmp((const char*) key, ((const VisaConstant*) item)->name);
+}
+
+int lookupVisaConstant(const char* name, int* value) {
+	const VisaConstant* c;
+
+	/* Both "VI_EXCLUSIVE_LOCK" and "EXCLUSIVE_LOCK" are accepted */
+	if (0 == strncmp(name, VISA_PREFIX, VISA_PREFIX_LEN)) {
+		name += VISA_PREFIX_LEN;
+	}
+
+	c = (const VisaConstant*) bsearch(name, visaConstants, VISA_CONSTANT_COUNT, sizeof(visaConstants[0]), compareConstants);
+	if (NULL == c) {
+		return TCL_ERROR;
+	}
+
+	if (value) {
+		*value = c->value;
+	}
+	return TCL_OK;
 }
 
-static int addStringVar(Tcl_Interp* const interp, const char* prefix, const char* name, size_t nameOffset, const char* value) {
+const char* findVisaConstantName(const char* prefix, int value) {
+	const size_t len = strlen(prefix);
+	size_t i;
+
+	/* Many constants share the same value, so prefix narrows the search, e.g. "EVENT_" */
+	for (i = 0; i < VISA_CONSTANT_COUNT; ++i) {
+		if (visaConstants[i].value == value && 0 == strncmp(visaConstants[i].name, prefix, len)) {
+			return visaConstants[i].name;
+		}
+	}
+
+	return NULL;
+}
+
+static int importConstants(Tcl_Interp* const interp, const char* prefix) {
 	char qualifiedName[64];
-	Tcl_Obj* v = Tcl_NewStringObj(value, 0);
+	size_t i;
 
-	sprintf(qualifiedName, "%s%s", prefix, name + nameOffset);
-	return NULL == Tcl_SetVar2Ex(interp, qualifiedName, NULL, v, TCL_LEAVE_ERR_MSG)
-		? TCL_ERROR : TCL_OK;
+	for (i = 0; i < VISA_CONSTANT_COUNT; ++i) {
+		sprintf(qualifiedName, "%s%s", prefix, visaConstants[i].name);
+		if (NULL == Tcl_SetVar2Ex(interp, qualifiedName, NULL, Tcl_NewIntObj(visaConstants[i].value), TCL_LEAVE_ERR_MSG)) {
+			return TCL_ERROR;
+		}
+	}
+
+	return TCL_OK;
 }
 
-#define addIntVar(name)	\
-	if (TCL_OK != addIntegerVar(interp, prefix, #name, 3, name)/* || TCL_OK != addIntegerVar(interp, "", #name, 0, name)*/) goto error
+int tclvisa_const(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]) {
+	const char* name;
+	int value;
 
-int setVisaConstants(Tcl_Interp* const interp, const char* prefix, const char *version) {
+	/* Check number of arguments */
+	if (objc > 2) {
+		Tcl_WrongNumArgs(interp, 1, objv, "?name|-import?");
+		return TCL_ERROR;
+	}
 
-#include "visa_constants.inc"
+	if (objc == 1) {
+		/* Return names of all known constants */
+		Tcl_Obj* res = Tcl_NewListObj(0, NULL);
+		size_t i;
+
+		for (i = 0; i < VISA_CONSTANT_COUNT; ++i) {
+			Tcl_ListObjAppendElement(interp, res, Tcl_NewStringObj(visaConstants[i].name, -1));
+		}
+		Tcl_SetObjResult(interp, res);
+		return TCL_OK;
+	}
+
+	name = TclGetString(objv[1]);
 
-	if (TCL_OK != addStringVar(interp, "", "TCLVISAVERSION", 0, version)) {
-		goto error;
+	if (0 == strcmp(name, "-import")) {
+		/* Create visa::XXX variables for scripts written for earlier versions */
+		return importConstants(interp, (const char*) clientData);
 	}
 
+	if (TCL_OK != lookupVisaConstant(name, &value)) {
+		Tcl_AppendResult(interp, "unknown VISA constant \"", name, "\"", NULL);
+		return TCL_ERROR;
+	}
+
+	Tcl_SetObjResult(interp, Tcl_NewIntObj(value));
 	return TCL_OK;
+}
 
-error:
-	return TCL_ERROR;
+int setVisaVersion(Tcl_Interp* const interp, const char *version) {
+	return NULL == Tcl_SetVar2Ex(interp, "TCLVISAVERSION", NULL, Tcl_NewStringObj(version, -1), TCL_LEAVE_ERR_MSG)
+		? TCL_ERROR : TCL_OK;
 }
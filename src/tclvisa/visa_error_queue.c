@@ -0,0 +1,171 @@
+/*
+ * visa_error_queue.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+/*
+ * Instrument error checking enabled by -errorcheck channel option.
+ * Instead of querying error queue after every command, status byte is read,
+ * and error queue is drained only when "error/event queue not empty" bit is
+ * set. Errors are recorded as the last error of the session.
+ */
+
+#include <tcl.h>
+#include <visa.h>
+#include <stdlib.h>
+#include <string.h>
+#include "visa_error_queue.h"
+#include "visa_channel.h"
+
+/* IEEE 488.2 / SCPI status byte bits */
+#define STB_EAV 0x04	/* error/event queue not empty */
+#define STB_MAV 0x10	/* message available */
+
+/* Guard against instruments which never report "no error" */
+#define MAX_ERRORS 32
+
+#define ERROR_NAME "[SCPI_ERROR] "
+#define ERROR_SEPARATOR "; "
+
+void setVisaErrorQuery(VisaChannelData* data, const char* query) {
+	if (data->errorQuery) {
+		free((void*) data->errorQuery);
+	}
+	data->errorQuery = (char*) malloc(strlen(query) + 1);
+	strcpy(data->errorQuery, query);
+}
+
+/* Reads one response to error query, returns instrument error code */
+static long queryError(VisaChannelData* data, Tcl_DString* dsPtr) {
+	const char* query = data->errorQuery ? data->errorQuery : VISA_DEFAULT_ERROR_QUERY;
+	char buf[256];
+	ViUInt32 retCount;
+	ViStatus status;
+	long code;
+
+	status = viWrite(data->session, (ViBuf) query, (ViUInt32) strlen(query), &retCount);
+	if (status < 0) {
+		return 0;
+	}
+
+	status = viRead(data->session, (ViPBuf) buf, sizeof(buf) - 1, &retCount);
+	if (status < 0) {
+		return 0;
+	}
+	while (status == VI_SUCCESS_MAX_CNT) {
+		/* Skip rest of a long message */
+		char rest[64];
+		ViUInt32 restCount;
+		status = viRead(data->session, (ViPBuf) rest, sizeof(rest), &restCount);
+	}
+
+	while (retCount > 0 && (buf[retCount - 1] == '\n' || buf[retCount - 1] == '\r')) {
+		--retCount;
+	}
+	buf[retCount] = 0;
+
+	/* Response looks like -113,"Undefined header" */
+	code = strtol(buf, NULL, 10);
+	if (code != 0) {
+		if (Tcl_DStringLength(dsPtr) > 0) {
+			Tcl_DStringAppend(dsPtr, ERROR_SEPARATOR, -1);
+		}
+		Tcl_DStringAppend(dsPtr, buf, -1);
+	}
+
+	return code;
+}
+
+void checkVisaErrorQueue(VisaChannelData* data) {
+	Tcl_DString ds;
+	ViUInt16 stb;
+	long code, firstCode = 0;
+	int i;
+
+	/* Draining queue while a response is pending would mix messages */
+	if (viReadSTB(data->session, &stb) < 0 || !(stb & STB_EAV) || (stb & STB_MAV)) {
+		return;
+	}
+
+	Tcl_DStringInit(&ds);
+
+	for (i = 0; i < MAX_ERRORS && 0 != (code = queryError(data, &ds)); ++i) {
+		if (0 == firstCode) {
+			firstCode = code;
+		}
+	}
+
+	if (firstCode != 0) {
+		/* Kept until reported by visa::last-error or replaced by VISA error */
+		if (data->lastErrorMsg) {
+			free((void*) data->lastErrorMsg);
+		}
+		data->lastErrorMsg = (char*) malloc(strlen(ERROR_NAME) + Tcl_DStringLength(&ds) + 1);
+		strcpy(data->lastErrorMsg, ERROR_NAME);
+		strcat(data->lastErrorMsg, Tcl_DStringValue(&ds));
+		data->lastError = (ViStatus) firstCode;
+		data->instrumentError = 1;
+	}
+
+	Tcl_DStringFree(&ds);
+}
+
+int isVisaQuery(const char* buf, size_t len) {
+	enum { UNIT_START, HEADER, ARGUMENTS } state = UNIT_START;
+	size_t i = 0;
+
+	while (i < len) {
+		char c = buf[i++];
+
+		if (c == ';' || c == '\n') {
+			/* Next program message unit */
+			state = UNIT_START;
+			continue;
+		}
+
+		switch (state) {
+		case UNIT_START:
+		case HEADER:
+			if (c == '?') {
+				return 1;
+			}
+			if (c == ' ' || c == '\t' || c == '\r') {
+				state = state == HEADER ? ARGUMENTS : UNIT_START;
+			} else {
+				state = HEADER;
+			}
+			break;
+
+		case ARGUMENTS:
+			if (c == '"' || c == '\'') {
+				/* String data, doubled quote is read as two strings */
+				while (i < len && buf[i] != c) {
+					++i;
+				}
+				++i;
+			} else if (c == '#' && i < len && buf[i] > '0' && buf[i] <= '9') {
+				/* Definite length block: digit count, length, data */
+				size_t digits = (size_t) (buf[i++] - '0'), count = 0;
+
+				for (; digits > 0 && i < len; --digits, ++i) {
+					count = count * 10 + (size_t) (buf[i] - '0');
+				}
+				i += count;
+			} else if (c == '#' && i < len && buf[i] == '0') {
+				/* Indefinite length block lasts until the end of message */
+				return 0;
+			}
+			break;
+		}
+	}
+
+	return 0;
+}
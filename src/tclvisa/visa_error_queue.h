@@ -0,0 +1,32 @@
+/*
+ * visa_error_queue.h --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+#ifndef VISA_ERROR_QUEUE_H_34237856365464
+#define VISA_ERROR_QUEUE_H_34237856365464
+
+#include <stddef.h>
+#include <visa.h>
+#include "visa_channel.h"
+
+#define VISA_DEFAULT_ERROR_QUERY "SYST:ERR?\n"
+
+void checkVisaErrorQueue(VisaChannelData* data);
+void setVisaErrorQuery(VisaChannelData* data, const char* query);
+
+/*
+ * Returns non-zero if program message contains a query, i. e. header of
+ * any message unit ends with "?". String and block arguments are skipped.
+ */
+int isVisaQuery(const char* buf, size_t len);
+
+#endif /* VISA_ERROR_QUEUE_H_34237856365464 */
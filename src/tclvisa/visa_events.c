@@ -0,0 +1,289 @@
+/*
+ * visa_events.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+/*
+ * VISA calls event handlers in its own threads. The handler installed here
+ * does nothing but queue a Tcl event to the thread which registered the
+ * script, so the script is evaluated by the Tcl event loop of that thread.
+ */
+
+#include <tcl.h>
+#include <visa.h>
+#include <ctype.h>
+#include <string.h>
+#include "visa_events.h"
+#include "visa_channel.h"
+#include "visa_utils.h"
+#include "tcl_utils.h"
+#include "tclvisa_utils.h"
+
+#define EVENT_PREFIX "EVENT_"
+#define EVENT_NAME_SIZE 64
+
+typedef struct _VisaEventHandler {
+	struct _VisaEventHandler* next;
+	ViEventType eventType;
+	Tcl_Interp* interp;
+	Tcl_Obj* script;
+	Tcl_ThreadId threadId;
+	int pending;	/* number of Tcl events queued or being processed */
+	int deleted;	/* handler is uninstalled, free it when pending drops to zero */
+} VisaEventHandler;
+
+typedef struct _VisaEvent {
+	Tcl_Event header;
+	VisaEventHandler* handler;
+} VisaEvent;
+
+/* Guards pending and deleted fields accessed from VISA threads */
+TCL_DECLARE_MUTEX(eventMutex)
+
+int getVisaEventTypeFromObj(Tcl_Interp* const interp, Tcl_Obj* objPtr, ViEventType* eventType) {
+	char buf[EVENT_NAME_SIZE + sizeof(EVENT_PREFIX)];
+	const char* name;
+	char* s;
+	long l;
+	int value;
+
+	/* Numeric event type, e.g. [visa::const EVENT_SERVICE_REQ] */
+	if (TCL_OK == Tcl_GetLongFromObj(NULL, objPtr, &l)) {
+		*eventType = (ViEventType) l;
+		return TCL_OK;
+	}
+
+	/* Symbolic event type, e.g. "srq", "service_req" or "VI_EVENT_SERVICE_REQ" */
+	name = TclGetString(objPtr);
+	if (strlen(name) >= EVENT_NAME_SIZE) {
+		goto error;
+	}
+
+	strcpy(buf, EVENT_PREFIX);
+	s = buf + strlen(EVENT_PREFIX);
+	strcpy(s, name);
+	for (; *s; ++s) {
+		*s = (char) toupper((unsigned char) *s);
+	}
+
+	s = buf + strlen(EVENT_PREFIX);
+	if (0 == strncmp(s, "VI_", 3)) {
+		memmove(s, s + 3, strlen(s + 3) + 1);
+	}
+	if (0 == strcmp(s, "SRQ")) {
+		strcpy(s, "SERVICE_REQ");
+	}
+
+	if (TCL_OK == lookupVisaConstant(buf, &value)
+		|| TCL_OK == lookupVisaConstant(s, &value)) {
+		*eventType = (ViEventType) value;
+		return TCL_OK;
+	}
+
+error:
+	if (interp) {
+		Tcl_AppendResult(interp, "bad event type \"", name, "\"", NULL);
+	}
+	return TCL_ERROR;
+}
+
+Tcl_Obj* newVisaEventTypeObj(ViEventType eventType) {
+	const char* name = findVisaConstantName(EVENT_PREFIX, (int) eventType);
+
+	/* Name without prefix is accepted back by getVisaEventTypeFromObj() */
+	return name
+		? Tcl_NewStringObj(name + strlen(EVENT_PREFIX), -1)
+		: Tcl_NewLongObj((long) eventType);
+}
+
+static void freeHandler(VisaEventHandler* h) {
+	Tcl_DecrRefCount(h->script);
+	Tcl_Release((ClientData) h->interp);
+	ckfree((char*) h);
+}
+
+/* Called in owner thread by Tcl event loop */
+static int eventProc(Tcl_Event* evPtr, int flags) {
+	VisaEventHandler* h = ((VisaEvent*) evPtr)->handler;
+	Tcl_Interp* interp = h->interp;
+	int deleted;
+
+	if (!(flags & TCL_FILE_EVENTS)) {
+		return 0;
+	}
+
+	Tcl_MutexLock(&eventMutex);
+	deleted = h->deleted;
+	Tcl_MutexUnlock(&eventMutex);
+
+	if (!deleted && !Tcl_InterpDeleted(interp)) {
+		/* Script may remove this very handler, so handler is kept alive until script is done */
+		Tcl_Obj* script = h->script;
+
+		Tcl_Preserve((ClientData) interp);
+		Tcl_IncrRefCount(script);
+		if (TCL_OK != Tcl_EvalObjEx(interp, script, TCL_EVAL_GLOBAL)) {
+			Tcl_AddErrorInfo(interp, "\n    (VISA event handler)");
+			Tcl_BackgroundError(interp);
+		}
+		Tcl_DecrRefCount(script);
+		Tcl_Release((ClientData) interp);
+	}
+
+	Tcl_MutexLock(&eventMutex);
+	--h->pending;
+	deleted = h->deleted && 0 == h->pending;
+	Tcl_MutexUnlock(&eventMutex);
+
+	if (deleted) {
+		freeHandler(h);
+	}
+
+	return 1;
+}
+
+/* Called by VISA in arbitrary thread */
+static ViStatus _VI_FUNCH visaEventHandler(ViSession vi, ViEventType eventType, ViEvent context, ViAddr userHandle) {
+	VisaEventHandler* h = (VisaEventHandler*) userHandle;
+
+	UNREFERENCED_PARAMETER(vi);
+	UNREFERENCED_PARAMETER(eventType);
+	UNREFERENCED_PARAMETER(context);
+
+	Tcl_MutexLock(&eventMutex);
+	if (!h->deleted) {
+		VisaEvent* ev = (VisaEvent*) ckalloc(sizeof(VisaEvent));
+
+		ev->header.proc = eventProc;
+		ev->handler = h;
+		++h->pending;
+
+		Tcl_ThreadQueueEvent(h->threadId, (Tcl_Event*) ev, TCL_QUEUE_TAIL);
+		Tcl_ThreadAlert(h->threadId);
+	}
+	Tcl_MutexUnlock(&eventMutex);
+
+	return VI_SUCCESS;
+}
+
+static VisaEventHandler** findHandler(VisaChannelData* data, ViEventType eventType) {
+	VisaEventHandler** p;
+
+	for (p = &data->eventHandlers; *p; p = &(*p)->next) {
+		if ((*p)->eventType == eventType) {
+			break;
+		}
+	}
+
+	return p;
+}
+
+static ViStatus uninstallHandler(VisaChannelData* data, VisaEventHandler** p) {
+	VisaEventHandler* h = *p;
+	ViStatus status;
+	int unused;
+
+	status = viDisableEvent(data->session, h->eventType, VI_HNDLR);
+	viUninstallHandler(data->session, h->eventType, visaEventHandler, (ViAddr) h);
+
+	/* Exclude from session's list */
+	*p = h->next;
+
+	Tcl_MutexLock(&eventMutex);
+	h->deleted = 1;
+	unused = 0 == h->pending;
+	Tcl_MutexUnlock(&eventMutex);
+
+	if (unused) {
+		freeHandler(h);
+	}
+
+	return status;
+}
+
+int setVisaEventHandler(Tcl_Interp* const interp, VisaChannelData* data, ViEventType eventType, Tcl_Obj* script) {
+	VisaEventHandler** p = findHandler(data, eventType);
+	VisaEventHandler* h;
+	ViStatus status;
+
+	if (NULL == script) {
+		/* Remove handler */
+		if (*p) {
+			status = uninstallHandler(data, p);
+			storeLastError(data, status, interp);
+			return status < 0 ? TCL_ERROR : TCL_OK;
+		}
+		return TCL_OK;
+	}
+
+	if (*p && (*p)->interp == interp && (*p)->threadId == Tcl_GetCurrentThread()) {
+		/* Handler is already installed, just replace script */
+		Tcl_IncrRefCount(script);
+		Tcl_DecrRefCount((*p)->script);
+		(*p)->script = script;
+		return TCL_OK;
+	}
+
+	if (*p) {
+		/* Handler is installed by another interpreter */
+		uninstallHandler(data, p);
+	}
+
+	h = (VisaEventHandler*) ckalloc(sizeof(VisaEventHandler));
+	memset((void*) h, 0, sizeof(*h));
+	h->eventType = eventType;
+	h->interp = interp;
+	h->script = script;
+	h->threadId = Tcl_GetCurrentThread();
+	Tcl_IncrRefCount(script);
+	Tcl_Preserve((ClientData) interp);
+
+	status = viInstallHandler(data->session, eventType, visaEventHandler, (ViAddr) h);
+	if (status >= 0) {
+		status = viEnableEvent(data->session, eventType, VI_HNDLR, VI_NULL);
+		if (status < 0) {
+			viUninstallHandler(data->session, eventType, visaEventHandler, (ViAddr) h);
+		}
+	}
+
+	storeLastError(data, status, interp);
+	if (status < 0) {
+		freeHandler(h);
+		return TCL_ERROR;
+	}
+
+	h->next = data->eventHandlers;
+	data->eventHandlers = h;
+
+	return TCL_OK;
+}
+
+Tcl_Obj* getVisaEventHandler(VisaChannelData* data, ViEventType eventType) {
+	VisaEventHandler** p = findHandler(data, eventType);
+	return *p ? (*p)->script : NULL;
+}
+
+void reinstallVisaEventHandlers(VisaChannelData* data) {
+	VisaEventHandler* h;
+
+	/* Handlers of closed session are gone along with it */
+	for (h = data->eventHandlers; h; h = h->next) {
+		if (viInstallHandler(data->session, h->eventType, visaEventHandler, (ViAddr) h) >= 0) {
+			viEnableEvent(data->session, h->eventType, VI_HNDLR, VI_NULL);
+		}
+	}
+}
+
+void removeVisaEventHandlers(VisaChannelData* data) {
+	while (data->eventHandlers) {
+		uninstallHandler(data, &data->eventHandlers);
+	}
+}
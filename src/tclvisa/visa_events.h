@@ -0,0 +1,28 @@
+/*
+ * visa_events.h --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+#ifndef VISA_EVENTS_H_34237856365464
+#define VISA_EVENTS_H_34237856365464
+
+#include <tcl.h>
+#include <visa.h>
+#include "visa_channel.h"
+
+int getVisaEventTypeFromObj(Tcl_Interp* const interp, Tcl_Obj* objPtr, ViEventType* eventType);
+Tcl_Obj* newVisaEventTypeObj(ViEventType eventType);
+int setVisaEventHandler(Tcl_Interp* const interp, VisaChannelData* data, ViEventType eventType, Tcl_Obj* script);
+Tcl_Obj* getVisaEventHandler(VisaChannelData* data, ViEventType eventType);
+void reinstallVisaEventHandlers(VisaChannelData* data);
+void removeVisaEventHandlers(VisaChannelData* data);
+
+#endif /* VISA_EVENTS_H_34237856365464 */
@@ -0,0 +1,841 @@
+/*
+ * visa_native.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+/*
+ * Native sessions are served by tclvisa itself, bypassing VISA library.
+ * Every VISA call made by tclvisa goes through visaNativeApi table below:
+ * calls on native sessions are handled here, all other calls are passed
+ * to the VISA library unchanged. Native sessions are opened by viOpen
+ * for supported resources only when enabled by visa::backend command.
+ */
+
+#define VISA_API_IMPLEMENTATION
+
+#include <tcl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "visa_native.h"
+#include "tclvisa_utils.h"
+
+#ifdef TCLVISA_NATIVE
+
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+/*
+ * Sessions are kept in chunks which are never moved or freed, so that
+ * every I/O call looks its session up without locking. Mutex serializes
+ * registration and the list of free slots.
+ *
+ * Identifier holds slot index in lower bits and generation of the slot in
+ * upper ones. Slot of closed session is reused in turn after all other
+ * free slots, with generation incremented, so stale identifier is not
+ * mistaken for the new session.
+ */
+#define SESSION_CHUNK_BITS 8
+#define SESSION_CHUNK_SIZE (1U << SESSION_CHUNK_BITS)
+#define SESSION_CHUNK_COUNT 256
+#define SESSION_INDEX_BITS 16
+#define SESSION_INDEX_MASK ((1U << SESSION_INDEX_BITS) - 1)
+#define SESSION_GENERATION_MASK 0xFFU
+#define SESSION_NO_SLOT ((ViUInt32) -1)
+
+typedef struct _SessionSlot {
+	VisaNativeSession* session;
+	ViUInt32 generation;
+	ViUInt32 nextFree;
+} SessionSlot;
+
+static SessionSlot* chunks[SESSION_CHUNK_COUNT];
+static ViUInt32 sessionCount = 0;
+static ViUInt32 freeHead = SESSION_NO_SLOT, freeTail = SESSION_NO_SLOT;
+static int nativeEnabled = 0;
+
+TCL_DECLARE_MUTEX(nativeMutex)
+
+int isVisaNativeEnabled(void) {
+	return loadAcquire(&nativeEnabled);
+}
+
+void setVisaNativeEnabled(int enabled) {
+	storeRelease(&nativeEnabled, enabled ? 1 : 0);
+}
+
+static SessionSlot* getSessionSlot(ViUInt32 index) {
+	SessionSlot* chunk;
+
+	if (index >= SESSION_CHUNK_SIZE * SESSION_CHUNK_COUNT) {
+		return NULL;
+	}
+
+	chunk = loadAcquire(&chunks[index >> SESSION_CHUNK_BITS]);
+	return chunk ? &chunk[index & (SESSION_CHUNK_SIZE - 1)] : NULL;
+}
+
+static VisaNativeSession* getNativeSession(ViObject vi) {
+	SessionSlot* slot;
+	VisaNativeSession* s;
+
+	if (vi < VISA_NATIVE_SESSION_BASE) {
+		/* Sessions of VISA library are not looked up */
+		return NULL;
+	}
+
+	slot = getSessionSlot((vi - VISA_NATIVE_SESSION_BASE) & SESSION_INDEX_MASK);
+	s = slot ? loadAcquire(&slot->session) : NULL;
+
+	/* Slot may hold newer session already */
+	return s && s->vi == vi ? s : NULL;
+}
+
+static ViStatus registerSession(VisaNativeSession* s) {
+	ViUInt32 index;
+	SessionSlot* slot;
+
+	Tcl_MutexLock(&nativeMutex);
+	if (SESSION_NO_SLOT != freeHead) {
+		index = freeHead;
+		slot = getSessionSlot(index);
+		freeHead = slot->nextFree;
+		if (SESSION_NO_SLOT == freeHead) {
+			freeTail = SESSION_NO_SLOT;
+		}
+	} else {
+		SessionSlot* chunk;
+
+		index = sessionCount;
+		if (index >= SESSION_CHUNK_SIZE * SESSION_CHUNK_COUNT) {
+			Tcl_MutexUnlock(&nativeMutex);
+			return VI_ERROR_ALLOC;
+		}
+
+		chunk = chunks[index >> SESSION_CHUNK_BITS];
+		if (NULL == chunk) {
+			chunk = (SessionSlot*) calloc(SESSION_CHUNK_SIZE, sizeof(SessionSlot));
+			if (NULL == chunk) {
+				Tcl_MutexUnlock(&nativeMutex);
+				return VI_ERROR_ALLOC;
+			}
+			storeRelease(&chunks[index >> SESSION_CHUNK_BITS], chunk);
+		}
+		slot = &chunk[index & (SESSION_CHUNK_SIZE - 1)];
+		sessionCount = index + 1;
+	}
+
+	s->vi = VISA_NATIVE_SESSION_BASE + (slot->generation << SESSION_INDEX_BITS) + index;
+	storeRelease(&slot->session, s);
+	Tcl_MutexUnlock(&nativeMutex);
+
+	return VI_SUCCESS;
+}
+
+static void unregisterSession(VisaNativeSession* s) {
+	ViUInt32 index = (s->vi - VISA_NATIVE_SESSION_BASE) & SESSION_INDEX_MASK;
+	SessionSlot* slot = getSessionSlot(index);
+
+	Tcl_MutexLock(&nativeMutex);
+	storeRelease(&slot->session, (VisaNativeSession*) NULL);
+	slot->generation = (slot->generation + 1) & SESSION_GENERATION_MASK;
+
+	/* Free slots are taken from head and returned to tail */
+	slot->nextFree = SESSION_NO_SLOT;
+	if (SESSION_NO_SLOT == freeTail) {
+		freeHead = index;
+	} else {
+		getSessionSlot(freeTail)->nextFree = index;
+	}
+	freeTail = index;
+	Tcl_MutexUnlock(&nativeMutex);
+}
+
+/* Session is registered on creation, caller fills type-specific fields before returning its identifier */
+ViStatus createVisaNativeSession(const VisaNativeType* type, const char* rsrcName, int fd, ClientData typeData, VisaNativeSession** sPtr) {
+	VisaNativeSession* s = (VisaNativeSession*) malloc(sizeof(VisaNativeSession));
+
+	if (NULL == s) {
+		return VI_ERROR_ALLOC;
+	}
+
+	memset(s, 0, sizeof(*s));
+	s->type = type;
+	s->fd = fd;
+	s->rsrcName = (char*) malloc(strlen(rsrcName) + 1);
+	strcpy(s->rsrcName, rsrcName);
+	s->timeout = 2000;
+	s->termChar = '\n';
+	s->termCharEn = VI_FALSE;
+	s->sendEndEn = VI_TRUE;
+	s->suppressEndEn = VI_FALSE;
+	s->typeData = typeData;
+
+	if (registerSession(s) < 0) {
+		free(s->rsrcName);
+		free(s);
+		return VI_ERROR_ALLOC;
+	}
+
+	*sPtr = s;
+	return VI_SUCCESS;
+}
+
+static void closeSession(VisaNativeSession* s) {
+	unregisterSession(s);
+
+	if (s->type && s->type->close) {
+		s->type->close(s);
+	}
+	if (s->fd >= 0) {
+		close(s->fd);
+	}
+
+	Tcl_MutexFinalize(&s->readMutex);
+	Tcl_MutexFinalize(&s->writeMutex);
+	free(s->rsrcName);
+	free(s);
+}
+
+ViStatus errnoToVisaStatus(int err) {
+	switch (err) {
+	case EPIPE:
+	case ECONNRESET:
+	case ECONNABORTED:
+	case ENOTCONN:
+	case ETIMEDOUT:
+		return VI_ERROR_CONN_LOST;
+	case ENOMEM:
+		return VI_ERROR_ALLOC;
+	default:
+		return VI_ERROR_IO;
+	}
+}
+
+/* Milliseconds since arbitrary moment, used to compute time left */
+static Tcl_WideInt nowMs(void) {
+	Tcl_Time t;
+
+	Tcl_GetTime(&t);
+	return (Tcl_WideInt) t.sec * 1000 + t.usec / 1000;
+}
+
+static int timeLeft(ViUInt32 timeout, Tcl_WideInt start) {
+	Tcl_WideInt left;
+
+	if (VI_TMO_INFINITE == timeout) {
+		return -1;
+	}
+
+	left = (Tcl_WideInt) timeout - (nowMs() - start);
+	return left > 0 ? (int) left : 0;
+}
+
+ViStatus waitVisaNativeFd(int fd, int events, ViUInt32 timeout) {
+	struct pollfd pfd;
+	Tcl_WideInt start = nowMs();
+	int res;
+
+	pfd.fd = fd;
+	pfd.events = (short) events;
+
+	do {
+		pfd.revents = 0;
+		res = poll(&pfd, 1, timeLeft(timeout, start));
+	} while (res < 0 && EINTR == errno);
+
+	if (res < 0) {
+		return errnoToVisaStatus(errno);
+	}
+	if (0 == res) {
+		return VI_ERROR_TMO;
+	}
+
+	/* Errors and hang-up are reported by following read or write */
+	return VI_SUCCESS;
+}
+
+/*
+ * Reads like viRead does. termChar is -1 when read should not stop at
+ * termination character. Socket has no END indicator, so for sessions
+ * with endOnIdle flag, unless VI_ATTR_SUPPRESS_END_EN is set, read
+ * completes when no more data is available at the moment, as VISA does
+ * for TCPIP SOCKET resources.
+ */
+ViStatus readVisaNative(VisaNativeSession* s, ViPBuf buf, ViUInt32 count, int termChar, ViUInt32* retCount) {
+	ViUInt32 got = 0;
+	ViStatus status;
+	Tcl_WideInt start = nowMs();
+	int endOnIdle = s->endOnIdle && !s->suppressEndEn;
+
+	Tcl_MutexLock(&s->readMutex);
+
+	for (;;) {
+		ssize_t n;
+
+		if (s->pendingPos < s->pendingLen) {
+			/* Take data received before */
+			size_t avail = s->pendingLen - s->pendingPos;
+			size_t len = avail < count - got ? avail : count - got;
+			char* p = s->pending + s->pendingPos;
+			char* term = termChar >= 0 ? (char*) memchr(p, termChar, len) : NULL;
+
+			if (term) {
+				len = (size_t) (term - p) + 1;
+			}
+			memcpy(buf + got, p, len);
+			got += (ViUInt32) len;
+			s->pendingPos += len;
+
+			if (term) {
+				status = VI_SUCCESS_TERM_CHAR;
+				break;
+			}
+			if (got == count) {
+				status = VI_SUCCESS_MAX_CNT;
+				break;
+			}
+		}
+
+		/* Read buffer is empty, wait for data */
+		status = waitVisaNativeFd(s->fd, POLLIN,
+			got > 0 && endOnIdle ? VI_TMO_IMMEDIATE : (ViUInt32) timeLeft(s->timeout, start));
+		if (VI_ERROR_TMO == status && got > 0 && endOnIdle) {
+			/* Nothing more to read: end of message */
+			status = VI_SUCCESS;
+			break;
+		}
+		if (status < 0) {
+			break;
+		}
+
+		s->pendingPos = s->pendingLen = 0;
+		if (termChar >= 0) {
+			/* Termination character must be found before data is passed to caller */
+			n = read(s->fd, s->pending, sizeof(s->pending));
+			if (n > 0) {
+				s->pendingLen = (size_t) n;
+			}
+		} else {
+			/* Data goes directly to caller, the rest is kept in read buffer */
+			struct iovec iov[2];
+
+			iov[0].iov_base = buf + got;
+			iov[0].iov_len = count - got;
+			iov[1].iov_base = s->pending;
+			iov[1].iov_len = sizeof(s->pending);
+			n = readv(s->fd, iov, 2);
+			if (n > 0) {
+				if ((size_t) n > count - got) {
+					s->pendingLen = (size_t) n - (count - got);
+					n = (ssize_t) (count - got);
+				}
+				got += (ViUInt32) n;
+				if (got == count) {
+					status = VI_SUCCESS_MAX_CNT;
+					break;
+				}
+			}
+		}
+
+		if (0 == n) {
+			/* Connection is closed by peer */
+			status = got > 0 ? VI_SUCCESS : VI_ERROR_CONN_LOST;
+			break;
+		}
+		if (n < 0 && EINTR != errno && EAGAIN != errno && EWOULDBLOCK != errno) {
+			status = errnoToVisaStatus(errno);
+			break;
+		}
+	}
+
+	Tcl_MutexUnlock(&s->readMutex);
+
+	if (retCount) {
+		*retCount = got;
+	}
+	return status;
+}
+
+/* Termination character is appended in the same system call when END_OUT requires it */
+ViStatus writeVisaNative(VisaNativeSession* s, const char* buf, ViUInt32 count, ViUInt32* retCount) {
+	ViUInt32 sent = 0;
+	ViStatus status = VI_SUCCESS;
+	Tcl_WideInt start = nowMs();
+	struct iovec iov[2];
+	struct msghdr msg;
+	int iovcnt = 1;
+	size_t total = count;
+
+	iov[0].iov_base = (void*) buf;
+	iov[0].iov_len = count;
+	if (s->endOutTermChar && s->sendEndEn) {
+		iov[1].iov_base = &s->termChar;
+		iov[1].iov_len = 1;
+		iovcnt = 2;
+		++total;
+	}
+
+	Tcl_MutexLock(&s->writeMutex);
+
+	while (total > 0) {
+		ssize_t n;
+
+		if (s->isSocket) {
+			/* No SIGPIPE on closed connection, EPIPE is reported instead */
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_iov = iov;
+			msg.msg_iovlen = iovcnt;
+			n = sendmsg(s->fd, &msg, MSG_NOSIGNAL);
+		} else {
+			n = writev(s->fd, iov, iovcnt);
+		}
+
+		if (n > 0) {
+			/* Skip data written */
+			size_t done = (size_t) n;
+
+			total -= done;
+			if (done >= iov[0].iov_len) {
+				sent += (ViUInt32) iov[0].iov_len;
+				done -= iov[0].iov_len;
+				iov[0] = iov[1];
+				iov[1].iov_len = 0;
+				--iovcnt;
+			} else {
+				sent += (ViUInt32) done;
+			}
+			iov[0].iov_base = (char*) iov[0].iov_base + done;
+			iov[0].iov_len -= done;
+		} else if (n < 0 && (EAGAIN == errno || EWOULDBLOCK == errno)) {
+			status = waitVisaNativeFd(s->fd, POLLOUT, (ViUInt32) timeLeft(s->timeout, start));
+			if (status < 0) {
+				break;
+			}
+		} else if (n < 0 && EINTR != errno) {
+			status = errnoToVisaStatus(errno);
+			break;
+		}
+	}
+
+	Tcl_MutexUnlock(&s->writeMutex);
+
+	if (retCount) {
+		/* Termination character appended is not counted */
+		*retCount = sent < count ? sent : count;
+	}
+	return status;
+}
+
+/* Status byte of message-based device without serial poll is queried like VISA does */
+ViStatus readVisaNativeSTB(VisaNativeSession* s, ViUInt16* stb) {
+	static const char query[] = "*STB?\n";
+	ViByte buf[32];
+	ViUInt32 count;
+	ViStatus status;
+
+	status = writeVisaNative(s, query, sizeof(query) - 1, NULL);
+	if (status < 0) {
+		return status;
+	}
+
+	status = readVisaNative(s, buf, sizeof(buf) - 1, '\n', &count);
+	if (status < 0) {
+		return status;
+	}
+
+	buf[count] = 0;
+	*stb = (ViUInt16) strtoul((const char*) buf, NULL, 10);
+	return VI_SUCCESS;
+}
+
+ViStatus assertVisaNativeTrigger(VisaNativeSession* s, ViUInt16 protocol) {
+	static const char command[] = "*TRG\n";
+
+	if (VI_TRIG_PROT_DEFAULT != protocol) {
+		return VI_ERROR_INV_PROT;
+	}
+	return writeVisaNative(s, command, sizeof(command) - 1, NULL);
+}
+
+/* Discards data received but not read yet */
+static void discardInput(VisaNativeSession* s) {
+	char buf[VISA_NATIVE_BUF_SIZE];
+
+	Tcl_MutexLock(&s->readMutex);
+	s->pendingPos = s->pendingLen = 0;
+	while (read(s->fd, buf, sizeof(buf)) > 0) {
+	}
+	Tcl_MutexUnlock(&s->readMutex);
+}
+
+static int readTermChar(VisaNativeSession* s) {
+	return s->termCharEn || s->endInTermChar ? s->termChar : -1;
+}
+
+/* Resource type may transfer data its own way */
+static ViStatus readSession(VisaNativeSession* s, ViPBuf buf, ViUInt32 count, ViUInt32* retCount) {
+	if (s->type->read) {
+		return s->type->read(s, buf, count, readTermChar(s), retCount);
+	}
+	return readVisaNative(s, buf, count, readTermChar(s), retCount);
+}
+
+static ViStatus writeSession(VisaNativeSession* s, const char* buf, ViUInt32 count, ViUInt32* retCount) {
+	if (s->type->write) {
+		return s->type->write(s, buf, count, retCount);
+	}
+	return writeVisaNative(s, buf, count, retCount);
+}
+
+int getVisaNativeHandle(ViSession vi) {
+	VisaNativeSession* s = getNativeSession(vi);
+	return s && s->type ? s->fd : -1;
+}
+
+int isVisaNativeInputPending(ViSession vi) {
+	VisaNativeSession* s = getNativeSession(vi);
+	return s && (s->pendingPos < s->pendingLen || s->responsePending);
+}
+
+/*
+ * Replacements of VISA functions
+ */
+
+#define LIBRARY(name) (*visaLibraryApi()->name)
+
+/* Returns native instrument session or passes call to VISA library */
+#define NATIVE_SESSION(s, vi, name, args) \
+	VisaNativeSession* s = getNativeSession(vi); \
+	if (NULL == s) { \
+		return LIBRARY(name) args; \
+	} \
+	if (NULL == s->type) { \
+		return VI_ERROR_NSUP_OPER; \
+	}
+
+/* Operation is not supported for native sessions */
+#define NOT_SUPPORTED(name, vi, args) \
+	if (NULL != getNativeSession(vi)) { \
+		return VI_ERROR_NSUP_OPER; \
+	} \
+	return LIBRARY(name) args;
+
+static ViStatus _VI_FUNC native_viAssertIntrSignal(ViSession vi, ViInt16 mode, ViUInt32 statusID) {
+	NOT_SUPPORTED(viAssertIntrSignal, vi, (vi, mode, statusID))
+}
+
+static ViStatus _VI_FUNC native_viAssertTrigger(ViSession vi, ViUInt16 protocol) {
+	NATIVE_SESSION(s, vi, viAssertTrigger, (vi, protocol))
+	return s->type->assertTrigger ? s->type->assertTrigger(s, protocol) : VI_ERROR_NSUP_OPER;
+}
+
+static ViStatus _VI_FUNC native_viAssertUtilSignal(ViSession vi, ViUInt16 line) {
+	NOT_SUPPORTED(viAssertUtilSignal, vi, (vi, line))
+}
+
+static ViStatus _VI_FUNC native_viClear(ViSession vi) {
+	NATIVE_SESSION(s, vi, viClear, (vi))
+	if (s->type->clear) {
+		return s->type->clear(s);
+	}
+	discardInput(s);
+	return VI_SUCCESS;
+}
+
+static ViStatus _VI_FUNC native_viClose(ViObject vi) {
+	VisaNativeSession* s = getNativeSession(vi);
+
+	if (NULL == s) {
+		return LIBRARY(viClose)(vi);
+	}
+
+	closeSession(s);
+	return VI_SUCCESS;
+}
+
+static ViStatus _VI_FUNC native_viDisableEvent(ViSession vi, ViEventType eventType, ViUInt16 mechanism) {
+	NOT_SUPPORTED(viDisableEvent, vi, (vi, eventType, mechanism))
+}
+
+static ViStatus _VI_FUNC native_viEnableEvent(ViSession vi, ViEventType eventType, ViUInt16 mechanism, ViEventFilter context) {
+	NOT_SUPPORTED(viEnableEvent, vi, (vi, eventType, mechanism, context))
+}
+
+static ViStatus _VI_FUNC native_viFindNext(ViFindList vi, ViChar desc[]) {
+	return LIBRARY(viFindNext)(vi, desc);
+}
+
+static ViStatus _VI_FUNC native_viFindRsrc(ViSession sesn, ViString expr, ViFindList* vi, ViUInt32* retCnt, ViChar desc[]) {
+	if (NULL != getNativeSession(sesn)) {
+		/* Native resources are not discoverable */
+		return VI_ERROR_RSRC_NFOUND;
+	}
+	return LIBRARY(viFindRsrc)(sesn, expr, vi, retCnt, desc);
+}
+
+static ViStatus _VI_FUNC native_viFlush(ViSession vi, ViUInt16 mask) {
+	NATIVE_SESSION(s, vi, viFlush, (vi, mask))
+
+	/* Output is not buffered, input buffer can be discarded */
+	if (mask & (VI_READ_BUF_DISCARD | VI_IO_IN_BUF_DISCARD)) {
+		Tcl_MutexLock(&s->readMutex);
+		s->pendingPos = s->pendingLen = 0;
+		Tcl_MutexUnlock(&s->readMutex);
+	}
+	return VI_SUCCESS;
+}
+
+static ViStatus _VI_FUNC native_viGetAttribute(ViObject vi, ViAttr attrName, void* attrValue) {
+	NATIVE_SESSION(s, vi, viGetAttribute, (vi, attrName, attrValue))
+
+	switch (attrName) {
+	case VI_ATTR_TMO_VALUE:
+		*(ViUInt32*) attrValue = s->timeout;
+		return VI_SUCCESS;
+	case VI_ATTR_TERMCHAR:
+		*(ViUInt8*) attrValue = s->termChar;
+		return VI_SUCCESS;
+	case VI_ATTR_TERMCHAR_EN:
+		*(ViBoolean*) attrValue = s->termCharEn;
+		return VI_SUCCESS;
+	case VI_ATTR_SEND_END_EN:
+		*(ViBoolean*) attrValue = s->sendEndEn;
+		return VI_SUCCESS;
+	case VI_ATTR_SUPPRESS_END_EN:
+		*(ViBoolean*) attrValue = s->suppressEndEn;
+		return VI_SUCCESS;
+	case VI_ATTR_INTF_TYPE:
+		*(ViUInt16*) attrValue = s->type->intfType;
+		return VI_SUCCESS;
+	case VI_ATTR_INTF_NUM:
+		*(ViUInt16*) attrValue = s->intfNum;
+		return VI_SUCCESS;
+	case VI_ATTR_RSRC_NAME:
+		strncpy((char*) attrValue, s->rsrcName, VI_FIND_BUFLEN - 1);
+		((char*) attrValue)[VI_FIND_BUFLEN - 1] = 0;
+		return VI_SUCCESS;
+	default:
+		return s->type->getAttribute ? s->type->getAttribute(s, attrName, attrValue) : VI_ERROR_NSUP_ATTR;
+	}
+}
+
+static ViStatus _VI_FUNC native_viGpibCommand(ViSession vi, ViBuf cmd, ViUInt32 cnt, ViUInt32* retCnt) {
+	NOT_SUPPORTED(viGpibCommand, vi, (vi, cmd, cnt, retCnt))
+}
+
+static ViStatus _VI_FUNC native_viGpibControlATN(ViSession vi, ViUInt16 mode) {
+	NOT_SUPPORTED(viGpibControlATN, vi, (vi, mode))
+}
+
+static ViStatus _VI_FUNC native_viGpibControlREN(ViSession vi, ViUInt16 mode) {
+	NOT_SUPPORTED(viGpibControlREN, vi, (vi, mode))
+}
+
+static ViStatus _VI_FUNC native_viGpibPassControl(ViSession vi, ViUInt16 primAddr, ViUInt16 secAddr) {
+	NOT_SUPPORTED(viGpibPassControl, vi, (vi, primAddr, secAddr))
+}
+
+static ViStatus _VI_FUNC native_viGpibSendIFC(ViSession vi) {
+	NOT_SUPPORTED(viGpibSendIFC, vi, (vi))
+}
+
+static ViStatus _VI_FUNC native_viInstallHandler(ViSession vi, ViEventType eventType, ViHndlr handler, ViAddr userHandle) {
+	NOT_SUPPORTED(viInstallHandler, vi, (vi, eventType, handler, userHandle))
+}
+
+static ViStatus _VI_FUNC native_viLock(ViSession vi, ViAccessMode lockType, ViUInt32 timeout, ViKeyId requestedKey, ViChar accessKey[]) {
+	NOT_SUPPORTED(viLock, vi, (vi, lockType, timeout, requestedKey, accessKey))
+}
+
+static ViStatus _VI_FUNC native_viOpen(ViSession sesn, ViRsrc name, ViAccessMode mode, ViUInt32 timeout, ViSession* vi) {
+	if (isVisaNativeEnabled() && isVisaSocketResource(name)) {
+		return openVisaSocket(name, timeout, vi);
+	}
+	if (isVisaNativeEnabled() && isVisaSerialResource(name)) {
+		return openVisaSerial(name, mode, vi);
+	}
+	if (isVisaNativeEnabled() && isVisaUsbtmcResource(name)) {
+		return openVisaUsbtmc(name, vi);
+	}
+	if (NULL != getNativeSession(sesn)) {
+		/* Resource manager without VISA library opens native resources only */
+		return VI_ERROR_RSRC_NFOUND;
+	}
+	return LIBRARY(viOpen)(sesn, name, mode, timeout, vi);
+}
+
+static ViStatus _VI_FUNC native_viOpenDefaultRM(ViSession* vi) {
+	ViStatus status = LIBRARY(viOpenDefaultRM)(vi);
+	VisaNativeSession* s;
+
+	if (VI_ERROR_LIBRARY_NFOUND == status && isVisaNativeEnabled()) {
+		/* Native resources can be used without VISA library */
+		status = createVisaNativeSession(NULL, "", -1, NULL, &s);
+		if (status >= 0) {
+			*vi = s->vi;
+		}
+	}
+
+	return status;
+}
+
+static ViStatus _VI_FUNC native_viParseRsrc(ViSession rmSesn, ViRsrc rsrcName, ViUInt16* intfType, ViUInt16* intfNum) {
+	NOT_SUPPORTED(viParseRsrc, rmSesn, (rmSesn, rsrcName, intfType, intfNum))
+}
+
+static ViStatus _VI_FUNC native_viParseRsrcEx(ViSession rmSesn, ViRsrc rsrcName, ViUInt16* intfType, ViUInt16* intfNum, ViChar rsrcClass[], ViChar expandedUnaliasedName[], ViChar aliasIfExists[]) {
+	NOT_SUPPORTED(viParseRsrcEx, rmSesn, (rmSesn, rsrcName, intfType, intfNum, rsrcClass, expandedUnaliasedName, aliasIfExists))
+}
+
+static ViStatus _VI_FUNC native_viRead(ViSession vi, ViPBuf buf, ViUInt32 cnt, ViUInt32* retCnt) {
+	NATIVE_SESSION(s, vi, viRead, (vi, buf, cnt, retCnt))
+	return readSession(s, buf, cnt, retCnt);
+}
+
+static ViStatus _VI_FUNC native_viReadSTB(ViSession vi, ViUInt16* status) {
+	NATIVE_SESSION(s, vi, viReadSTB, (vi, status))
+	return s->type->readSTB ? s->type->readSTB(s, status) : VI_ERROR_NSUP_OPER;
+}
+
+static ViStatus _VI_FUNC native_viReadToFile(ViSession vi, const char* filename, ViUInt32 cnt, ViUInt32* retCnt) {
+	ViStatus status;
+	ViPBuf buf;
+	FILE* f;
+
+	NATIVE_SESSION(s, vi, viReadToFile, (vi, filename, cnt, retCnt))
+
+	buf = (ViPBuf) malloc(cnt ? cnt : 1);
+	if (NULL == buf) {
+		return VI_ERROR_ALLOC;
+	}
+
+	status = readSession(s, buf, cnt, retCnt);
+	if (status >= 0 || VI_ERROR_TMO == status) {
+		f = fopen(filename, "wb");
+		if (NULL == f) {
+			status = VI_ERROR_FILE_ACCESS;
+		} else {
+			if (fwrite(buf, 1, *retCnt, f) != *retCnt) {
+				status = VI_ERROR_FILE_IO;
+			}
+			fclose(f);
+		}
+	}
+
+	free(buf);
+	return status;
+}
+
+static ViStatus _VI_FUNC native_viSetAttribute(ViObject vi, ViAttr attrName, ViAttrState attrValue) {
+	NATIVE_SESSION(s, vi, viSetAttribute, (vi, attrName, attrValue))
+
+	switch (attrName) {
+	case VI_ATTR_TMO_VALUE:
+		s->timeout = (ViUInt32) attrValue;
+		return VI_SUCCESS;
+	case VI_ATTR_TERMCHAR:
+		s->termChar = (ViUInt8) attrValue;
+		return VI_SUCCESS;
+	case VI_ATTR_TERMCHAR_EN:
+		s->termCharEn = attrValue ? VI_TRUE : VI_FALSE;
+		return VI_SUCCESS;
+	case VI_ATTR_SEND_END_EN:
+		s->sendEndEn = attrValue ? VI_TRUE : VI_FALSE;
+		return VI_SUCCESS;
+	case VI_ATTR_SUPPRESS_END_EN:
+		s->suppressEndEn = attrValue ? VI_TRUE : VI_FALSE;
+		return VI_SUCCESS;
+	default:
+		return s->type->setAttribute ? s->type->setAttribute(s, attrName, attrValue) : VI_ERROR_NSUP_ATTR;
+	}
+}
+
+static ViStatus _VI_FUNC native_viTerminate(ViObject vi, ViUInt16 degree, ViJobId jobId) {
+	NOT_SUPPORTED(viTerminate, vi, (vi, degree, jobId))
+}
+
+static ViStatus _VI_FUNC native_viUninstallHandler(ViSession vi, ViEventType eventType, ViHndlr handler, ViAddr userHandle) {
+	NOT_SUPPORTED(viUninstallHandler, vi, (vi, eventType, handler, userHandle))
+}
+
+static ViStatus _VI_FUNC native_viUnlock(ViSession vi) {
+	NOT_SUPPORTED(viUnlock, vi, (vi))
+}
+
+static ViStatus _VI_FUNC native_viWaitOnEvent(ViSession vi, ViEventType inEventType, ViUInt32 timeout, ViEventType* outEventType, ViEvent* outContext) {
+	NOT_SUPPORTED(viWaitOnEvent, vi, (vi, inEventType, timeout, outEventType, outContext))
+}
+
+static ViStatus _VI_FUNC native_viWrite(ViSession vi, ViBuf buf, ViUInt32 cnt, ViUInt32* retCnt) {
+	NATIVE_SESSION(s, vi, viWrite, (vi, buf, cnt, retCnt))
+	return writeSession(s, (const char*) buf, cnt, retCnt);
+}
+
+static ViStatus _VI_FUNC native_viWriteFromFile(ViSession vi, const char* filename, ViUInt32 cnt, ViUInt32* retCnt) {
+	ViStatus status;
+	char* buf;
+	size_t len;
+	FILE* f;
+
+	NATIVE_SESSION(s, vi, viWriteFromFile, (vi, filename, cnt, retCnt))
+
+	f = fopen(filename, "rb");
+	if (NULL == f) {
+		return VI_ERROR_FILE_ACCESS;
+	}
+
+	buf = (char*) malloc(cnt ? cnt : 1);
+	if (NULL == buf) {
+		fclose(f);
+		return VI_ERROR_ALLOC;
+	}
+
+	len = fread(buf, 1, cnt, f);
+	fclose(f);
+
+	status = writeSession(s, buf, (ViUInt32) len, retCnt);
+	free(buf);
+	return status;
+}
+
+#define VISA_API(name, params) &native_##name,
+
+const VisaApi visaNativeApi = {
+	VISA_API_FUNCTIONS
+};
+
+#undef VISA_API
+
+#else /* TCLVISA_NATIVE */
+
+int isVisaNativeEnabled(void) {
+	return 0;
+}
+
+void setVisaNativeEnabled(int enabled) {
+	UNREFERENCED_PARAMETER(enabled);
+}
+
+int getVisaNativeHandle(ViSession vi) {
+	UNREFERENCED_PARAMETER(vi);
+	return -1;
+}
+
+int isVisaNativeInputPending(ViSession vi) {
+	UNREFERENCED_PARAMETER(vi);
+	return 0;
+}
+
+#endif /* TCLVISA_NATIVE */
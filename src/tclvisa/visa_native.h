@@ -0,0 +1,87 @@
+/*
+ * visa_native.h --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+#ifndef VISA_NATIVE_H_34237856365464
+#define VISA_NATIVE_H_34237856365464
+
+#include <tcl.h>
+#include <visa.h>
+#include "visa_api.h"
+
+/* Native session identifiers are taken from this range */
+#define VISA_NATIVE_SESSION_BASE ((ViSession) 0xFF000000UL)
+
+/* Size of read-ahead buffer of native session */
+#define VISA_NATIVE_BUF_SIZE 4096
+
+struct _VisaNativeSession;
+
+/* Operations specific to resource type, any of them may be NULL */
+typedef struct _VisaNativeType {
+	ViUInt16 intfType;
+	ViStatus (*setAttribute)(struct _VisaNativeSession* s, ViAttr attr, ViAttrState value);
+	ViStatus (*getAttribute)(struct _VisaNativeSession* s, ViAttr attr, void* value);
+	ViStatus (*readSTB)(struct _VisaNativeSession* s, ViUInt16* stb);
+	ViStatus (*assertTrigger)(struct _VisaNativeSession* s, ViUInt16 protocol);
+	ViStatus (*read)(struct _VisaNativeSession* s, ViPBuf buf, ViUInt32 count, int termChar, ViUInt32* retCount);
+	ViStatus (*write)(struct _VisaNativeSession* s, const char* buf, ViUInt32 count, ViUInt32* retCount);
+	ViStatus (*clear)(struct _VisaNativeSession* s);
+	void (*close)(struct _VisaNativeSession* s);
+} VisaNativeType;
+
+typedef struct _VisaNativeSession {
+	const VisaNativeType* type;	/* NULL for resource manager session */
+	ViSession vi;
+	int fd;
+	int isSocket;
+	char* rsrcName;
+	ViUInt16 intfNum;
+	ViUInt32 timeout;
+	ViUInt8 termChar;
+	ViBoolean termCharEn, sendEndEn, suppressEndEn;
+	short endOnIdle;	/* read completes when no more data is available */
+	short endInTermChar, endOutTermChar;	/* see VI_ATTR_ASRL_END_IN and VI_ATTR_ASRL_END_OUT */
+	short responsePending;	/* device answers on request only, response to last write is not read yet */
+	char pending[VISA_NATIVE_BUF_SIZE];	/* data received but not read yet */
+	size_t pendingPos, pendingLen;
+	Tcl_Mutex readMutex, writeMutex;
+	ClientData typeData;
+} VisaNativeSession;
+
+int isVisaNativeEnabled(void);
+void setVisaNativeEnabled(int enabled);
+
+ViStatus createVisaNativeSession(const VisaNativeType* type, const char* rsrcName, int fd, ClientData typeData, VisaNativeSession** sPtr);
+ViStatus readVisaNative(VisaNativeSession* s, ViPBuf buf, ViUInt32 count, int termChar, ViUInt32* retCount);
+ViStatus writeVisaNative(VisaNativeSession* s, const char* buf, ViUInt32 count, ViUInt32* retCount);
+ViStatus readVisaNativeSTB(VisaNativeSession* s, ViUInt16* stb);
+ViStatus assertVisaNativeTrigger(VisaNativeSession* s, ViUInt16 protocol);
+ViStatus waitVisaNativeFd(int fd, int events, ViUInt32 timeout);
+ViStatus errnoToVisaStatus(int err);
+
+int getVisaNativeHandle(ViSession vi);
+int isVisaNativeInputPending(ViSession vi);
+
+/* TCPIP::host::port::SOCKET resources, see visa_socket.c */
+int isVisaSocketResource(const char* rsrcName);
+ViStatus openVisaSocket(const char* rsrcName, ViUInt32 timeout, ViSession* vi);
+
+/* ASRLn::INSTR and ASRL/dev/path::INSTR resources, see visa_serial.c */
+int isVisaSerialResource(const char* rsrcName);
+ViStatus openVisaSerial(const char* rsrcName, ViAccessMode mode, ViSession* vi);
+
+/* USB[board]::vid::pid::serial::INSTR and USB/dev/usbtmcN::INSTR resources, see visa_usbtmc.c */
+int isVisaUsbtmcResource(const char* rsrcName);
+ViStatus openVisaUsbtmc(const char* rsrcName, ViSession* vi);
+
+#endif /* VISA_NATIVE_H_34237856365464 */
@@ -0,0 +1,89 @@
+/*
+ * visa_pool.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+/*
+ * Worker threads for slow VISA calls which wait for instruments, like
+ * viOpen(). Every thread takes the next job index until all jobs are done.
+ * Jobs must not touch Tcl interpreter or channels.
+ */
+
+#include <tcl.h>
+#include <string.h>
+#include "visa_pool.h"
+
+typedef struct _VisaPool {
+	Tcl_Mutex mutex;
+	int next;	/* index of next job */
+	int count;
+	VisaPoolJobProc* proc;
+	ClientData clientData;
+} VisaPool;
+
+static Tcl_ThreadCreateType workerProc(ClientData clientData) {
+	VisaPool* pool = (VisaPool*) clientData;
+
+	for (;;) {
+		int index;
+
+		Tcl_MutexLock(&pool->mutex);
+		index = pool->next < pool->count ? pool->next++ : -1;
+		Tcl_MutexUnlock(&pool->mutex);
+
+		if (index < 0) {
+			break;
+		}
+
+		pool->proc(pool->clientData, index);
+	}
+
+	TCL_THREAD_CREATE_RETURN;
+}
+
+void runVisaPool(VisaPoolJobProc* proc, ClientData clientData, int jobCount, int threadCount) {
+	VisaPool pool;
+	Tcl_ThreadId* threads;
+	int i, result, started = 0;
+
+	if (jobCount <= 0) {
+		return;
+	}
+
+	memset((void*) &pool, 0, sizeof(pool));
+	pool.count = jobCount;
+	pool.proc = proc;
+	pool.clientData = clientData;
+
+	if (threadCount > jobCount) {
+		threadCount = jobCount;
+	}
+
+	threads = (Tcl_ThreadId*) ckalloc(sizeof(Tcl_ThreadId) * threadCount);
+	for (i = 0; i < threadCount; ++i) {
+		if (TCL_OK != Tcl_CreateThread(&threads[i], workerProc, (ClientData) &pool, TCL_THREAD_STACK_DEFAULT, TCL_THREAD_JOINABLE)) {
+			break;
+		}
+		++started;
+	}
+
+	if (0 == started) {
+		/* No thread at all, do everything in this one */
+		workerProc((ClientData) &pool);
+	}
+
+	for (i = 0; i < started; ++i) {
+		Tcl_JoinThread(threads[i], &result);
+	}
+
+	Tcl_MutexFinalize(&pool.mutex);
+	ckfree((char*) threads);
+}
@@ -0,0 +1,25 @@
+/*
+ * visa_pool.h --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+#ifndef VISA_POOL_H_34237856365464
+#define VISA_POOL_H_34237856365464
+
+#include <tcl.h>
+
+#define VISA_POOL_DEFAULT_THREADS 8
+
+typedef void (VisaPoolJobProc)(ClientData clientData, int index);
+
+void runVisaPool(VisaPoolJobProc* proc, ClientData clientData, int jobCount, int threadCount);
+
+#endif /* VISA_POOL_H_34237856365464 */
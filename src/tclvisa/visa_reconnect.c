@@ -0,0 +1,253 @@
+/*
+ * visa_reconnect.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+/*
+ * Sessions opened with -reconnect option remember how they were opened and
+ * every attribute set through tclvisa. When connection is lost, session is
+ * re-opened with the same parameters and attributes are applied again,
+ * event queues are re-enabled and event handlers are installed again.
+ * Blocking channels wait for reconnection, non-blocking ones fail at once
+ * and are re-opened from a timer, so the event loop keeps running.
+ */
+
+#include <tcl.h>
+#include <visa.h>
+#include <stdlib.h>
+#include <string.h>
+#include "visa_reconnect.h"
+#include "visa_events.h"
+
+typedef struct _VisaAttrValue {
+	ViAttr attr;
+	ViAttrState value;
+} VisaAttrValue;
+
+typedef struct _VisaReconnect {
+	ViSession rm;
+	char* rsrcName;
+	ViAccessMode accessMode;
+	ViUInt32 openTimeout;
+	ViUInt32 backoff;	/* ms before first attempt, doubled after every failure */
+	int maxTries;
+	int count;	/* number of successful reconnects */
+	int lost;	/* session is closed and is not re-opened yet */
+	VisaAttrValue* attrs;	/* in order of first setting */
+	int attrCount, attrSize;
+	ViEventType* queues;	/* events enabled for queueing */
+	int queueCount, queueSize;
+
+	/* Retrying from timer, non-blocking channels only */
+	Tcl_TimerToken timer;
+	ViUInt32 delay;
+	int tries;
+} VisaReconnect;
+
+/* Longest pause between attempts, ms */
+#define MAX_BACKOFF 60000
+
+void enableVisaReconnect(VisaChannelData* data, ViSession rm, const char* rsrcName, ViAccessMode accessMode, ViUInt32 openTimeout, ViUInt32 backoff, int maxTries) {
+	VisaReconnect* r = (VisaReconnect*) malloc(sizeof(VisaReconnect));
+
+	memset((void*) r, 0, sizeof(*r));
+	r->rm = rm;
+	r->rsrcName = (char*) malloc(strlen(rsrcName) + 1);
+	strcpy(r->rsrcName, rsrcName);
+	r->accessMode = accessMode;
+	r->openTimeout = openTimeout;
+	r->backoff = backoff;
+	r->maxTries = maxTries;
+
+	freeVisaReconnect(data);
+	data->reconnect = r;
+}
+
+void freeVisaReconnect(VisaChannelData* data) {
+	VisaReconnect* r = data->reconnect;
+
+	if (r) {
+		if (r->timer) {
+			Tcl_DeleteTimerHandler(r->timer);
+		}
+		free((void*) r->rsrcName);
+		if (r->attrs) {
+			free((void*) r->attrs);
+		}
+		if (r->queues) {
+			free((void*) r->queues);
+		}
+		free((void*) r);
+		data->reconnect = NULL;
+	}
+}
+
+int getVisaReconnectCount(VisaChannelData* data) {
+	return data->reconnect ? data->reconnect->count : 0;
+}
+
+int isVisaSessionLost(VisaChannelData* data) {
+	return data->reconnect && data->reconnect->lost;
+}
+
+static void rememberAttribute(VisaReconnect* r, ViAttr attr, ViAttrState value) {
+	int i;
+
+	for (i = 0; i < r->attrCount; ++i) {
+		if (r->attrs[i].attr == attr) {
+			r->attrs[i].value = value;
+			return;
+		}
+	}
+
+	if (r->attrCount == r->attrSize) {
+		r->attrSize = r->attrSize ? r->attrSize * 2 : 8;
+		r->attrs = (VisaAttrValue*) realloc((void*) r->attrs, sizeof(VisaAttrValue) * r->attrSize);
+	}
+	r->attrs[r->attrCount].attr = attr;
+	r->attrs[r->attrCount].value = value;
+	++r->attrCount;
+}
+
+ViStatus setVisaAttribute(VisaChannelData* data, ViAttr attr, ViAttrState value) {
+	ViStatus status = viSetAttribute(data->session, attr, value);
+
+	if (status >= 0 && data->reconnect) {
+		rememberAttribute(data->reconnect, attr, value);
+	}
+
+	return status;
+}
+
+ViStatus enableVisaEventQueue(VisaChannelData* data, ViEventType eventType) {
+	ViStatus status = viEnableEvent(data->session, eventType, VI_QUEUE, VI_NULL);
+	VisaReconnect* r = data->reconnect;
+	int i;
+
+	if (status < 0 || NULL == r) {
+		return status;
+	}
+
+	for (i = 0; i < r->queueCount; ++i) {
+		if (r->queues[i] == eventType) {
+			return status;
+		}
+	}
+
+	if (r->queueCount == r->queueSize) {
+		r->queueSize = r->queueSize ? r->queueSize * 2 : 4;
+		r->queues = (ViEventType*) realloc((void*) r->queues, sizeof(ViEventType) * r->queueSize);
+	}
+	r->queues[r->queueCount++] = eventType;
+
+	return status;
+}
+
+/* Single attempt to open session again and restore its state */
+static int reopenSession(VisaChannelData* data) {
+	VisaReconnect* r = data->reconnect;
+	ViSession vi;
+	int i;
+
+	if (viOpen(r->rm, r->rsrcName, r->accessMode, r->openTimeout, &vi) < 0) {
+		return 0;
+	}
+
+	for (i = 0; i < r->attrCount; ++i) {
+		viSetAttribute(vi, r->attrs[i].attr, r->attrs[i].value);
+	}
+	for (i = 0; i < r->queueCount; ++i) {
+		viEnableEvent(vi, r->queues[i], VI_QUEUE, VI_NULL);
+	}
+
+	data->session = vi;
+	reinstallVisaEventHandlers(data);
+
+	data->messageEnd = 0;
+	r->lost = 0;
+	++r->count;
+	return 1;
+}
+
+static ViUInt32 nextDelay(ViUInt32 delay) {
+	return delay * 2 > MAX_BACKOFF ? MAX_BACKOFF : delay * 2;
+}
+
+static void retryProc(ClientData clientData) {
+	VisaChannelData* data = (VisaChannelData*) clientData;
+	VisaReconnect* r = data->reconnect;
+
+	r->timer = NULL;
+	if (reopenSession(data) || ++r->tries >= r->maxTries) {
+		return;
+	}
+
+	r->delay = nextDelay(r->delay);
+	r->timer = Tcl_CreateTimerHandler((int) r->delay, retryProc, (ClientData) data);
+}
+
+VisaChannelData* getConnectedVisaChannelFromObj(Tcl_Interp* const interp, Tcl_Obj* objPtr) {
+	VisaChannelData* data = getVisaChannelFromObj(interp, objPtr);
+
+	if (data && isVisaSessionLost(data) && !reconnectVisaSession(data)) {
+		storeLastError(data, VI_ERROR_CONN_LOST, interp);
+		return NULL;
+	}
+
+	return data;
+}
+
+int reconnectVisaSession(VisaChannelData* data) {
+	VisaReconnect* r = data->reconnect;
+	ViUInt32 backoff;
+	int i;
+
+	if (NULL == r) {
+		return 0;
+	}
+
+	if (data->stream) {
+		/* Reader thread of visa::stream uses the session, it has to be stopped first */
+		return 0;
+	}
+
+	if (!r->lost) {
+		/*
+		 * Old session is useless, but its resources must be released.
+		 * Its number may be given to another session, so it is forgotten.
+		 */
+		viClose(data->session);
+		data->session = VI_NULL;
+		r->lost = 1;
+	}
+
+	if (!data->blocking) {
+		/* Do not block event loop, next operation finds session re-opened */
+		if (NULL == r->timer && r->maxTries > 0) {
+			r->tries = 0;
+			r->delay = r->backoff;
+			r->timer = Tcl_CreateTimerHandler((int) r->delay, retryProc, (ClientData) data);
+		}
+		return 0;
+	}
+
+	backoff = r->backoff;
+	for (i = 0; i < r->maxTries; ++i) {
+		Tcl_Sleep((int) backoff);
+		backoff = nextDelay(backoff);
+
+		if (reopenSession(data)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
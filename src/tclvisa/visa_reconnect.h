@@ -0,0 +1,35 @@
+/*
+ * visa_reconnect.h --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+#ifndef VISA_RECONNECT_H_34237856365464
+#define VISA_RECONNECT_H_34237856365464
+
+#include <tcl.h>
+#include <visa.h>
+#include "visa_channel.h"
+
+void enableVisaReconnect(VisaChannelData* data, ViSession rm, const char* rsrcName, ViAccessMode accessMode, ViUInt32 openTimeout, ViUInt32 backoff, int maxTries);
+void freeVisaReconnect(VisaChannelData* data);
+int reconnectVisaSession(VisaChannelData* data);
+int getVisaReconnectCount(VisaChannelData* data);
+int isVisaSessionLost(VisaChannelData* data);
+
+/*
+ * Like getVisaChannelFromObj, but session lost by channel with -reconnect
+ * option is re-opened first. Fails with VI_ERROR_CONN_LOST if it cannot be.
+ */
+VisaChannelData* getConnectedVisaChannelFromObj(Tcl_Interp* const interp, Tcl_Obj* objPtr);
+ViStatus setVisaAttribute(VisaChannelData* data, ViAttr attr, ViAttrState value);
+ViStatus enableVisaEventQueue(VisaChannelData* data, ViEventType eventType);
+
+#endif /* VISA_RECONNECT_H_34237856365464 */
@@ -0,0 +1,550 @@
+/*
+ * visa_serial.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+/*
+ * Native serial sessions, see visa_native.c. Resource ASRLn::INSTR is
+ * device /dev/ttyS<n-1>, any other device is given by its path, like
+ * ASRL/dev/ttyUSB0::INSTR. VI_ATTR_ASRL_XXX attributes are mapped onto
+ * termios settings and modem control lines.
+ */
+
+#include <tcl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "visa_native.h"
+#include "tclvisa_utils.h"
+
+#ifdef TCLVISA_NATIVE
+
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+
+#define SERIAL_PREFIX "ASRL"
+#define SERIAL_SUFFIX "::INSTR"
+#define SERIAL_DEVICE_FORMAT "/dev/ttyS%u"
+
+typedef struct _SerialData {
+	ViUInt16 endIn, endOut;
+	ViBoolean breakState;
+} SerialData;
+
+static const struct {
+	ViUInt32 baud;
+	speed_t speed;
+} bauds[] = {
+	{50, B50}, {75, B75}, {110, B110}, {134, B134}, {150, B150}, {200, B200},
+	{300, B300}, {600, B600}, {1200, B1200}, {1800, B1800}, {2400, B2400},
+	{4800, B4800}, {9600, B9600}, {19200, B19200}, {38400, B38400},
+#ifdef B57600
+	{57600, B57600},
+#endif
+#ifdef B115200
+	{115200, B115200},
+#endif
+#ifdef B230400
+	{230400, B230400},
+#endif
+#ifdef B460800
+	{460800, B460800},
+#endif
+#ifdef B921600
+	{921600, B921600},
+#endif
+#ifdef B1000000
+	{1000000, B1000000},
+#endif
+#ifdef B2000000
+	{2000000, B2000000},
+#endif
+#ifdef B3000000
+	{3000000, B3000000},
+#endif
+#ifdef B4000000
+	{4000000, B4000000},
+#endif
+	{0, B0}
+};
+
+/* Finds device path, returns 0 if it is not a serial resource */
+static int parseSerialResource(const char* rsrcName, char* path, ViUInt16* board) {
+	const char* p;
+	size_t len = strlen(rsrcName);
+	size_t suffix = sizeof(SERIAL_SUFFIX) - 1;
+
+	if (strncasecmp(rsrcName, SERIAL_PREFIX, sizeof(SERIAL_PREFIX) - 1) != 0) {
+		return 0;
+	}
+	p = rsrcName + sizeof(SERIAL_PREFIX) - 1;
+
+	/* Resource class may be omitted */
+	if (len < suffix || strcasecmp(rsrcName + len - suffix, SERIAL_SUFFIX) != 0) {
+		suffix = 0;
+	}
+	len -= (size_t) (p - rsrcName) + suffix;
+
+	if ('/' == *p) {
+		if (len >= VI_FIND_BUFLEN || memchr(p, ':', len)) {
+			return 0;
+		}
+		memcpy(path, p, len);
+		path[len] = 0;
+		*board = 0;
+	} else {
+		char* end;
+		unsigned long n = strtoul(p, &end, 10);
+
+		if (end == p || (size_t) (end - p) != len || 0 == n) {
+			return 0;
+		}
+		sprintf(path, SERIAL_DEVICE_FORMAT, (unsigned) (n - 1));
+		*board = (ViUInt16) n;
+	}
+
+	return 1;
+}
+
+int isVisaSerialResource(const char* rsrcName) {
+	char path[VI_FIND_BUFLEN];
+	ViUInt16 board;
+
+	return parseSerialResource(rsrcName, path, &board);
+}
+
+static ViStatus getTermios(VisaNativeSession* s, struct termios* tio) {
+	return tcgetattr(s->fd, tio) < 0 ? errnoToVisaStatus(errno) : VI_SUCCESS;
+}
+
+static ViStatus setTermios(VisaNativeSession* s, const struct termios* tio) {
+	if (tcsetattr(s->fd, TCSANOW, tio) < 0) {
+		/* Device does not support the setting, e.g. parity on pseudo-terminal */
+		return EINVAL == errno ? VI_ERROR_NSUP_ATTR_STATE : errnoToVisaStatus(errno);
+	}
+	return VI_SUCCESS;
+}
+
+static ViStatus setBaud(struct termios* tio, ViUInt32 baud) {
+	int i;
+
+	for (i = 0; bauds[i].baud; ++i) {
+		if (bauds[i].baud == baud) {
+			cfsetispeed(tio, bauds[i].speed);
+			cfsetospeed(tio, bauds[i].speed);
+			return VI_SUCCESS;
+		}
+	}
+
+	return VI_ERROR_NSUP_ATTR_STATE;
+}
+
+static ViUInt32 getBaud(const struct termios* tio) {
+	speed_t speed = cfgetospeed(tio);
+	int i;
+
+	for (i = 0; bauds[i].baud; ++i) {
+		if (bauds[i].speed == speed) {
+			return bauds[i].baud;
+		}
+	}
+
+	return 0;
+}
+
+static ViStatus setParity(struct termios* tio, ViUInt16 parity) {
+	tio->c_cflag &= ~(PARENB | PARODD);
+#ifdef CMSPAR
+	tio->c_cflag &= ~CMSPAR;
+#endif
+
+	switch (parity) {
+	case VI_ASRL_PAR_NONE:
+		break;
+	case VI_ASRL_PAR_ODD:
+		tio->c_cflag |= PARENB | PARODD;
+		break;
+	case VI_ASRL_PAR_EVEN:
+		tio->c_cflag |= PARENB;
+		break;
+#ifdef CMSPAR
+	case VI_ASRL_PAR_MARK:
+		tio->c_cflag |= PARENB | PARODD | CMSPAR;
+		break;
+	case VI_ASRL_PAR_SPACE:
+		tio->c_cflag |= PARENB | CMSPAR;
+		break;
+#endif
+	default:
+		return VI_ERROR_NSUP_ATTR_STATE;
+	}
+
+	return VI_SUCCESS;
+}
+
+static ViUInt16 getParity(const struct termios* tio) {
+	if (!(tio->c_cflag & PARENB)) {
+		return VI_ASRL_PAR_NONE;
+	}
+#ifdef CMSPAR
+	if (tio->c_cflag & CMSPAR) {
+		return (tio->c_cflag & PARODD) ? VI_ASRL_PAR_MARK : VI_ASRL_PAR_SPACE;
+	}
+#endif
+	return (tio->c_cflag & PARODD) ? VI_ASRL_PAR_ODD : VI_ASRL_PAR_EVEN;
+}
+
+static ViStatus setDataBits(struct termios* tio, ViUInt16 bits) {
+	static const tcflag_t sizes[] = { CS5, CS6, CS7, CS8 };
+
+	if (bits < 5 || bits > 8) {
+		return VI_ERROR_NSUP_ATTR_STATE;
+	}
+	tio->c_cflag = (tio->c_cflag & ~CSIZE) | sizes[bits - 5];
+	return VI_SUCCESS;
+}
+
+static ViUInt16 getDataBits(const struct termios* tio) {
+	switch (tio->c_cflag & CSIZE) {
+	case CS5:
+		return 5;
+	case CS6:
+		return 6;
+	case CS7:
+		return 7;
+	default:
+		return 8;
+	}
+}
+
+static ViStatus setFlow(struct termios* tio, ViUInt16 flow) {
+	tio->c_iflag &= ~(IXON | IXOFF);
+#ifdef CRTSCTS
+	tio->c_cflag &= ~CRTSCTS;
+#endif
+
+	if (flow & VI_ASRL_FLOW_XON_XOFF) {
+		tio->c_iflag |= IXON | IXOFF;
+	}
+	if (flow & VI_ASRL_FLOW_RTS_CTS) {
+#ifdef CRTSCTS
+		tio->c_cflag |= CRTSCTS;
+#else
+		return VI_ERROR_NSUP_ATTR_STATE;
+#endif
+	}
+	if (flow & VI_ASRL_FLOW_DTR_DSR) {
+		/* Not supported by termios */
+		return VI_ERROR_NSUP_ATTR_STATE;
+	}
+
+	return VI_SUCCESS;
+}
+
+static ViUInt16 getFlow(const struct termios* tio) {
+	ViUInt16 flow = VI_ASRL_FLOW_NONE;
+
+	if (tio->c_iflag & IXON) {
+		flow |= VI_ASRL_FLOW_XON_XOFF;
+	}
+#ifdef CRTSCTS
+	if (tio->c_cflag & CRTSCTS) {
+		flow |= VI_ASRL_FLOW_RTS_CTS;
+	}
+#endif
+
+	return flow;
+}
+
+static ViStatus setModemLine(VisaNativeSession* s, int line, ViAttrState state) {
+	if (ioctl(s->fd, VI_STATE_ASSERTED == (ViInt16) state ? TIOCMBIS : TIOCMBIC, &line) < 0) {
+		return errnoToVisaStatus(errno);
+	}
+	return VI_SUCCESS;
+}
+
+static ViInt16 getModemLine(VisaNativeSession* s, int line) {
+	int lines;
+
+	if (ioctl(s->fd, TIOCMGET, &lines) < 0) {
+		/* Pseudo-terminals and some adapters have no modem lines */
+		return VI_STATE_UNKNOWN;
+	}
+	return (lines & line) ? VI_STATE_ASSERTED : VI_STATE_UNASSERTED;
+}
+
+static ViStatus serialSetAttribute(VisaNativeSession* s, ViAttr attr, ViAttrState value) {
+	SerialData* data = (SerialData*) s->typeData;
+	struct termios tio;
+	ViStatus status;
+
+	switch (attr) {
+	case VI_ATTR_ASRL_DTR_STATE:
+		return setModemLine(s, TIOCM_DTR, value);
+	case VI_ATTR_ASRL_RTS_STATE:
+		return setModemLine(s, TIOCM_RTS, value);
+
+	case VI_ATTR_ASRL_BREAK_STATE:
+		if (ioctl(s->fd, VI_STATE_ASSERTED == (ViInt16) value ? TIOCSBRK : TIOCCBRK) < 0) {
+			return errnoToVisaStatus(errno);
+		}
+		data->breakState = VI_STATE_ASSERTED == (ViInt16) value;
+		return VI_SUCCESS;
+
+	case VI_ATTR_ASRL_END_IN:
+		if (VI_ASRL_END_NONE != value && VI_ASRL_END_TERMCHAR != value) {
+			return VI_ERROR_NSUP_ATTR_STATE;
+		}
+		data->endIn = (ViUInt16) value;
+		s->endInTermChar = VI_ASRL_END_TERMCHAR == value;
+		return VI_SUCCESS;
+
+	case VI_ATTR_ASRL_END_OUT:
+		if (VI_ASRL_END_NONE != value && VI_ASRL_END_TERMCHAR != value) {
+			return VI_ERROR_NSUP_ATTR_STATE;
+		}
+		data->endOut = (ViUInt16) value;
+		s->endOutTermChar = VI_ASRL_END_TERMCHAR == value;
+		return VI_SUCCESS;
+
+	case VI_ATTR_ASRL_BAUD:
+	case VI_ATTR_ASRL_DATA_BITS:
+	case VI_ATTR_ASRL_PARITY:
+	case VI_ATTR_ASRL_STOP_BITS:
+	case VI_ATTR_ASRL_FLOW_CNTRL:
+	case VI_ATTR_ASRL_XON_CHAR:
+	case VI_ATTR_ASRL_XOFF_CHAR:
+		break;
+
+	default:
+		return VI_ERROR_NSUP_ATTR;
+	}
+
+	/* Line settings */
+	if ((status = getTermios(s, &tio)) < 0) {
+		return status;
+	}
+
+	switch (attr) {
+	case VI_ATTR_ASRL_BAUD:
+		status = setBaud(&tio, (ViUInt32) value);
+		break;
+	case VI_ATTR_ASRL_DATA_BITS:
+		status = setDataBits(&tio, (ViUInt16) value);
+		break;
+	case VI_ATTR_ASRL_PARITY:
+		status = setParity(&tio, (ViUInt16) value);
+		break;
+	case VI_ATTR_ASRL_STOP_BITS:
+		if (VI_ASRL_STOP_ONE == value) {
+			tio.c_cflag &= ~CSTOPB;
+		} else if (VI_ASRL_STOP_TWO == value) {
+			tio.c_cflag |= CSTOPB;
+		} else {
+			status = VI_ERROR_NSUP_ATTR_STATE;
+		}
+		break;
+	case VI_ATTR_ASRL_FLOW_CNTRL:
+		status = setFlow(&tio, (ViUInt16) value);
+		break;
+	case VI_ATTR_ASRL_XON_CHAR:
+		tio.c_cc[VSTART] = (cc_t) value;
+		break;
+	case VI_ATTR_ASRL_XOFF_CHAR:
+		tio.c_cc[VSTOP] = (cc_t) value;
+		break;
+	}
+
+	return status < 0 ? status : setTermios(s, &tio);
+}
+
+static ViStatus serialGetAttribute(VisaNativeSession* s, ViAttr attr, void* value) {
+	SerialData* data = (SerialData*) s->typeData;
+	struct termios tio;
+	ViStatus status;
+	int avail;
+
+	switch (attr) {
+	case VI_ATTR_ASRL_CTS_STATE:
+		*(ViInt16*) value = getModemLine(s, TIOCM_CTS);
+		return VI_SUCCESS;
+	case VI_ATTR_ASRL_DSR_STATE:
+		*(ViInt16*) value = getModemLine(s, TIOCM_DSR);
+		return VI_SUCCESS;
+	case VI_ATTR_ASRL_RI_STATE:
+		*(ViInt16*) value = getModemLine(s, TIOCM_RI);
+		return VI_SUCCESS;
+	case VI_ATTR_ASRL_DCD_STATE:
+		*(ViInt16*) value = getModemLine(s, TIOCM_CD);
+		return VI_SUCCESS;
+	case VI_ATTR_ASRL_DTR_STATE:
+		*(ViInt16*) value = getModemLine(s, TIOCM_DTR);
+		return VI_SUCCESS;
+	case VI_ATTR_ASRL_RTS_STATE:
+		*(ViInt16*) value = getModemLine(s, TIOCM_RTS);
+		return VI_SUCCESS;
+	case VI_ATTR_ASRL_BREAK_STATE:
+		*(ViInt16*) value = data->breakState ? VI_STATE_ASSERTED : VI_STATE_UNASSERTED;
+		return VI_SUCCESS;
+	case VI_ATTR_ASRL_END_IN:
+		*(ViUInt16*) value = data->endIn;
+		return VI_SUCCESS;
+	case VI_ATTR_ASRL_END_OUT:
+		*(ViUInt16*) value = data->endOut;
+		return VI_SUCCESS;
+
+	case VI_ATTR_ASRL_AVAIL_NUM:
+		/* Bytes in driver queue and in read buffer of the session */
+		if (ioctl(s->fd, FIONREAD, &avail) < 0) {
+			return errnoToVisaStatus(errno);
+		}
+		*(ViUInt32*) value = (ViUInt32) avail + (ViUInt32) (s->pendingLen - s->pendingPos);
+		return VI_SUCCESS;
+	}
+
+	if ((status = getTermios(s, &tio)) < 0) {
+		return status;
+	}
+
+	switch (attr) {
+	case VI_ATTR_ASRL_BAUD:
+		*(ViUInt32*) value = getBaud(&tio);
+		return VI_SUCCESS;
+	case VI_ATTR_ASRL_DATA_BITS:
+		*(ViUInt16*) value = getDataBits(&tio);
+		return VI_SUCCESS;
+	case VI_ATTR_ASRL_PARITY:
+		*(ViUInt16*) value = getParity(&tio);
+		return VI_SUCCESS;
+	case VI_ATTR_ASRL_STOP_BITS:
+		*(ViUInt16*) value = (tio.c_cflag & CSTOPB) ? VI_ASRL_STOP_TWO : VI_ASRL_STOP_ONE;
+		return VI_SUCCESS;
+	case VI_ATTR_ASRL_FLOW_CNTRL:
+		*(ViUInt16*) value = getFlow(&tio);
+		return VI_SUCCESS;
+	case VI_ATTR_ASRL_XON_CHAR:
+		*(ViUInt8*) value = (ViUInt8) tio.c_cc[VSTART];
+		return VI_SUCCESS;
+	case VI_ATTR_ASRL_XOFF_CHAR:
+		*(ViUInt8*) value = (ViUInt8) tio.c_cc[VSTOP];
+		return VI_SUCCESS;
+	default:
+		return VI_ERROR_NSUP_ATTR;
+	}
+}
+
+static void serialClose(VisaNativeSession* s) {
+	free(s->typeData);
+}
+
+static const VisaNativeType serialType = {
+	VI_INTF_ASRL,	/* intfType */
+	&serialSetAttribute,	/* setAttribute */
+	&serialGetAttribute,	/* getAttribute */
+	&readVisaNativeSTB,	/* readSTB */
+	&assertVisaNativeTrigger,	/* assertTrigger */
+	NULL,	/* read */
+	NULL,	/* write */
+	NULL,	/* clear */
+	&serialClose	/* close */
+};
+
+/* Asks driver to pass received bytes immediately instead of every few milliseconds */
+static void setLowLatency(int fd) {
+#if defined(TIOCGSERIAL) && defined(ASYNC_LOW_LATENCY)
+	struct serial_struct ss;
+
+	if (ioctl(fd, TIOCGSERIAL, &ss) == 0 && !(ss.flags & ASYNC_LOW_LATENCY)) {
+		ss.flags |= ASYNC_LOW_LATENCY;
+		ioctl(fd, TIOCSSERIAL, &ss);
+	}
+#else
+	UNREFERENCED_PARAMETER(fd);
+#endif
+}
+
+ViStatus openVisaSerial(const char* rsrcName, ViAccessMode mode, ViSession* vi) {
+	char path[VI_FIND_BUFLEN];
+	VisaNativeSession* s;
+	SerialData* data;
+	struct termios tio;
+	ViUInt16 board;
+	ViStatus status;
+	int fd;
+
+	if (!parseSerialResource(rsrcName, path, &board)) {
+		return VI_ERROR_INV_RSRC_NAME;
+	}
+
+	fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (fd < 0) {
+		return EBUSY == errno ? VI_ERROR_RSRC_BUSY : VI_ERROR_RSRC_NFOUND;
+	}
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+	if (tcgetattr(fd, &tio) < 0) {
+		/* Not a terminal */
+		close(fd);
+		return VI_ERROR_RSRC_NFOUND;
+	}
+
+	if ((mode & VI_EXCLUSIVE_LOCK) && ioctl(fd, TIOCEXCL) < 0) {
+		close(fd);
+		return VI_ERROR_RSRC_LOCKED;
+	}
+
+	/* Raw mode with VISA defaults: 9600 baud, 8 data bits, no parity, 1 stop bit, no flow control */
+	cfmakeraw(&tio);
+	tio.c_cflag |= CLOCAL | CREAD;
+	tio.c_cc[VMIN] = 0;
+	tio.c_cc[VTIME] = 0;
+	setBaud(&tio, 9600);
+	setDataBits(&tio, 8);
+	setParity(&tio, VI_ASRL_PAR_NONE);
+	tio.c_cflag &= ~CSTOPB;
+	setFlow(&tio, VI_ASRL_FLOW_NONE);
+	if (tcsetattr(fd, TCSANOW, &tio) < 0) {
+		close(fd);
+		return errnoToVisaStatus(errno);
+	}
+	setLowLatency(fd);
+
+	data = (SerialData*) malloc(sizeof(SerialData));
+	if (NULL == data) {
+		close(fd);
+		return VI_ERROR_ALLOC;
+	}
+	memset(data, 0, sizeof(*data));
+
+	status = createVisaNativeSession(&serialType, rsrcName, fd, (ClientData) data, &s);
+	if (status < 0) {
+		close(fd);
+		free(data);
+		return status;
+	}
+
+	/* Read ends at termination character like VISA ASRL default */
+	data->endIn = VI_ASRL_END_TERMCHAR;
+	data->endOut = VI_ASRL_END_NONE;
+	s->endInTermChar = 1;
+	s->intfNum = board;
+	*vi = s->vi;
+	return VI_SUCCESS;
+}
+
+#endif /* TCLVISA_NATIVE */
@@ -0,0 +1,252 @@
+/*
+ * visa_socket.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+/*
+ * Native TCPIP[board]::host::port::SOCKET sessions, see visa_native.c.
+ * Socket is non-blocking, Nagle algorithm is disabled like VISA does
+ * by default (VI_ATTR_TCPIP_NODELAY).
+ */
+
+#include <tcl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "visa_native.h"
+#include "tclvisa_utils.h"
+
+#ifdef TCLVISA_NATIVE
+
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define SOCKET_PREFIX "TCPIP"
+#define SOCKET_SUFFIX "::SOCKET"
+
+typedef struct _SocketData {
+	char host[VI_FIND_BUFLEN];
+	ViUInt16 port;
+} SocketData;
+
+/* Splits resource name into parts, returns 0 if it is not a socket resource */
+static int parseSocketResource(const char* rsrcName, ViUInt16* board, char* host, ViUInt16* port) {
+	const char* p = rsrcName;
+	const char* sep;
+	size_t len = strlen(rsrcName);
+	char* end;
+	unsigned long n;
+
+	if (strncasecmp(p, SOCKET_PREFIX, sizeof(SOCKET_PREFIX) - 1) != 0
+		|| len < sizeof(SOCKET_SUFFIX) - 1
+		|| strcasecmp(rsrcName + len - (sizeof(SOCKET_SUFFIX) - 1), SOCKET_SUFFIX) != 0) {
+		return 0;
+	}
+	p += sizeof(SOCKET_PREFIX) - 1;
+
+	/* Optional board number */
+	n = strtoul(p, &end, 10);
+	if (strncmp(end, "::", 2) != 0) {
+		return 0;
+	}
+	*board = (ViUInt16) n;
+	p = end + 2;
+
+	/* Host is everything up to port, IPv6 address may contain colons */
+	sep = rsrcName + len - (sizeof(SOCKET_SUFFIX) - 1);
+	while (sep > p && !(sep[-1] == ':' && sep > p + 1 && sep[-2] == ':')) {
+		--sep;
+	}
+	if (sep <= p + 2 || (size_t) (sep - 2 - p) >= VI_FIND_BUFLEN) {
+		return 0;
+	}
+	memcpy(host, p, (size_t) (sep - 2 - p));
+	host[sep - 2 - p] = 0;
+
+	n = strtoul(sep, &end, 10);
+	if (end == sep || strncmp(end, "::", 2) != 0 || n == 0 || n > 65535) {
+		return 0;
+	}
+	*port = (ViUInt16) n;
+
+	return 1;
+}
+
+int isVisaSocketResource(const char* rsrcName) {
+	char host[VI_FIND_BUFLEN];
+	ViUInt16 board, port;
+
+	return parseSocketResource(rsrcName, &board, host, &port);
+}
+
+static ViStatus setFlag(VisaNativeSession* s, int level, int option, ViAttrState value) {
+	int flag = value ? 1 : 0;
+
+	if (setsockopt(s->fd, level, option, &flag, sizeof(flag)) < 0) {
+		return errnoToVisaStatus(errno);
+	}
+	return VI_SUCCESS;
+}
+
+static ViStatus getFlag(VisaNativeSession* s, int level, int option, void* value) {
+	int flag = 0;
+	socklen_t len = sizeof(flag);
+
+	if (getsockopt(s->fd, level, option, &flag, &len) < 0) {
+		return errnoToVisaStatus(errno);
+	}
+	*(ViBoolean*) value = flag ? VI_TRUE : VI_FALSE;
+	return VI_SUCCESS;
+}
+
+static ViStatus socketSetAttribute(VisaNativeSession* s, ViAttr attr, ViAttrState value) {
+	switch (attr) {
+	case VI_ATTR_TCPIP_NODELAY:
+		return setFlag(s, IPPROTO_TCP, TCP_NODELAY, value);
+	case VI_ATTR_TCPIP_KEEPALIVE:
+		return setFlag(s, SOL_SOCKET, SO_KEEPALIVE, value);
+	default:
+		return VI_ERROR_NSUP_ATTR;
+	}
+}
+
+static ViStatus socketGetAttribute(VisaNativeSession* s, ViAttr attr, void* value) {
+	SocketData* data = (SocketData*) s->typeData;
+
+	switch (attr) {
+	case VI_ATTR_TCPIP_NODELAY:
+		return getFlag(s, IPPROTO_TCP, TCP_NODELAY, value);
+	case VI_ATTR_TCPIP_KEEPALIVE:
+		return getFlag(s, SOL_SOCKET, SO_KEEPALIVE, value);
+	case VI_ATTR_TCPIP_ADDR:
+		strcpy((char*) value, data->host);
+		return VI_SUCCESS;
+	case VI_ATTR_TCPIP_PORT:
+		*(ViUInt16*) value = data->port;
+		return VI_SUCCESS;
+	default:
+		return VI_ERROR_NSUP_ATTR;
+	}
+}
+
+static void socketClose(VisaNativeSession* s) {
+	free(s->typeData);
+}
+
+static const VisaNativeType socketType = {
+	VI_INTF_TCPIP,	/* intfType */
+	&socketSetAttribute,	/* setAttribute */
+	&socketGetAttribute,	/* getAttribute */
+	&readVisaNativeSTB,	/* readSTB */
+	&assertVisaNativeTrigger,	/* assertTrigger */
+	NULL,	/* read */
+	NULL,	/* write */
+	NULL,	/* clear */
+	&socketClose	/* close */
+};
+
+/* Non-blocking connect with timeout */
+static ViStatus connectSocket(const struct addrinfo* ai, ViUInt32 timeout, int* fdPtr) {
+	int fd, err = 0;
+	socklen_t len = sizeof(err);
+	ViStatus status;
+
+	fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+	if (fd < 0) {
+		return errnoToVisaStatus(errno);
+	}
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	if (connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+		if (EINPROGRESS != errno) {
+			close(fd);
+			return VI_ERROR_RSRC_NFOUND;
+		}
+
+		/* VISA open timeout is minimal time to wait, zero means default */
+		status = waitVisaNativeFd(fd, POLLOUT, timeout ? timeout : 2000);
+		if (status < 0) {
+			close(fd);
+			return VI_ERROR_TMO == status ? VI_ERROR_TMO : VI_ERROR_RSRC_NFOUND;
+		}
+		if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err) {
+			close(fd);
+			return VI_ERROR_RSRC_NFOUND;
+		}
+	}
+
+	*fdPtr = fd;
+	return VI_SUCCESS;
+}
+
+ViStatus openVisaSocket(const char* rsrcName, ViUInt32 timeout, ViSession* vi) {
+	struct addrinfo hints, *res, *ai;
+	char service[16];
+	VisaNativeSession* s;
+	SocketData* data;
+	ViUInt16 board;
+	ViStatus status = VI_ERROR_RSRC_NFOUND;
+	int fd = -1, flag = 1;
+
+	data = (SocketData*) malloc(sizeof(SocketData));
+	if (NULL == data) {
+		return VI_ERROR_ALLOC;
+	}
+	if (!parseSocketResource(rsrcName, &board, data->host, &data->port)) {
+		free(data);
+		return VI_ERROR_INV_RSRC_NAME;
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	sprintf(service, "%u", (unsigned) data->port);
+	if (getaddrinfo(data->host, service, &hints, &res) != 0) {
+		free(data);
+		return VI_ERROR_RSRC_NFOUND;
+	}
+
+	/* Try all addresses of the host */
+	for (ai = res; ai && status < 0; ai = ai->ai_next) {
+		status = connectSocket(ai, timeout, &fd);
+	}
+	freeaddrinfo(res);
+
+	if (status < 0) {
+		free(data);
+		return status;
+	}
+
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+	status = createVisaNativeSession(&socketType, rsrcName, fd, (ClientData) data, &s);
+	if (status < 0) {
+		close(fd);
+		free(data);
+		return status;
+	}
+
+	s->isSocket = 1;
+	s->endOnIdle = 1;
+	s->intfNum = board;
+	*vi = s->vi;
+	return VI_SUCCESS;
+}
+
+#endif /* TCLVISA_NATIVE */
@@ -0,0 +1,74 @@
+/*
+ * visa_stb.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+#include <tcl.h>
+#include <visa.h>
+#include "visa_api.h"
+#include "visa_stb.h"
+
+#ifdef _WINDOWS
+#include <windows.h>
+/* Windows sleeps whole milliseconds, shorter intervals are rounded up not to spin */
+#define sleepMicroseconds(us) Sleep((DWORD) ((us) < 1000 ? 1 : (us) / 1000))
+#else
+#include <unistd.h>
+#define sleepMicroseconds(us) usleep((useconds_t) (us))
+#endif
+
+/* Milliseconds elapsed since start */
+static ViUInt32 elapsed(const Tcl_Time* start) {
+	Tcl_Time now;
+
+	Tcl_GetTime(&now);
+	return (ViUInt32) ((now.sec - start->sec) * 1000 + (now.usec - start->usec) / 1000);
+}
+
+/*
+ * Waits until any bit of mask is set in status byte. Status byte is either
+ * polled every interval microseconds, or read when service request arrives.
+ * In the latter case caller must enable queue of service requests.
+ * Returns VI_ERROR_TMO if timeout (ms) expires.
+ */
+ViStatus waitVisaStb(ViSession vi, ViUInt16 mask, ViUInt32 timeout, ViUInt32 interval, int srq, ViUInt16* stb) {
+	Tcl_Time start;
+	ViStatus status;
+
+	Tcl_GetTime(&start);
+	for (;;) {
+		ViUInt32 spent;
+
+		status = viReadSTB(vi, stb);
+		if (status < 0 || (*stb & mask)) {
+			return status;
+		}
+
+		spent = elapsed(&start);
+		if (timeout != VI_TMO_INFINITE && spent >= timeout) {
+			return VI_ERROR_TMO;
+		}
+
+		if (srq) {
+			ViEvent context;
+			ViEventType eventType;
+
+			status = viWaitOnEvent(vi, VI_EVENT_SERVICE_REQ, timeout == VI_TMO_INFINITE ? VI_TMO_INFINITE : timeout - spent,
+				&eventType, &context);
+			if (status < 0) {
+				return status;
+			}
+			viClose(context);
+		} else {
+			sleepMicroseconds(interval);
+		}
+	}
+}
@@ -0,0 +1,24 @@
+/*
+ * visa_stb.h --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+#ifndef VISA_STB_H_34237856365464
+#define VISA_STB_H_34237856365464
+
+#include <visa.h>
+
+/* Default interval between two viReadSTB() calls, in microseconds */
+#define VISA_STB_DEFAULT_INTERVAL 1000
+
+ViStatus waitVisaStb(ViSession vi, ViUInt16 mask, ViUInt32 timeout, ViUInt32 interval, int srq, ViUInt16* stb);
+
+#endif /* VISA_STB_H_34237856365464 */
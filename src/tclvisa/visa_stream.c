@@ -0,0 +1,297 @@
+/*
+ * visa_stream.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+/*
+ * Continuous acquisition: a reader thread calls viRead() back to back and
+ * stores data into a ring buffer, Tcl thread takes data from it.
+ * The ring has a single producer and a single consumer, so it needs no lock:
+ * producer only advances head, consumer only advances tail.
+ */
+
+#include <tcl.h>
+#include <visa.h>
+#include <string.h>
+#include "visa_stream.h"
+#include "visa_utils.h"
+#include "tcl_utils.h"
+#include "tclvisa_utils.h"
+
+/* How long (ms) reader sleeps when ring is full in blocking mode */
+#define STREAM_FULL_SLEEP 1
+
+typedef struct _VisaStream {
+	ViSession session;
+	Tcl_ThreadId threadId;
+	char* ring;
+	char* scratch;	/* chunk read when ring is full and data are dropped */
+	ViUInt32 size;
+	ViUInt32 chunk;
+	int block;
+
+	/*
+	 * Free running positions, index in ring is position modulo size.
+	 * Size is a power of two, so the index stays continuous when
+	 * positions wrap around at 4 GB.
+	 */
+	volatile ViUInt32 head;	/* written by reader thread only */
+	volatile ViUInt32 tail;	/* written by Tcl thread only */
+	volatile int stop;
+	volatile int finished;
+	ViStatus status;	/* error which stopped reader thread */
+
+	/* Statistics, guarded by mutex */
+	Tcl_Mutex mutex;
+	Tcl_WideUInt bytes;
+	Tcl_WideUInt dropped;
+	ViUInt32 overruns;	/* times ring became full */
+	ViUInt32 maxFill;
+} VisaStream;
+
+static Tcl_ThreadCreateType readerProc(ClientData clientData) {
+	VisaStream* s = (VisaStream*) clientData;
+	int full = 0;
+
+	while (!loadAcquire(&s->stop)) {
+		ViUInt32 head = s->head;
+		ViUInt32 fill = head - loadAcquire(&s->tail);
+		ViUInt32 retCount = 0, count;
+		ViStatus status;
+		int drop = 0;
+
+		if (fill == s->size) {
+			if (!full) {
+				/* Overrun is counted once until consumer frees some space */
+				full = 1;
+				Tcl_MutexLock(&s->mutex);
+				++s->overruns;
+				Tcl_MutexUnlock(&s->mutex);
+			}
+			if (s->block) {
+				/* Let device or driver buffer data until consumer catches up */
+				Tcl_Sleep(STREAM_FULL_SLEEP);
+				continue;
+			}
+			drop = 1;
+		} else {
+			full = 0;
+		}
+
+		if (drop) {
+			status = viRead(s->session, (ViPBuf) s->scratch, s->chunk, &retCount);
+		} else {
+			/* Read directly into ring, up to its physical end or free space available */
+			ViUInt32 pos = head & (s->size - 1);
+			count = s->size - pos < s->chunk ? s->size - pos : s->chunk;
+			if (count > s->size - fill) {
+				count = s->size - fill;
+			}
+			status = viRead(s->session, (ViPBuf) (s->ring + pos), count, &retCount);
+			storeRelease(&s->head, head + retCount);
+			fill += retCount;
+		}
+
+		Tcl_MutexLock(&s->mutex);
+		s->bytes += retCount;
+		if (drop) {
+			s->dropped += retCount;
+		}
+		if (fill > s->maxFill) {
+			s->maxFill = fill;
+		}
+		Tcl_MutexUnlock(&s->mutex);
+
+		if (status < 0 && status != VI_ERROR_TMO) {
+			s->status = status;
+			break;
+		}
+	}
+
+	storeRelease(&s->finished, 1);
+	TCL_THREAD_CREATE_RETURN;
+}
+
+static VisaStream* getStream(Tcl_Interp* const interp, VisaChannelData* data) {
+	if (NULL == data->stream && interp) {
+		Tcl_AppendResult(interp, "stream is not started on channel \"", Tcl_GetChannelName(data->channel), "\"", NULL);
+	}
+	return data->stream;
+}
+
+int startVisaStream(Tcl_Interp* const interp, VisaChannelData* data, ViUInt32 chunk, ViUInt32 ringSize, int block) {
+	VisaStream* s;
+
+	if (data->stream) {
+		Tcl_AppendResult(interp, "stream is already started on channel \"", Tcl_GetChannelName(data->channel), "\"", NULL);
+		return TCL_ERROR;
+	}
+	if (TCL_OK != checkVisaChannelBusy(interp, data, 1)) {
+		return TCL_ERROR;
+	}
+
+	if (chunk == 0 || ringSize < chunk) {
+		Tcl_AppendResult(interp, "ring size must not be less than chunk size", NULL);
+		return TCL_ERROR;
+	}
+
+	if (ringSize & (ringSize - 1)) {
+		Tcl_AppendResult(interp, "ring size must be a power of two", NULL);
+		return TCL_ERROR;
+	}
+
+	/* Ring contents must fit into a single Tcl byte array */
+	if (ringSize > (ViUInt32) TCL_SIZE_MAX) {
+		Tcl_AppendResult(interp, "ring size is too large", NULL);
+		return TCL_ERROR;
+	}
+
+	/* Reader thread must return from viRead to notice stop request */
+	if (data->blocking) {
+		ViUInt32 timeout;
+
+		if (TCL_OK != getVisaTimeout(interp, data, &timeout)) {
+			return TCL_ERROR;
+		}
+		if (timeout == VI_TMO_INFINITE) {
+			Tcl_AppendResult(interp, "stream requires finite timeout on channel \"", Tcl_GetChannelName(data->channel), "\"", NULL);
+			return TCL_ERROR;
+		}
+	}
+
+	s = (VisaStream*) ckalloc(sizeof(VisaStream));
+	memset((void*) s, 0, sizeof(*s));
+	s->session = data->session;
+	s->size = ringSize;
+	s->chunk = chunk;
+	s->block = block;
+	s->ring = ckalloc(ringSize);
+	s->scratch = block ? NULL : ckalloc(chunk);
+
+	if (TCL_OK != Tcl_CreateThread(&s->threadId, readerProc, (ClientData) s, TCL_THREAD_STACK_DEFAULT, TCL_THREAD_JOINABLE)) {
+		Tcl_AppendResult(interp, "cannot create thread", NULL);
+		ckfree(s->ring);
+		if (s->scratch) {
+			ckfree(s->scratch);
+		}
+		ckfree((char*) s);
+		return TCL_ERROR;
+	}
+
+	data->stream = s;
+	return TCL_OK;
+}
+
+/* Moves up to maxBytes from ring to interpreter result */
+static void takeData(Tcl_Interp* const interp, VisaStream* s, ViUInt32 maxBytes) {
+	ViUInt32 tail = s->tail;
+	ViUInt32 count = loadAcquire(&s->head) - tail;
+	ViUInt32 pos = tail & (s->size - 1);
+	ViUInt32 first;
+	unsigned char* bytes;
+
+	if (count > maxBytes) {
+		count = maxBytes;
+	}
+
+	bytes = Tcl_SetByteArrayLength(Tcl_GetObjResult(interp), (Tcl_Size) count);
+	first = s->size - pos < count ? s->size - pos : count;
+	memcpy(bytes, s->ring + pos, first);
+	memcpy(bytes + first, s->ring, count - first);
+
+	storeRelease(&s->tail, tail + count);
+}
+
+int readVisaStream(Tcl_Interp* const interp, VisaChannelData* data, ViUInt32 maxBytes) {
+	VisaStream* s = getStream(interp, data);
+
+	if (NULL == s) {
+		return TCL_ERROR;
+	}
+
+	Tcl_SetObjResult(interp, Tcl_NewByteArrayObj(NULL, 0));
+
+	if (loadAcquire(&s->head) == s->tail && loadAcquire(&s->finished) && s->status < 0) {
+		/* All data are taken, report why reader has stopped */
+		Tcl_ResetResult(interp);
+		storeLastError(data, s->status, interp);
+		return TCL_ERROR;
+	}
+
+	takeData(interp, s, maxBytes);
+	return TCL_OK;
+}
+
+int getVisaStreamStats(Tcl_Interp* const interp, VisaChannelData* data) {
+	VisaStream* s = getStream(interp, data);
+	Tcl_Obj* res;
+	int finished;
+
+	if (NULL == s) {
+		return TCL_ERROR;
+	}
+
+	/* Reader's status is valid once it has finished */
+	finished = loadAcquire(&s->finished);
+	res = Tcl_NewListObj(0, NULL);
+
+	Tcl_MutexLock(&s->mutex);
+	Tcl_ListObjAppendElement(interp, res, Tcl_NewStringObj("bytes", -1));
+	Tcl_ListObjAppendElement(interp, res, Tcl_NewWideIntObj((Tcl_WideInt) s->bytes));
+	Tcl_ListObjAppendElement(interp, res, Tcl_NewStringObj("dropped", -1));
+	Tcl_ListObjAppendElement(interp, res, Tcl_NewWideIntObj((Tcl_WideInt) s->dropped));
+	Tcl_ListObjAppendElement(interp, res, Tcl_NewStringObj("overruns", -1));
+	Tcl_ListObjAppendElement(interp, res, Tcl_NewWideIntObj((Tcl_WideInt) s->overruns));
+	Tcl_ListObjAppendElement(interp, res, Tcl_NewStringObj("maxfill", -1));
+	Tcl_ListObjAppendElement(interp, res, Tcl_NewWideIntObj((Tcl_WideInt) s->maxFill));
+	Tcl_MutexUnlock(&s->mutex);
+
+	Tcl_ListObjAppendElement(interp, res, Tcl_NewStringObj("fill", -1));
+	Tcl_ListObjAppendElement(interp, res, Tcl_NewWideIntObj((Tcl_WideInt) (ViUInt32) (loadAcquire(&s->head) - s->tail)));
+	Tcl_ListObjAppendElement(interp, res, Tcl_NewStringObj("size", -1));
+	Tcl_ListObjAppendElement(interp, res, Tcl_NewWideIntObj((Tcl_WideInt) s->size));
+	Tcl_ListObjAppendElement(interp, res, Tcl_NewStringObj("running", -1));
+	Tcl_ListObjAppendElement(interp, res, Tcl_NewIntObj(!finished));
+	Tcl_ListObjAppendElement(interp, res, Tcl_NewStringObj("error", -1));
+	Tcl_ListObjAppendElement(interp, res, Tcl_NewStringObj(finished && s->status < 0 ? visaErrorMessage(s->status) : "", -1));
+
+	Tcl_SetObjResult(interp, res);
+	return TCL_OK;
+}
+
+int stopVisaStream(Tcl_Interp* const interp, VisaChannelData* data) {
+	VisaStream* s = getStream(interp, data);
+	int result;
+
+	if (NULL == s) {
+		return TCL_ERROR;
+	}
+
+	/* Reader finishes as soon as current viRead() returns */
+	storeRelease(&s->stop, 1);
+	Tcl_JoinThread(s->threadId, &result);
+
+	/* Return data not read yet */
+	if (interp) {
+		Tcl_SetObjResult(interp, Tcl_NewByteArrayObj(NULL, 0));
+		takeData(interp, s, s->size);
+	}
+
+	Tcl_MutexFinalize(&s->mutex);
+	ckfree(s->ring);
+	if (s->scratch) {
+		ckfree(s->scratch);
+	}
+	ckfree((char*) s);
+	data->stream = NULL;
+
+	return TCL_OK;
+}
@@ -0,0 +1,29 @@
+/*
+ * visa_stream.h --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+#ifndef VISA_STREAM_H_34237856365464
+#define VISA_STREAM_H_34237856365464
+
+#include <tcl.h>
+#include <visa.h>
+#include "visa_channel.h"
+
+#define VISA_STREAM_DEFAULT_CHUNK	4096
+#define VISA_STREAM_DEFAULT_RING_SIZE	(1024 * 1024)
+
+int startVisaStream(Tcl_Interp* const interp, VisaChannelData* data, ViUInt32 chunk, ViUInt32 ringSize, int block);
+int readVisaStream(Tcl_Interp* const interp, VisaChannelData* data, ViUInt32 maxBytes);
+int getVisaStreamStats(Tcl_Interp* const interp, VisaChannelData* data);
+int stopVisaStream(Tcl_Interp* const interp, VisaChannelData* data);
+
+#endif /* VISA_STREAM_H_34237856365464 */
@@ -0,0 +1,183 @@
+/*
+ * visa_transfer.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+/* Files larger than 2 GB on 32-bit systems */
+#ifndef _WINDOWS
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include <tcl.h>
+#include <visa.h>
+#include <stdio.h>
+#include "visa_api.h"
+#include "visa_transfer.h"
+
+#define MIN_COUNT(a, b) ((a) < (b) ? (a) : (b))
+
+/* Disables END for all chunks but the last one, returns previous setting */
+static ViBoolean holdEnd(ViSession vi) {
+	ViBoolean sendEnd = VI_FALSE;
+
+	if (viGetAttribute(vi, VI_ATTR_SEND_END_EN, &sendEnd) < 0) {
+		/* Cannot control END, send chunks as they are */
+		return VI_FALSE;
+	}
+	if (sendEnd) {
+		viSetAttribute(vi, VI_ATTR_SEND_END_EN, VI_FALSE);
+	}
+	return sendEnd;
+}
+
+static void releaseEnd(ViSession vi, ViBoolean sendEnd) {
+	if (sendEnd) {
+		viSetAttribute(vi, VI_ATTR_SEND_END_EN, VI_TRUE);
+	}
+}
+
+ViStatus readVisa(ViSession vi, unsigned char* buf, Tcl_WideUInt count, Tcl_WideUInt* retCount) {
+	ViStatus status;
+	ViUInt32 n;
+
+	*retCount = 0;
+	do {
+		n = 0;
+		status = viRead(vi, buf + *retCount, (ViUInt32) MIN_COUNT(count - *retCount, VISA_MAX_COUNT), &n);
+		*retCount += n;
+	} while (VI_SUCCESS_MAX_CNT == status && *retCount < count);
+
+	return status;
+}
+
+ViStatus writeVisa(ViSession vi, const unsigned char* buf, Tcl_WideUInt count, Tcl_WideUInt* retCount) {
+	ViStatus status;
+	ViBoolean sendEnd;
+	ViUInt32 n = 0;
+
+	if (count <= VISA_MAX_COUNT) {
+		status = viWrite(vi, (ViBuf) buf, (ViUInt32) count, &n);
+		*retCount = n;
+		return status;
+	}
+
+	*retCount = 0;
+	sendEnd = holdEnd(vi);
+	do {
+		ViUInt32 chunk = (ViUInt32) MIN_COUNT(count - *retCount, VISA_MAX_COUNT);
+
+		if (*retCount + chunk == count) {
+			releaseEnd(vi, sendEnd);
+			sendEnd = VI_FALSE;
+		}
+		n = 0;
+		status = viWrite(vi, (ViBuf) (buf + *retCount), chunk, &n);
+		*retCount += n;
+	} while (status >= 0 && *retCount < count);
+	releaseEnd(vi, sendEnd);
+
+	return status;
+}
+
+ViStatus readVisaToFile(ViSession vi, const char* fileName, Tcl_WideUInt count, Tcl_WideUInt* retCount) {
+	ViStatus status;
+	unsigned char* buf;
+	FILE* f;
+
+	if (count <= VISA_MAX_COUNT) {
+		ViUInt32 n = 0;
+
+		status = viReadToFile(vi, fileName, (ViUInt32) count, &n);
+		*retCount = n;
+		return status;
+	}
+
+	*retCount = 0;
+	f = fopen(fileName, "wb");
+	if (NULL == f) {
+		return VI_ERROR_FILE_ACCESS;
+	}
+
+	buf = (unsigned char*) ckalloc(VISA_FILE_CHUNK);
+	do {
+		ViUInt32 n = 0;
+
+		status = viRead(vi, buf, (ViUInt32) MIN_COUNT(count - *retCount, VISA_FILE_CHUNK), &n);
+		if (n > 0 && fwrite(buf, 1, n, f) != n) {
+			status = VI_ERROR_FILE_IO;
+			break;
+		}
+		*retCount += n;
+	} while (VI_SUCCESS_MAX_CNT == status && *retCount < count);
+	ckfree((char*) buf);
+
+	if (fclose(f) && status >= 0) {
+		status = VI_ERROR_FILE_IO;
+	}
+	return status;
+}
+
+ViStatus writeVisaFromFile(ViSession vi, const char* fileName, Tcl_WideUInt count, Tcl_WideUInt* retCount) {
+	ViStatus status = VI_SUCCESS;
+	ViBoolean sendEnd;
+	unsigned char* buf;
+	FILE* f;
+
+	if (count <= VISA_MAX_COUNT) {
+		ViUInt32 n = 0;
+
+		status = viWriteFromFile(vi, fileName, (ViUInt32) count, &n);
+		*retCount = n;
+		return status;
+	}
+
+	*retCount = 0;
+	f = fopen(fileName, "rb");
+	if (NULL == f) {
+		return VI_ERROR_FILE_ACCESS;
+	}
+
+	buf = (unsigned char*) ckalloc(VISA_FILE_CHUNK);
+	sendEnd = holdEnd(vi);
+	while (*retCount < count) {
+		size_t chunk = (size_t) MIN_COUNT(count - *retCount, VISA_FILE_CHUNK);
+		size_t got = fread(buf, 1, chunk, f);
+		ViUInt32 n = 0;
+		int c;
+
+		if (got < chunk && ferror(f)) {
+			status = VI_ERROR_FILE_IO;
+			break;
+		}
+
+		/* Last chunk carries END, file may be shorter than count */
+		if (got < chunk || *retCount + got == count || EOF == (c = getc(f))) {
+			releaseEnd(vi, sendEnd);
+			sendEnd = VI_FALSE;
+		} else {
+			ungetc(c, f);
+		}
+
+		if (0 == got) {
+			break;
+		}
+		status = viWrite(vi, (ViBuf) buf, (ViUInt32) got, &n);
+		*retCount += n;
+		if (status < 0 || got < chunk) {
+			break;
+		}
+	}
+	releaseEnd(vi, sendEnd);
+	ckfree((char*) buf);
+	fclose(f);
+
+	return status;
+}
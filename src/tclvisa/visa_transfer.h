@@ -0,0 +1,38 @@
+/*
+ * visa_transfer.h --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+#ifndef VISA_TRANSFER_H_34237856365464
+#define VISA_TRANSFER_H_34237856365464
+
+#include <tcl.h>
+#include <visa.h>
+
+/* Largest count single VISA call accepts */
+#ifndef VISA_MAX_COUNT
+#define VISA_MAX_COUNT ((Tcl_WideUInt) 0xFFFFFFFF)
+#endif
+
+/* Buffer size used when data larger than VISA_MAX_COUNT are copied to or from file */
+#define VISA_FILE_CHUNK (1024 * 1024)
+
+/*
+ * 64-bit versions of viRead, viWrite, viReadToFile and viWriteFromFile.
+ * Transfers larger than VISA_MAX_COUNT are split into several VISA calls,
+ * END is sent with the last chunk only.
+ */
+ViStatus readVisa(ViSession vi, unsigned char* buf, Tcl_WideUInt count, Tcl_WideUInt* retCount);
+ViStatus writeVisa(ViSession vi, const unsigned char* buf, Tcl_WideUInt count, Tcl_WideUInt* retCount);
+ViStatus readVisaToFile(ViSession vi, const char* fileName, Tcl_WideUInt count, Tcl_WideUInt* retCount);
+ViStatus writeVisaFromFile(ViSession vi, const char* fileName, Tcl_WideUInt count, Tcl_WideUInt* retCount);
+
+#endif /* VISA_TRANSFER_H_34237856365464 */
@@ -0,0 +1,448 @@
+/*
+ * visa_usbtmc.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+/*
+ * Native USB sessions served by Linux usbtmc driver, see visa_native.c.
+ * Resource USB[board]::vid::pid::serial[::intf]::INSTR is looked up
+ * in /sys/class/usbmisc, device node may also be given by its path,
+ * like USB/dev/usbtmc0::INSTR. Driver transfers whole messages, so
+ * read and write operations are passed to it directly.
+ */
+
+#include <tcl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "visa_native.h"
+#include "tclvisa_utils.h"
+
+#ifdef TCLVISA_NATIVE
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <strings.h>
+#include <sys/ioctl.h>
+#include <linux/usb/tmc.h>
+
+#define USBTMC_PREFIX "USB"
+#define USBTMC_SUFFIX "::INSTR"
+#define USBTMC_SYSFS_DIR "/sys/class/usbmisc"
+#define USBTMC_DEVICE_DIR "/dev/"
+
+/* Driver does not accept shorter timeout */
+#define USBTMC_MIN_TIMEOUT 100
+
+typedef struct _UsbtmcData {
+	ViUInt16 vendorId, productId, intfNum;
+	char serial[VI_FIND_BUFLEN];
+	ViUInt32 timeout;	/* timeout set in driver */
+	int termChar;	/* termination character set in driver, -1 if disabled */
+	ViBoolean sendEndEn;	/* EOM flag set in driver */
+} UsbtmcData;
+
+typedef struct _UsbtmcAddress {
+	ViUInt16 board;
+	unsigned long vendorId, productId;
+	char serial[VI_FIND_BUFLEN];
+	long intfNum;	/* -1 if not given */
+	char path[VI_FIND_BUFLEN];	/* device path if given instead of address */
+} UsbtmcAddress;
+
+/* Takes next "::"-separated part of resource name */
+static const char* nextPart(const char* p, const char* end, char* part, size_t size) {
+	const char* sep = p;
+	size_t len;
+
+	while (sep < end && !(sep[0] == ':' && sep + 1 < end && sep[1] == ':')) {
+		++sep;
+	}
+	len = (size_t) (sep - p);
+	if (0 == len || len >= size) {
+		return NULL;
+	}
+	memcpy(part, p, len);
+	part[len] = 0;
+	return sep < end ? sep + 2 : sep;
+}
+
+static int parseNumber(const char* s, unsigned long* value) {
+	char* end;
+
+	*value = strtoul(s, &end, 0);
+	return end != s && 0 == *end;
+}
+
+/* Splits resource name into parts, returns 0 if it is not a USB resource */
+static int parseUsbtmcResource(const char* rsrcName, UsbtmcAddress* addr) {
+	const char* p;
+	const char* end;
+	size_t len = strlen(rsrcName);
+	size_t suffix = sizeof(USBTMC_SUFFIX) - 1;
+	char part[VI_FIND_BUFLEN];
+	unsigned long n;
+	char* numEnd;
+
+	if (strncasecmp(rsrcName, USBTMC_PREFIX, sizeof(USBTMC_PREFIX) - 1) != 0) {
+		return 0;
+	}
+	p = rsrcName + sizeof(USBTMC_PREFIX) - 1;
+
+	/* Resource class may be omitted for device path only */
+	if (len < suffix || strcasecmp(rsrcName + len - suffix, USBTMC_SUFFIX) != 0) {
+		suffix = 0;
+	}
+	end = rsrcName + len - suffix;
+
+	memset(addr, 0, sizeof(*addr));
+	addr->intfNum = -1;
+
+	if ('/' == *p) {
+		len = (size_t) (end - p);
+		if (len >= VI_FIND_BUFLEN || memchr(p, ':', len)) {
+			return 0;
+		}
+		memcpy(addr->path, p, len);
+		addr->path[len] = 0;
+		return 1;
+	}
+
+	if (0 == suffix) {
+		return 0;
+	}
+
+	/* Optional board number */
+	n = strtoul(p, &numEnd, 10);
+	if (strncmp(numEnd, "::", 2) != 0) {
+		return 0;
+	}
+	addr->board = (ViUInt16) n;
+	p = numEnd + 2;
+
+	if (NULL == (p = nextPart(p, end, part, sizeof(part))) || !parseNumber(part, &addr->vendorId)
+		|| NULL == (p = nextPart(p, end, part, sizeof(part))) || !parseNumber(part, &addr->productId)
+		|| NULL == (p = nextPart(p, end, addr->serial, sizeof(addr->serial)))) {
+		return 0;
+	}
+
+	if (p < end) {
+		/* USB interface number */
+		if (NULL == (p = nextPart(p, end, part, sizeof(part))) || p < end || !parseNumber(part, &n)) {
+			return 0;
+		}
+		addr->intfNum = (long) n;
+	}
+
+	return 1;
+}
+
+int isVisaUsbtmcResource(const char* rsrcName) {
+	UsbtmcAddress addr;
+
+	return parseUsbtmcResource(rsrcName, &addr);
+}
+
+/* Reads first line of sysfs file, trailing newline is removed */
+static int readSysfs(const char* dev, const char* name, char* buf, size_t size) {
+	char path[VI_FIND_BUFLEN * 2];
+	FILE* f;
+	size_t len;
+
+	sprintf(path, "%s/%s/device/%s", USBTMC_SYSFS_DIR, dev, name);
+	f = fopen(path, "r");
+	if (NULL == f) {
+		return 0;
+	}
+	if (NULL == fgets(buf, (int) size, f)) {
+		fclose(f);
+		return 0;
+	}
+	fclose(f);
+
+	len = strlen(buf);
+	while (len > 0 && (buf[len - 1] == '\n' || buf[len - 1] == '\r')) {
+		buf[--len] = 0;
+	}
+	return 1;
+}
+
+static unsigned long readSysfsNumber(const char* dev, const char* name, int base) {
+	char buf[32];
+
+	return readSysfs(dev, name, buf, sizeof(buf)) ? strtoul(buf, NULL, base) : 0;
+}
+
+/* Fills USB identification of device node, interface directory is linked as "device" */
+static void readDeviceInfo(const char* dev, UsbtmcData* data) {
+	data->vendorId = (ViUInt16) readSysfsNumber(dev, "../idVendor", 16);
+	data->productId = (ViUInt16) readSysfsNumber(dev, "../idProduct", 16);
+	data->intfNum = (ViUInt16) readSysfsNumber(dev, "bInterfaceNumber", 16);
+	if (!readSysfs(dev, "../serial", data->serial, sizeof(data->serial))) {
+		data->serial[0] = 0;
+	}
+}
+
+/* Finds device node of instrument with given address */
+static int findDevice(const UsbtmcAddress* addr, char* path, UsbtmcData* data) {
+	DIR* dir = opendir(USBTMC_SYSFS_DIR);
+	struct dirent* entry;
+	int found = 0;
+
+	if (NULL == dir) {
+		return 0;
+	}
+
+	while (!found && NULL != (entry = readdir(dir))) {
+		if (strncmp(entry->d_name, "usbtmc", 6) != 0 || strlen(entry->d_name) >= VI_FIND_BUFLEN - sizeof(USBTMC_DEVICE_DIR)) {
+			continue;
+		}
+
+		readDeviceInfo(entry->d_name, data);
+		if (data->vendorId == addr->vendorId && data->productId == addr->productId
+			&& strcasecmp(data->serial, addr->serial) == 0
+			&& (addr->intfNum < 0 || data->intfNum == addr->intfNum)) {
+			sprintf(path, "%s%s", USBTMC_DEVICE_DIR, entry->d_name);
+			found = 1;
+		}
+	}
+
+	closedir(dir);
+	return found;
+}
+
+static ViStatus usbtmcStatus(int err) {
+	return ETIMEDOUT == err ? VI_ERROR_TMO : errnoToVisaStatus(err);
+}
+
+/* Passes session settings to driver when they change */
+static void applySettings(VisaNativeSession* s, int termChar) {
+	UsbtmcData* data = (UsbtmcData*) s->typeData;
+
+	if (data->timeout != s->timeout) {
+		__u32 timeout = s->timeout < USBTMC_MIN_TIMEOUT ? USBTMC_MIN_TIMEOUT : s->timeout;
+
+		if (0 == ioctl(s->fd, USBTMC_IOCTL_SET_TIMEOUT, &timeout)) {
+			data->timeout = s->timeout;
+		}
+	}
+
+	if (data->termChar != termChar) {
+		struct usbtmc_termchar tc;
+
+		/* Device without termination character capability ends messages by EOM only */
+		tc.term_char = (__u8) (termChar >= 0 ? termChar : s->termChar);
+		tc.term_char_enabled = termChar >= 0 ? 1 : 0;
+		ioctl(s->fd, USBTMC_IOCTL_CONFIG_TERMCHAR, &tc);
+		data->termChar = termChar;
+	}
+
+	if (data->sendEndEn != s->sendEndEn) {
+		__u8 eom = s->sendEndEn ? 1 : 0;
+
+		if (0 == ioctl(s->fd, USBTMC_IOCTL_EOM_ENABLE, &eom)) {
+			data->sendEndEn = s->sendEndEn;
+		}
+	}
+}
+
+/* Driver reads until end of message, buffer is full or termination character is received */
+static ViStatus usbtmcRead(VisaNativeSession* s, ViPBuf buf, ViUInt32 count, int termChar, ViUInt32* retCount) {
+	ViStatus status;
+	ssize_t n;
+
+	Tcl_MutexLock(&s->readMutex);
+	applySettings(s, termChar);
+
+	do {
+		n = read(s->fd, buf, count);
+	} while (n < 0 && EINTR == errno);
+
+	if (n < 0) {
+		status = usbtmcStatus(errno);
+		n = 0;
+	} else if (termChar >= 0 && n > 0 && buf[n - 1] == (ViByte) termChar) {
+		status = VI_SUCCESS_TERM_CHAR;
+		s->responsePending = 0;
+	} else if ((ViUInt32) n == count) {
+		/* Rest of the message is read by next call */
+		status = VI_SUCCESS_MAX_CNT;
+	} else {
+		status = VI_SUCCESS;
+		s->responsePending = 0;
+	}
+
+	Tcl_MutexUnlock(&s->readMutex);
+
+	if (retCount) {
+		*retCount = (ViUInt32) n;
+	}
+	return status;
+}
+
+static ViStatus usbtmcWrite(VisaNativeSession* s, const char* buf, ViUInt32 count, ViUInt32* retCount) {
+	ViStatus status = VI_SUCCESS;
+	ssize_t n;
+
+	Tcl_MutexLock(&s->writeMutex);
+	applySettings(s, ((UsbtmcData*) s->typeData)->termChar);
+
+	do {
+		n = write(s->fd, buf, count);
+	} while (n < 0 && EINTR == errno);
+
+	if (n < 0) {
+		status = usbtmcStatus(errno);
+		n = 0;
+	} else {
+		/* Instrument answers only when asked, response is requested by read */
+		s->responsePending = 1;
+	}
+
+	Tcl_MutexUnlock(&s->writeMutex);
+
+	if (retCount) {
+		*retCount = (ViUInt32) n;
+	}
+	return status;
+}
+
+static ViStatus usbtmcClear(VisaNativeSession* s) {
+	s->responsePending = 0;
+	return ioctl(s->fd, USBTMC_IOCTL_CLEAR) < 0 ? usbtmcStatus(errno) : VI_SUCCESS;
+}
+
+static ViStatus usbtmcReadSTB(VisaNativeSession* s, ViUInt16* stb) {
+	unsigned char value;
+
+	if (ioctl(s->fd, USBTMC488_IOCTL_READ_STB, &value) < 0) {
+		return usbtmcStatus(errno);
+	}
+	*stb = value;
+	return VI_SUCCESS;
+}
+
+static ViStatus usbtmcAssertTrigger(VisaNativeSession* s, ViUInt16 protocol) {
+	if (VI_TRIG_PROT_DEFAULT != protocol) {
+		return VI_ERROR_INV_PROT;
+	}
+	return ioctl(s->fd, USBTMC488_IOCTL_TRIGGER) < 0 ? usbtmcStatus(errno) : VI_SUCCESS;
+}
+
+static ViStatus usbtmcGetAttribute(VisaNativeSession* s, ViAttr attr, void* value) {
+	UsbtmcData* data = (UsbtmcData*) s->typeData;
+
+	switch (attr) {
+	case VI_ATTR_MANF_ID:
+		*(ViUInt16*) value = data->vendorId;
+		return VI_SUCCESS;
+	case VI_ATTR_MODEL_CODE:
+		*(ViUInt16*) value = data->productId;
+		return VI_SUCCESS;
+	case VI_ATTR_USB_SERIAL_NUM:
+		strcpy((char*) value, data->serial);
+		return VI_SUCCESS;
+	case VI_ATTR_USB_INTFC_NUM:
+		*(ViInt16*) value = (ViInt16) data->intfNum;
+		return VI_SUCCESS;
+	default:
+		return VI_ERROR_NSUP_ATTR;
+	}
+}
+
+static void usbtmcClose(VisaNativeSession* s) {
+	free(s->typeData);
+}
+
+static const VisaNativeType usbtmcType = {
+	VI_INTF_USB,	/* intfType */
+	NULL,	/* setAttribute */
+	&usbtmcGetAttribute,	/* getAttribute */
+	&usbtmcReadSTB,	/* readSTB */
+	&usbtmcAssertTrigger,	/* assertTrigger */
+	&usbtmcRead,	/* read */
+	&usbtmcWrite,	/* write */
+	&usbtmcClear,	/* clear */
+	&usbtmcClose	/* close */
+};
+
+ViStatus openVisaUsbtmc(const char* rsrcName, ViSession* vi) {
+	UsbtmcAddress addr;
+	char path[VI_FIND_BUFLEN];
+	VisaNativeSession* s;
+	UsbtmcData* data;
+	ViStatus status;
+	int fd;
+
+	if (!parseUsbtmcResource(rsrcName, &addr)) {
+		return VI_ERROR_INV_RSRC_NAME;
+	}
+
+	data = (UsbtmcData*) malloc(sizeof(UsbtmcData));
+	if (NULL == data) {
+		return VI_ERROR_ALLOC;
+	}
+	memset(data, 0, sizeof(*data));
+
+	if (addr.path[0]) {
+		const char* dev = strrchr(addr.path, '/') + 1;
+
+		strcpy(path, addr.path);
+		readDeviceInfo(dev, data);
+	} else if (!findDevice(&addr, path, data)) {
+		free(data);
+		return VI_ERROR_RSRC_NFOUND;
+	}
+
+	/* Driver blocks until message is transferred or its own timeout expires */
+	fd = open(path, O_RDWR);
+	if (fd < 0) {
+		free(data);
+		return EBUSY == errno ? VI_ERROR_RSRC_BUSY : VI_ERROR_RSRC_NFOUND;
+	}
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+	status = createVisaNativeSession(&usbtmcType, rsrcName, fd, (ClientData) data, &s);
+	if (status < 0) {
+		close(fd);
+		free(data);
+		return status;
+	}
+
+	/* Settings are passed to driver before first transfer */
+	data->timeout = 0;
+	data->termChar = -2;
+	data->sendEndEn = s->sendEndEn ? VI_FALSE : VI_TRUE;
+	s->intfNum = addr.board;
+	*vi = s->vi;
+	return VI_SUCCESS;
+}
+
+#else /* __linux__ */
+
+int isVisaUsbtmcResource(const char* rsrcName) {
+	UNREFERENCED_PARAMETER(rsrcName);
+	return 0;
+}
+
+ViStatus openVisaUsbtmc(const char* rsrcName, ViSession* vi) {
+	UNREFERENCED_PARAMETER(rsrcName);
+	UNREFERENCED_PARAMETER(vi);
+	return VI_ERROR_NSUP_OPER;
+}
+
+#endif /* __linux__ */
+
+#endif /* TCLVISA_NATIVE */
@@ -12,6 +12,7 @@
  */
 
 #include "visa_utils.h"
+#include "visa_api.h"
 
 const char* visaErrorMessage(ViStatus status) {
 	switch (status) {
@@ -92,8 +93,11 @@ const char* visaErrorMessage(ViStatus status) {
 		return "[VI_ERROR_IO] Could not perform read/write operation because of I/O error.";
 #endif
 #ifdef VI_ERROR_LIBRARY_NFOUND
-	case VI_ERROR_LIBRARY_NFOUND:
-		return "[VI_ERROR_LIBRARY_NFOUND] A code library required by VISA could not be located or loaded.";
+	case VI_ERROR_LIBRARY_NFOUND: {
+		/* Tell why VISA library could not be loaded */
+		const char* loadError = getVisaApiError();
+		return loadError ? loadError : "[VI_ERROR_LIBRARY_NFOUND] A code library required by VISA could not be located or loaded.";
+	}
 #endif
 #ifdef VI_ERROR_NCIC
 	case VI_ERROR_NCIC:
@@ -21,5 +21,7 @@
 
 const char* visaErrorMessage(ViStatus status);
 const char* tclvisaErrorMessage(int error);
+int lookupVisaConstant(const char* name, int* value);
+const char* findVisaConstantName(const char* prefix, int value);
 
 #endif /* VISA_UTILS_H_34237856365464 */
@@ -0,0 +1,192 @@
+/*
+ * visa_waveform.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+/*
+ * Sample conversion and statistics over whole chunks of a waveform.
+ * Loops have no calls and branches inside, so that compiler is able to
+ * vectorize them. Samples are assembled from bytes in the order given,
+ * which works regardless of byte order of the host.
+ */
+
+#include <tcl.h>
+#include <visa.h>
+#include <string.h>
+#include <math.h>
+#include "visa_waveform.h"
+
+const char* visaSampleTypes[] = {
+	"int8", "uint8", "int16", "uint16", "int32", "uint32", "float32", "float64", NULL
+};
+
+static const int sampleSizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+
+#define BE16(p) ((unsigned) (p)[0] << 8 | (p)[1])
+#define LE16(p) ((unsigned) (p)[1] << 8 | (p)[0])
+#define BE32(p) ((ViUInt32) (p)[0] << 24 | (ViUInt32) (p)[1] << 16 | (ViUInt32) (p)[2] << 8 | (p)[3])
+#define LE32(p) ((ViUInt32) (p)[3] << 24 | (ViUInt32) (p)[2] << 16 | (ViUInt32) (p)[1] << 8 | (p)[0])
+#define BE64(p) ((Tcl_WideUInt) BE32(p) << 32 | BE32((p) + 4))
+#define LE64(p) ((Tcl_WideUInt) LE32((p) + 4) << 32 | LE32(p))
+
+#define CONVERT(size, expr) \
+	for (i = 0; i < count; ++i) { \
+		const unsigned char* p = raw + i * (size); \
+		out[i] = (double) (expr) * scale + offset; \
+	}
+
+static ViReal32 toFloat32(ViUInt32 bits) {
+	ViReal32 f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+static ViReal64 toFloat64(Tcl_WideUInt bits) {
+	ViReal64 f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+int getVisaSampleSize(int type) {
+	return sampleSizes[type];
+}
+
+void convertVisaSamples(int type, int bigEndian, const unsigned char* raw, size_t count, double scale, double offset, double* out) {
+	size_t i;
+
+	switch (type) {
+	case SAMPLE_INT8:
+		CONVERT(1, (ViInt8) p[0]);
+		break;
+
+	case SAMPLE_UINT8:
+		CONVERT(1, p[0]);
+		break;
+
+	case SAMPLE_INT16:
+		if (bigEndian) {
+			CONVERT(2, (ViInt16) BE16(p));
+		} else {
+			CONVERT(2, (ViInt16) LE16(p));
+		}
+		break;
+
+	case SAMPLE_UINT16:
+		if (bigEndian) {
+			CONVERT(2, BE16(p));
+		} else {
+			CONVERT(2, LE16(p));
+		}
+		break;
+
+	case SAMPLE_INT32:
+		if (bigEndian) {
+			CONVERT(4, (ViInt32) BE32(p));
+		} else {
+			CONVERT(4, (ViInt32) LE32(p));
+		}
+		break;
+
+	case SAMPLE_UINT32:
+		if (bigEndian) {
+			CONVERT(4, BE32(p));
+		} else {
+			CONVERT(4, LE32(p));
+		}
+		break;
+
+	case SAMPLE_FLOAT32:
+		if (bigEndian) {
+			CONVERT(4, toFloat32(BE32(p)));
+		} else {
+			CONVERT(4, toFloat32(LE32(p)));
+		}
+		break;
+
+	case SAMPLE_FLOAT64:
+		if (bigEndian) {
+			CONVERT(8, toFloat64(BE64(p)));
+		} else {
+			CONVERT(8, toFloat64(LE64(p)));
+		}
+		break;
+	}
+}
+
+void storeVisaSamples(int type, const double* samples, size_t count, unsigned char* packed) {
+	size_t i;
+
+	if (SAMPLE_FLOAT64 == type) {
+		memcpy(packed, samples, count * sizeof(double));
+	} else {
+		ViReal32* out = (ViReal32*) packed;
+
+		for (i = 0; i < count; ++i) {
+			out[i] = (ViReal32) samples[i];
+		}
+	}
+}
+
+void initVisaWaveStats(VisaWaveStats* stats) {
+	stats->count = 0;
+	stats->min = HUGE_VAL;
+	stats->max = -HUGE_VAL;
+	stats->sum = stats->sumSquares = 0.0;
+}
+
+void addVisaWaveStats(VisaWaveStats* stats, const double* samples, size_t count) {
+	/* Four independent accumulators keep pipeline busy */
+	double min[4], max[4], sum[4] = { 0.0, 0.0, 0.0, 0.0 }, sq[4] = { 0.0, 0.0, 0.0, 0.0 };
+	size_t i, j;
+
+	for (j = 0; j < 4; ++j) {
+		min[j] = stats->min;
+		max[j] = stats->max;
+	}
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		for (j = 0; j < 4; ++j) {
+			double v = samples[i + j];
+			min[j] = v < min[j] ? v : min[j];
+			max[j] = v > max[j] ? v : max[j];
+			sum[j] += v;
+			sq[j] += v * v;
+		}
+	}
+	for (j = 0; i < count; ++i, ++j) {
+		double v = samples[i];
+		min[j] = v < min[j] ? v : min[j];
+		max[j] = v > max[j] ? v : max[j];
+		sum[j] += v;
+		sq[j] += v * v;
+	}
+
+	for (j = 0; j < 4; ++j) {
+		stats->min = min[j] < stats->min ? min[j] : stats->min;
+		stats->max = max[j] > stats->max ? max[j] : stats->max;
+		stats->sum += sum[j];
+		stats->sumSquares += sq[j];
+	}
+	stats->count += (Tcl_WideInt) count;
+}
+
+Tcl_Obj* newVisaWaveStatsObj(const VisaWaveStats* stats) {
+	Tcl_Obj* res = Tcl_NewDictObj();
+	int empty = 0 == stats->count;
+
+	Tcl_DictObjPut(NULL, res, Tcl_NewStringObj("count", -1), Tcl_NewWideIntObj(stats->count));
+	Tcl_DictObjPut(NULL, res, Tcl_NewStringObj("min", -1), Tcl_NewDoubleObj(empty ? 0.0 : stats->min));
+	Tcl_DictObjPut(NULL, res, Tcl_NewStringObj("max", -1), Tcl_NewDoubleObj(empty ? 0.0 : stats->max));
+	Tcl_DictObjPut(NULL, res, Tcl_NewStringObj("mean", -1), Tcl_NewDoubleObj(empty ? 0.0 : stats->sum / (double) stats->count));
+	Tcl_DictObjPut(NULL, res, Tcl_NewStringObj("rms", -1), Tcl_NewDoubleObj(empty ? 0.0 : sqrt(stats->sumSquares / (double) stats->count)));
+
+	return res;
+}
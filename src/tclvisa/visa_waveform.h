@@ -0,0 +1,45 @@
+/*
+ * visa_waveform.h --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+#ifndef VISA_WAVEFORM_H_34237856365464
+#define VISA_WAVEFORM_H_34237856365464
+
+#include <tcl.h>
+#include <stddef.h>
+
+/* Sample types, in the same order as names in visaSampleTypes */
+enum VisaSampleType {
+	SAMPLE_INT8, SAMPLE_UINT8, SAMPLE_INT16, SAMPLE_UINT16, SAMPLE_INT32, SAMPLE_UINT32, SAMPLE_FLOAT32, SAMPLE_FLOAT64
+};
+
+extern const char* visaSampleTypes[];
+
+/* Running statistics of converted samples */
+typedef struct _VisaWaveStats {
+	Tcl_WideInt count;
+	double min, max, sum, sumSquares;
+} VisaWaveStats;
+
+int getVisaSampleSize(int type);
+
+/* Converts count samples to y = raw * scale + offset */
+void convertVisaSamples(int type, int bigEndian, const unsigned char* raw, size_t count, double scale, double offset, double* out);
+
+/* Stores count samples into float32 or float64 packed buffer in native byte order */
+void storeVisaSamples(int type, const double* samples, size_t count, unsigned char* packed);
+
+void initVisaWaveStats(VisaWaveStats* stats);
+void addVisaWaveStats(VisaWaveStats* stats, const double* samples, size_t count);
+Tcl_Obj* newVisaWaveStatsObj(const VisaWaveStats* stats);
+
+#endif /* VISA_WAVEFORM_H_34237856365464 */
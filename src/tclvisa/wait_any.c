@@ -0,0 +1,331 @@
+/*
+ * wait_any.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+/*
+ * Every session is watched by its own thread blocked in viWaitOnEvent().
+ * The first thread which gets an event wakes up the caller, which aborts
+ * the other waits by viTerminate(), then all threads make one more
+ * non-blocking check and finish, so that every session ready at the moment
+ * is reported. viTerminate() aborts every call made on the session, so
+ * sessions used by stream or asynchronous job, as well as sessions of
+ * libraries which cannot terminate, are polled in short slices instead.
+ */
+
+#include <tcl.h>
+#include <string.h>
+#include "visa_channel.h"
+#include "visa_events.h"
+#include "visa_reconnect.h"
+#include "visa_utils.h"
+#include "tcl_utils.h"
+#include "tclvisa_utils.h"
+
+/* How often (ms) threads which cannot be terminated check whether they should stop */
+#define WAIT_SLICE 20
+
+/* How often (ms) viTerminate() is repeated for thread which has not entered viWaitOnEvent() yet */
+#define TERMINATE_RETRY 10
+
+typedef struct _WaitGroup {
+	Tcl_Mutex mutex;
+	Tcl_Condition cond;
+	ViUInt32 timeout;	/* of a single wait of thread which can be terminated */
+	int ready;	/* number of sessions got an event or an error */
+	int finished;	/* number of threads finished */
+	int stop;	/* waiting is over, threads should finish */
+} WaitGroup;
+
+typedef struct _SessionWaiter {
+	WaitGroup* group;
+	VisaChannelData* data;
+	ViEventType eventType;
+	ViEventType outEventType;
+	ViStatus status;
+	int abortable;	/* wait can be aborted by viTerminate() */
+	int ready;
+	int finished;
+	Tcl_ThreadId threadId;
+} SessionWaiter;
+
+static Tcl_ThreadCreateType waiterProc(ClientData clientData) {
+	SessionWaiter* w = (SessionWaiter*) clientData;
+	WaitGroup* g = w->group;
+	ViEvent context;
+	int stop;
+
+	for (;;) {
+		Tcl_MutexLock(&g->mutex);
+		stop = g->stop;
+		Tcl_MutexUnlock(&g->mutex);
+
+		w->status = viWaitOnEvent(w->data->session, w->eventType, stop ? 0 : w->abortable ? g->timeout : WAIT_SLICE,
+			&w->outEventType, &context);
+		if (w->status >= 0) {
+			viClose(context);
+		}
+
+		if (w->status != VI_ERROR_TMO && w->status != VI_ERROR_ABORT) {
+			w->ready = 1;
+			Tcl_MutexLock(&g->mutex);
+			++g->ready;
+			Tcl_ConditionNotify(&g->cond);
+			Tcl_MutexUnlock(&g->mutex);
+			break;
+		}
+
+		if (stop) {
+			break;
+		}
+	}
+
+	Tcl_MutexLock(&g->mutex);
+	w->finished = 1;
+	++g->finished;
+	Tcl_ConditionNotify(&g->cond);
+	Tcl_MutexUnlock(&g->mutex);
+
+	TCL_THREAD_CREATE_RETURN;
+}
+
+/* Returns non-zero if deadline has passed, otherwise fills time left */
+static int timeLeft(const Tcl_Time* deadline, Tcl_Time* left) {
+	Tcl_Time now;
+
+	Tcl_GetTime(&now);
+	left->sec = deadline->sec - now.sec;
+	left->usec = deadline->usec - now.usec;
+	if (left->usec < 0) {
+		left->usec += 1000000;
+		--left->sec;
+	}
+
+	return left->sec < 0 || (left->sec == 0 && left->usec == 0);
+}
+
+static int parseEvents(Tcl_Interp* const interp, Tcl_Obj* listObj, ViEventType** types, int* count) {
+	Tcl_Obj** elems;
+	int i;
+
+	if (TCL_OK != Tcl_ListObjGetElements(interp, listObj, count, &elems)) {
+		return TCL_ERROR;
+	}
+	if (*count == 0) {
+		Tcl_AppendResult(interp, "empty event list", NULL);
+		return TCL_ERROR;
+	}
+
+	*types = (ViEventType*) ckalloc(sizeof(ViEventType) * *count);
+	for (i = 0; i < *count; ++i) {
+		if (TCL_OK != getVisaEventTypeFromObj(interp, elems[i], &(*types)[i])) {
+			ckfree((char*) *types);
+			*types = NULL;
+			return TCL_ERROR;
+		}
+	}
+
+	return TCL_OK;
+}
+
+int tclvisa_wait_any(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]) {
+	static const char* options[] = {"-events", "-timeout", NULL};
+	enum { OPT_EVENTS, OPT_TIMEOUT };
+
+	ViEventType defaultType = VI_EVENT_SERVICE_REQ;
+	ViEventType* types = &defaultType;
+	int typeCount = 1;
+	long timeout = -1;
+	Tcl_Obj** sessionObjs;
+	int sessionCount;
+	SessionWaiter* waiters = NULL;
+	WaitGroup group;
+	Tcl_Time deadline, left;
+	Tcl_Obj* res;
+	int i, j, index, started = 0, code = TCL_ERROR;
+
+	UNREFERENCED_PARAMETER(clientData);	/* avoid "unused parameter" warning */
+
+	/* Check number of arguments */
+	if (objc < 2 || objc % 2 != 0) {
+		Tcl_WrongNumArgs(interp, 1, objv, "sessionList ?-events eventTypes? ?-timeout ms?");
+		return TCL_ERROR;
+	}
+
+	if (TCL_OK != Tcl_ListObjGetElements(interp, objv[1], &sessionCount, &sessionObjs)) {
+		return TCL_ERROR;
+	}
+
+	/* Parse options */
+	for (i = 2; i < objc; i += 2) {
+		if (TCL_OK != Tcl_GetIndexFromObj(interp, objv[i], options, "option", 0, &index)) {
+			goto cleanup;
+		}
+
+		switch (index) {
+		case OPT_EVENTS:
+			if (types != &defaultType) {
+				ckfree((char*) types);
+				types = &defaultType;
+			}
+			if (TCL_OK != parseEvents(interp, objv[i + 1], &types, &typeCount)) {
+				types = &defaultType;
+				goto cleanup;
+			}
+			break;
+
+		case OPT_TIMEOUT:
+			if (TCL_OK != Tcl_GetLongFromObj(interp, objv[i + 1], &timeout)) {
+				goto cleanup;
+			}
+			break;
+		}
+	}
+
+	if (sessionCount == 0) {
+		code = TCL_OK;
+		goto cleanup;
+	}
+
+	waiters = (SessionWaiter*) ckalloc(sizeof(SessionWaiter) * sessionCount);
+	memset((void*) waiters, 0, sizeof(SessionWaiter) * sessionCount);
+	memset((void*) &group, 0, sizeof(group));
+
+	/* Convert sessions and enable queueing of requested events */
+	for (i = 0; i < sessionCount; ++i) {
+		SessionWaiter* w = &waiters[i];
+
+		w->data = getConnectedVisaChannelFromObj(interp, sessionObjs[i]);
+		if (NULL == w->data) {
+			goto cleanup;
+		}
+		for (j = 0; j < i; ++j) {
+			if (waiters[j].data == w->data) {
+				Tcl_AppendResult(interp, "session \"", Tcl_GetString(sessionObjs[i]), "\" is listed twice", NULL);
+				goto cleanup;
+			}
+		}
+		w->group = &group;
+		w->eventType = typeCount == 1 ? types[0] : VI_ALL_ENABLED_EVENTS;
+
+		/*
+		 * Queue is left enabled after return, so events arrived between
+		 * two calls are not lost
+		 */
+		for (j = 0; j < typeCount; ++j) {
+			ViStatus status = enableVisaEventQueue(w->data, types[j]);
+			if (status < 0) {
+				storeLastError(w->data, status, interp);
+				goto cleanup;
+			}
+		}
+
+		/* Nothing runs on idle session, so termination only tells whether library supports it */
+		w->abortable = !w->data->stream && !w->data->asyncPending
+			&& viTerminate(w->data->session, VI_NULL, VI_NULL) >= 0;
+	}
+
+	group.timeout = timeout < 0 || (unsigned long) timeout >= VI_TMO_INFINITE ? VI_TMO_INFINITE : (ViUInt32) timeout;
+	if (timeout >= 0) {
+		Tcl_GetTime(&deadline);
+		deadline.sec += timeout / 1000;
+		deadline.usec += (timeout % 1000) * 1000;
+		if (deadline.usec >= 1000000) {
+			deadline.usec -= 1000000;
+			++deadline.sec;
+		}
+	}
+
+	for (started = 0; started < sessionCount; ++started) {
+		if (TCL_OK != Tcl_CreateThread(&waiters[started].threadId, waiterProc, (ClientData) &waiters[started],
+				TCL_THREAD_STACK_DEFAULT, TCL_THREAD_JOINABLE)) {
+			Tcl_AppendResult(interp, "cannot create thread", NULL);
+			break;
+		}
+	}
+
+	/* Wait for the first event or timeout */
+	Tcl_MutexLock(&group.mutex);
+	while (started == sessionCount && !group.ready) {
+		if (timeout < 0) {
+			Tcl_ConditionWait(&group.cond, &group.mutex, NULL);
+		} else if (timeLeft(&deadline, &left)) {
+			break;
+		} else {
+			Tcl_ConditionWait(&group.cond, &group.mutex, &left);
+		}
+	}
+	group.stop = 1;
+
+	/* Thread may enter viWaitOnEvent() after viTerminate(), so it is repeated until thread finishes */
+	while (group.finished < started) {
+		Tcl_Time retry = {0, TERMINATE_RETRY * 1000};
+
+		for (i = 0; i < started; ++i) {
+			if (waiters[i].abortable && !waiters[i].finished) {
+				viTerminate(waiters[i].data->session, VI_NULL, VI_NULL);
+			}
+		}
+		Tcl_ConditionWait(&group.cond, &group.mutex, &retry);
+	}
+	Tcl_MutexUnlock(&group.mutex);
+
+	for (i = 0; i < started; ++i) {
+		int result;
+		Tcl_JoinThread(waiters[i].threadId, &result);
+	}
+
+	Tcl_ConditionFinalize(&group.cond);
+	Tcl_MutexFinalize(&group.mutex);
+
+	if (started < sessionCount) {
+		goto cleanup;
+	}
+
+	/*
+	 * Build list of {session eventType} pairs. Failed session is reported
+	 * in place, so that events dequeued by other threads are not lost.
+	 */
+	res = Tcl_NewListObj(0, NULL);
+	for (i = 0; i < sessionCount; ++i) {
+		SessionWaiter* w = &waiters[i];
+		Tcl_Obj* value;
+
+		if (!w->ready) {
+			continue;
+		}
+
+		storeLastError(w->data, w->status, NULL);
+		if (w->status < 0) {
+			value = Tcl_NewListObj(0, NULL);
+			Tcl_ListObjAppendElement(interp, value, Tcl_NewStringObj("error", -1));
+			Tcl_ListObjAppendElement(interp, value, Tcl_NewStringObj(visaErrorMessage(w->status), -1));
+		} else {
+			value = newVisaEventTypeObj(w->outEventType);
+		}
+
+		Tcl_ListObjAppendElement(interp, res, sessionObjs[i]);
+		Tcl_ListObjAppendElement(interp, res, value);
+	}
+
+	Tcl_SetObjResult(interp, res);
+	code = TCL_OK;
+
+cleanup:
+	if (waiters) {
+		ckfree((char*) waiters);
+	}
+	if (types != &defaultType) {
+		ckfree((char*) types);
+	}
+
+	return code;
+}
@@ -0,0 +1,101 @@
+/*
+ * wait_stb.c --
+ *
+ * This file is part of tclvisa library.
+ *
+ * Copyright (c) 2011 Andrey V. Nakin <andrey.nakin@gmail.com>
+ * All rights reserved.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ */
+
+#include <tcl.h>
+#include "visa_channel.h"
+#include "visa_stb.h"
+#include "visa_reconnect.h"
+#include "visa_utils.h"
+#include "tcl_utils.h"
+#include "tclvisa_utils.h"
+
+int tclvisa_wait_stb(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]) {
+	static const char* options[] = { "-interval", "-srq", "-timeout", NULL };
+	enum { OPT_INTERVAL, OPT_SRQ, OPT_TIMEOUT };
+
+	VisaChannelData* session;
+	ViStatus status;
+	ViUInt16 mask, stb = 0;
+	ViUInt32 timeout, interval = VISA_STB_DEFAULT_INTERVAL;
+	int srq = 0, hasTimeout = 0;
+	int i, index;
+
+	UNREFERENCED_PARAMETER(clientData);	/* avoid "unused parameter" warning */
+
+	/* Check number of arguments */
+	if (objc < 3) {
+		Tcl_WrongNumArgs(interp, 1, objv, "session mask ?-timeout ms? ?-interval us? ?-srq?");
+		return TCL_ERROR;
+	}
+
+	/* Convert first argument to valid Tcl channel reference */
+	session = getConnectedVisaChannelFromObj(interp, objv[1]);
+	if (session == NULL) {
+		return TCL_ERROR;
+	}
+
+	if (Tcl_GetUInt16FromObj(interp, objv[2], &mask)) {
+		return TCL_ERROR;
+	}
+
+	/* Parse options */
+	for (i = 3; i < objc; ++i) {
+		if (TCL_OK != Tcl_GetIndexFromObj(interp, objv[i], options, "option", 0, &index)) {
+			return TCL_ERROR;
+		}
+
+		if (index == OPT_SRQ) {
+			srq = 1;
+			continue;
+		}
+
+		if (++i == objc) {
+			Tcl_AppendResult(interp, "value for \"", TclGetString(objv[i - 1]), "\" missing", NULL);
+			return TCL_ERROR;
+		}
+
+		if (index == OPT_TIMEOUT) {
+			if (Tcl_GetUInt32FromObj(interp, objv[i], &timeout)) {
+				return TCL_ERROR;
+			}
+			hasTimeout = 1;
+		} else if (Tcl_GetUInt32FromObj(interp, objv[i], &interval)) {
+			return TCL_ERROR;
+		}
+	}
+
+	/* By default wait as long as IO operations do */
+	if (!hasTimeout && TCL_OK != getVisaTimeout(interp, session, &timeout)) {
+		return TCL_ERROR;
+	}
+
+	if (srq) {
+		/* Queue stays enabled, as visa::wait-any does, and is enabled again if session is re-opened */
+		status = enableVisaEventQueue(session, VI_EVENT_SERVICE_REQ);
+		if (status < 0) {
+			storeLastError(session, status, interp);
+			return TCL_ERROR;
+		}
+	}
+
+	status = waitVisaStb(session->session, mask, timeout, interval, srq, &stb);
+	/* Check status returned */
+	storeLastError(session, status, interp);
+
+	if (status < 0) {
+		return TCL_ERROR;
+	}
+
+	Tcl_SetObjResult(interp, Tcl_NewIntObj((int) stb));
+	return TCL_OK;
+}
@@ -11,20 +11,22 @@
  *
  */
 
+#include <sys/stat.h>
 #include <tcl.h>
 #include <stdio.h>
 #include "visa_channel.h"
+#include "visa_reconnect.h"
 #include "visa_utils.h"
+#include "visa_transfer.h"
 #include "tcl_utils.h"
 #include "tclvisa_utils.h"
 
-static long getFileSize(const char *fileName);
+static Tcl_WideUInt getFileSize(Tcl_Obj* pathPtr);
 
 int write_from_file(const ClientData clientData, Tcl_Interp* const interp, const int objc, Tcl_Obj* const objv[]) {
 	VisaChannelData* session;
 	ViStatus status;
-	ViUInt32 retCount;
-	long count;
+	Tcl_WideUInt count, retCount;
 	const char* fileName;
 
 	UNREFERENCED_PARAMETER(clientData);	/* avoid "unused parameter" warning */
@@ -36,27 +38,28 @@ int write_from_file(const ClientData clientData, Tcl_Interp* const interp, const
 	}
 
 	/* Convert first argument to valid Tcl channel reference */
-    session = getVisaChannelFromObj(interp, objv[1]);
+    session = getConnectedVisaChannelFromObj(interp, objv[1]);
 	if (session == NULL) {
 		return TCL_ERROR;
 	}
 
+	if (TCL_OK != checkVisaChannelBusy(interp, session, 0)) {
+		return TCL_ERROR;
+	}
+
 	fileName = Tcl_GetString(objv[2]);
 
 	if (objc > 3) {
-		unsigned i;
-
 		// transfer size is specified explicitly
-		if (Tcl_GetUIntFromObj(interp, objv[3], &i)) {
+		if (Tcl_GetUInt64FromObj(interp, objv[3], &count)) {
 			return TCL_ERROR;
 		}
-		count = (long) i;
 	} else {
-		count = getFileSize(fileName);
+		count = getFileSize(objv[2]);
 	}
 
-	/* Attempt to write */
-	status = viWriteFromFile(session->session, fileName, (ViUInt32) count, &retCount);
+	/* Attempt to write, large counts are written in chunks */
+	status = writeVisaFromFile(session->session, fileName, count, &retCount);
 
 	/* Check status returned */
 	if (status < 0 && VI_ERROR_TMO != status) {
@@ -64,20 +67,18 @@ int write_from_file(const ClientData clientData, Tcl_Interp* const interp, const
 		return TCL_ERROR;
 	} else {
 		storeLastError(session, status, NULL);
-		Tcl_SetObjResult(interp, Tcl_NewLongObj((long) retCount));
+		Tcl_SetObjResult(interp, Tcl_NewWideIntObj((Tcl_WideInt) retCount));
 		return TCL_OK;
 	}
 }
 
-static long getFileSize(const char *fileName) {
-	long size = 0;
+static Tcl_WideUInt getFileSize(Tcl_Obj* pathPtr) {
+	Tcl_StatBuf buf;
 
-	FILE *f = fopen(fileName, "rb");
-	if (f) {
-		fseek(f, 0, SEEK_END);
-		size = ftell(f);
-		fclose(f);
+	/* Unlike ftell(), works for files larger than 2 GB */
+	if (Tcl_FSStat(pathPtr, &buf)) {
+		return 0;
 	}
 
-	return size;
+	return (Tcl_WideUInt) buf.st_size;
 }